@@ -1,6 +1,5 @@
 { clang-tools
 , meson
-, libGL
 , ninja
 , pkg-config
 , stdenv
@@ -22,6 +21,5 @@ stdenv.mkDerivation {
   buildInputs = [
     wayland
     wayland-protocols
-    libGL
   ];
 }
@@ -1,127 +1,132 @@
+#define _GNU_SOURCE
 #include "wayland-client-core.h"
-#include "wayland-egl-core.h"
 #include <bits/getopt_core.h>
 #include <wayland-client-protocol.h>
 #include <wayland-client.h>
-#include <wayland-egl.h>
-#include <wayland-server.h>
+#include <viewporter-protocol.h>
 #include <xdg-shell-protocol.h>
 
-#include <EGL/egl.h>
-#include <GLES2/gl2.h>
-
 #include <getopt.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 struct window {
   struct wl_surface *surface;
   struct wl_compositor *compositor;
+  struct wl_shm *shm;
+  struct wp_viewporter *viewporter;
+  struct wp_viewport *viewport;
+  struct wl_buffer *buffer;
+  // the compositor may still read from the buffer until it releases it
+  bool buffer_busy;
 
   struct xdg_wm_base *xdg_base;
   struct xdg_surface *xdg_surface;
   struct xdg_toplevel *xdg_toplevel;
 
-  struct {
-    struct wl_egl_window *window;
-    EGLDisplay display;
-    EGLConfig config;
-    EGLSurface surface;
-    EGLContext context;
-  } egl_context;
+  uint32_t color;
+  // the size from the last toplevel configure and the one drawn at
+  int32_t width, height;
+  int32_t drawn_width, drawn_height;
 };
 
-static void draw(struct window *window, uint32_t color) {
-
-  EGLSurface egl_surface = window->egl_context.surface;
-  EGLDisplay egl_display = window->egl_context.display;
-  EGLContext egl_context = window->egl_context.context;
-  if (!eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context)) {
-    fprintf(stderr, "Made current failed\n");
+static void buffer_release(void *data, struct wl_buffer *buffer) {
+  // buffers replaced while the compositor still had them are done with now
+  struct window *window = data;
+  if (buffer != window->buffer) {
+    wl_buffer_destroy(buffer);
     return;
   }
+  window->buffer_busy = false;
+}
 
-  glClearColor((color >> 16) / 255.f, ((color >> 8) & 0xff) / 255.f,
-               (color & 0xff) / 255.f, 1.f);
-
-  glClear(GL_COLOR_BUFFER_BIT);
-  glFlush();
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
 
-  eglSwapBuffers(egl_display, egl_surface);
-}
+static struct wl_buffer *create_buffer(struct window *window, int32_t width,
+                                       int32_t height) {
+  /* A buffer filled with a single colour is something the compositor can
+   * recognize and draw as a plain rectangle instead of a texture. With a
+   * viewport a single pixel is enough, the compositor scales it up. */
+  int32_t stride = width * 4;
+  size_t size = (size_t)stride * height;
+
+  int fd = memfd_create("color", MFD_CLOEXEC);
+  if (fd < 0 || ftruncate(fd, size) < 0) {
+    fprintf(stderr, "Can't create shm file\n");
+    if (fd >= 0) {
+      close(fd);
+    }
+    return NULL;
+  }
 
-static void create_window(struct window *window) {
+  uint32_t *pixels =
+      mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (pixels == MAP_FAILED) {
+    fprintf(stderr, "Can't map shm file\n");
+    close(fd);
+    return NULL;
+  }
 
-  window->egl_context.window = wl_egl_window_create(window->surface, 480, 360);
-  if (window->egl_context.window == EGL_NO_SURFACE) {
-    fprintf(stderr, "Failed to create EGL window\n");
-    return;
+  for (size_t i = 0, e = size / 4; i < e; ++i) {
+    pixels[i] = 0xff000000 | window->color;
   }
+  munmap(pixels, size);
+
+  struct wl_shm_pool *pool = wl_shm_create_pool(window->shm, fd, size);
+  struct wl_buffer *buffer = wl_shm_pool_create_buffer(
+      pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
+  wl_shm_pool_destroy(pool);
+  close(fd);
+  wl_buffer_add_listener(buffer, &buffer_listener, window);
 
-  window->egl_context.surface = eglCreateWindowSurface(
-      window->egl_context.display, window->egl_context.config,
-      window->egl_context.window, NULL);
+  return buffer;
 }
 
-static void init_egl(struct wl_display *display, struct window *window) {
-  EGLint major, minor, count, n, size;
-  EGLConfig *configs;
-  int i;
-  EGLint config_attribs[] = {EGL_SURFACE_TYPE,
-                             EGL_WINDOW_BIT,
-                             EGL_RED_SIZE,
-                             8,
-                             EGL_GREEN_SIZE,
-                             8,
-                             EGL_BLUE_SIZE,
-                             8,
-                             EGL_RENDERABLE_TYPE,
-                             EGL_OPENGL_ES2_BIT,
-                             EGL_NONE};
-
-  static const EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2,
-                                           EGL_NONE};
-
-  window->egl_context.display = eglGetDisplay((EGLNativeDisplayType)display);
-  if (window->egl_context.display == EGL_NO_DISPLAY) {
-    fprintf(stderr, "Can't create egl display\n");
+static void draw(struct window *window) {
+  if (window->width == window->drawn_width &&
+      window->height == window->drawn_height) {
     return;
-  } else {
-    fprintf(stderr, "Created egl display\n");
   }
 
-  if (eglInitialize(window->egl_context.display, &major, &minor) != EGL_TRUE) {
-    fprintf(stderr, "Can't initialise egl display\n");
-    exit(1);
+  /* With a viewport the single pixel buffer from the start is only scaled to
+   * the new size, attaching it again is harmless and a 1x1 upload. */
+  struct wl_buffer *buffer = window->buffer;
+  if (window->viewport != NULL) {
+    wp_viewport_set_destination(window->viewport, window->width,
+                                window->height);
+  } else {
+    /* Without a viewport the buffer has to cover the whole surface. The old
+     * one goes once the compositor has released it. */
+    if (buffer != NULL && !window->buffer_busy) {
+      wl_buffer_destroy(buffer);
+    }
+    buffer = window->buffer =
+        create_buffer(window, window->width, window->height);
+  }
+  if (buffer == NULL) {
+    return;
   }
-  printf("EGL major: %d, minor %d\n", major, minor);
-
-  eglGetConfigs(window->egl_context.display, NULL, 0, &count);
-  printf("EGL has %d configs\n", count);
-
-  configs = calloc(count, sizeof *configs);
-
-  eglChooseConfig(window->egl_context.display, config_attribs, configs, count,
-                  &n);
 
-  for (i = 0; i < n; i++) {
-    eglGetConfigAttrib(window->egl_context.display, configs[i], EGL_BUFFER_SIZE,
-                       &size);
-    printf("Buffer size for config %d is %d\n", i, size);
-    eglGetConfigAttrib(window->egl_context.display, configs[i], EGL_RED_SIZE,
-                       &size);
-    printf("Red size for config %d is %d\n", i, size);
+  // the whole surface is opaque, so whatever is below doesn't need drawing
+  struct wl_region *opaque = wl_compositor_create_region(window->compositor);
+  wl_region_add(opaque, 0, 0, window->width, window->height);
+  wl_surface_set_opaque_region(window->surface, opaque);
+  wl_region_destroy(opaque);
 
-    // just choose the first one
-    window->egl_context.config = configs[i];
-    break;
-  }
+  wl_surface_attach(window->surface, buffer, 0, 0);
+  window->buffer_busy = true;
+  wl_surface_damage(window->surface, 0, 0, window->width, window->height);
+  wl_surface_commit(window->surface);
 
-  window->egl_context.context =
-      eglCreateContext(window->egl_context.display, window->egl_context.config,
-                       EGL_NO_CONTEXT, context_attribs);
+  window->drawn_width = window->width;
+  window->drawn_height = window->height;
 }
 
 static void global_registry_handler(void *data, struct wl_registry *registry,
@@ -132,6 +137,11 @@ static void global_registry_handler(void *data, struct wl_registry *registry,
   if (strcmp(interface, wl_compositor_interface.name) == 0) {
     window->compositor =
         wl_registry_bind(registry, id, &wl_compositor_interface, 1);
+  } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+    window->shm = wl_registry_bind(registry, id, &wl_shm_interface, 1);
+  } else if (strcmp(interface, wp_viewporter_interface.name) == 0) {
+    window->viewporter =
+        wl_registry_bind(registry, id, &wp_viewporter_interface, 1);
   } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
     window->xdg_base =
         wl_registry_bind(registry, id, &xdg_wm_base_interface, 1);
@@ -154,8 +164,9 @@ static void get_server_references(struct wl_display *display,
 
   wl_display_roundtrip(display);
 
-  if (window->compositor == NULL || window->xdg_base == NULL) {
-    fprintf(stderr, "Can't find compositor or xdg-shell\n");
+  if (window->compositor == NULL || window->shm == NULL ||
+      window->xdg_base == NULL) {
+    fprintf(stderr, "Can't find compositor, shm or xdg-shell\n");
     exit(1);
   } else {
     fprintf(stderr, "Found compositor and shell\n");
@@ -175,12 +186,17 @@ static void handle_configure(void *data, struct xdg_toplevel *toplevel,
   }
 
   struct window *window = data;
-  wl_egl_window_resize(window->egl_context.window, width, height, 0, 0);
+  window->width = width;
+  window->height = height;
 }
 
 static void handle_surface_configure(void *data, struct xdg_surface *surface,
                                      uint32_t serial) {
   xdg_surface_ack_configure(surface, serial);
+
+  // the configure is complete, draw at the size it asked for
+  struct window *window = data;
+  draw(window);
 }
 
 static uint32_t color_from_str(const char *color) {
@@ -235,7 +251,7 @@ int main(int argc, char **argv) {
   }
   printf("connected to display\n");
 
-  struct window window;
+  struct window window = {.color = color, .width = 480, .height = 360};
   get_server_references(display, &window);
 
   window.surface = wl_compositor_create_surface(window.compositor);
@@ -246,6 +262,12 @@ int main(int argc, char **argv) {
     fprintf(stderr, "Created surface\n");
   }
 
+  if (window.viewporter != NULL) {
+    window.viewport =
+        wp_viewporter_get_viewport(window.viewporter, window.surface);
+    window.buffer = create_buffer(&window, 1, 1);
+  }
+
   struct xdg_wm_base_listener wm_base_listener = {.ping = handle_ping};
   xdg_wm_base_add_listener(window.xdg_base, &wm_base_listener, NULL);
 
@@ -254,7 +276,8 @@ int main(int argc, char **argv) {
   };
   window.xdg_surface =
       xdg_wm_base_get_xdg_surface(window.xdg_base, window.surface);
-  xdg_surface_add_listener(window.xdg_surface, &xdg_surface_listener, NULL);
+  xdg_surface_add_listener(window.xdg_surface, &xdg_surface_listener,
+                           &window);
 
   struct xdg_toplevel_listener xdg_toplevel_listener = {.configure =
                                                             handle_configure};
@@ -264,16 +287,9 @@ int main(int argc, char **argv) {
 
   xdg_toplevel_set_title(window.xdg_toplevel, "This is a color!");
 
-  init_egl(display, &window);
-  create_window(&window);
-
-  // recieve the configure events for the xdg surface
+  // recieve the configure events for the xdg surface, which draw the window
   wl_surface_commit(window.surface);
-  wl_display_roundtrip(display);
-
-  draw(&window, color);
   while (wl_display_dispatch(display) != -1) {
-    draw(&window, color);
   }
 
   wl_display_disconnect(display);
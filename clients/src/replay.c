@@ -0,0 +1,786 @@
+#define _GNU_SOURCE
+#include <wayland-client-core.h>
+#include <wayland-client-protocol.h>
+#include <wayland-client.h>
+#include <viewporter-protocol.h>
+#include <xdg-shell-protocol.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Plays back a recording of the compositor's -R option: every recorded
+ * client connects again and sends the same requests at the same times, so
+ * that a new build can be compared against the same workload, e.g. on the
+ * headless backend. Object ids are mapped to the new objects, globals are
+ * bound by interface, and configure and ping serials are answered with
+ * the current ones. Requests on interfaces this doesn't know, or on objects
+ * the compositor created, are skipped.
+ *
+ * The file format is described in compositor/src/record.h. */
+
+#define RECORD_MAGIC "DGDEREC1"
+#define RECORD_SCALE 8
+
+enum record_type {
+  RECORD_CLIENT = 1,
+  RECORD_CLIENT_GONE = 2,
+  RECORD_INTERFACE = 3,
+  RECORD_REQUEST = 4,
+  RECORD_BUFFER = 5,
+};
+
+enum record_contents {
+  RECORD_CONTENTS_NONE = 0,
+  RECORD_CONTENTS_HASH = 1,
+  RECORD_CONTENTS_SCALED = 2,
+};
+
+struct record_header {
+  uint8_t type;
+  uint8_t reserved;
+  uint16_t client;
+  uint32_t size;
+  uint64_t time;
+};
+
+#define MAX_INTERFACES 128
+#define MAX_GLOBALS 64
+#define MAX_ARGS 20
+
+static const struct wl_interface *const known_interfaces[] = {
+    &wl_display_interface,
+    &wl_registry_interface,
+    &wl_callback_interface,
+    &wl_compositor_interface,
+    &wl_shm_pool_interface,
+    &wl_shm_interface,
+    &wl_buffer_interface,
+    &wl_data_offer_interface,
+    &wl_data_source_interface,
+    &wl_data_device_interface,
+    &wl_data_device_manager_interface,
+    &wl_surface_interface,
+    &wl_seat_interface,
+    &wl_pointer_interface,
+    &wl_keyboard_interface,
+    &wl_touch_interface,
+    &wl_output_interface,
+    &wl_region_interface,
+    &wl_subcompositor_interface,
+    &wl_subsurface_interface,
+    &xdg_wm_base_interface,
+    &xdg_positioner_interface,
+    &xdg_surface_interface,
+    &xdg_toplevel_interface,
+    &xdg_popup_interface,
+    &wp_viewporter_interface,
+    &wp_viewport_interface,
+};
+
+/* Memory of a shm pool, shared by its buffers, which can outlive it. */
+struct pool {
+  int refs;
+  int fd;
+  uint8_t *data;
+  size_t size;
+};
+
+struct object {
+  struct wl_proxy *proxy;
+  const struct wl_interface *interface;
+
+  // shm pools and buffers
+  struct pool *pool;
+  int32_t offset, width, height, stride;
+
+  // the last configure of an xdg_surface
+  uint32_t serial;
+  // when a frame callback was asked for, 0 for other callbacks
+  uint64_t frame_requested;
+};
+
+struct global {
+  uint32_t name;
+  char *interface;
+  uint32_t version;
+};
+
+struct client {
+  struct wl_display *display;
+  uint16_t index;
+
+  struct object *objects;
+  uint32_t num_objects;
+
+  struct global globals[MAX_GLOBALS];
+  uint32_t num_globals;
+  // global names of the recording and the ones they were mapped to
+  uint32_t recorded_names[MAX_GLOBALS];
+  uint32_t names[MAX_GLOBALS];
+  uint32_t num_names;
+};
+
+static struct client *clients[UINT16_MAX + 1];
+static const struct wl_interface *interfaces[MAX_INTERFACES];
+
+static uint64_t requests_replayed;
+static uint64_t requests_skipped;
+
+// time from asking for a frame callback to it being done, in microseconds
+static uint64_t *frame_times;
+static size_t num_frame_times;
+static size_t frame_times_cap;
+
+static uint64_t now_nsec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void pool_unref(struct pool *pool) {
+  if (pool == NULL || --pool->refs > 0) {
+    return;
+  }
+  if (pool->data != NULL) {
+    munmap(pool->data, pool->size);
+  }
+  close(pool->fd);
+  free(pool);
+}
+
+static struct object *get_object(struct client *client, uint32_t id) {
+  // ids the compositor allocates are never looked up
+  if (id >= 0xff000000) {
+    return NULL;
+  }
+
+  if (id >= client->num_objects) {
+    uint32_t num = client->num_objects > 0 ? client->num_objects : 64;
+    while (num <= id) {
+      num *= 2;
+    }
+    client->objects = realloc(client->objects, num * sizeof(struct object));
+    memset(client->objects + client->num_objects, 0,
+           (num - client->num_objects) * sizeof(struct object));
+    client->num_objects = num;
+  }
+  return &client->objects[id];
+}
+
+static void forget_object(struct object *object) {
+  pool_unref(object->pool);
+  memset(object, 0, sizeof(*object));
+}
+
+static void add_frame_time(uint64_t usec) {
+  if (num_frame_times == frame_times_cap) {
+    frame_times_cap = frame_times_cap > 0 ? frame_times_cap * 2 : 1024;
+    frame_times = realloc(frame_times, frame_times_cap * sizeof(uint64_t));
+  }
+  frame_times[num_frame_times++] = usec;
+}
+
+static int dispatch_event(const void *implementation, void *target,
+                          uint32_t opcode, const struct wl_message *message,
+                          union wl_argument *args) {
+  /* Only what the replay needs to keep going is handled, everything else
+   * the recorded client did in response is in the recording. */
+  struct client *client = (struct client *)implementation;
+  struct wl_proxy *proxy = target;
+  uint32_t id = (uintptr_t)wl_proxy_get_user_data(proxy);
+  struct object *object = get_object(client, id);
+  if (object->proxy != proxy) {
+    // the recorded client already reused the id, only callbacks get here
+    wl_proxy_destroy(proxy);
+    return 0;
+  }
+  const struct wl_interface *interface = object->interface;
+
+  if (interface == &wl_registry_interface && opcode == 0) {
+    if (client->num_globals < MAX_GLOBALS) {
+      struct global *global = &client->globals[client->num_globals++];
+      global->name = args[0].u;
+      global->interface = strdup(args[1].s);
+      global->version = args[2].u;
+    }
+  } else if (interface == &xdg_wm_base_interface && opcode == 0) {
+    xdg_wm_base_pong((struct xdg_wm_base *)proxy, args[0].u);
+  } else if (interface == &xdg_surface_interface && opcode == 0) {
+    object->serial = args[0].u;
+  } else if (interface == &wl_callback_interface && opcode == 0) {
+    if (object->frame_requested != 0) {
+      add_frame_time((now_nsec() - object->frame_requested) / 1000);
+    }
+    // the compositor destroys callbacks once they are done
+    wl_proxy_destroy(proxy);
+    forget_object(object);
+  }
+  return 0;
+}
+
+static const struct global *find_global(struct client *client,
+                                        uint32_t recorded_name,
+                                        const char *interface) {
+  /* The first recorded global of an interface is bound to our first global
+   * of it, the second to the second and so on. */
+  uint32_t nth = 0;
+  for (uint32_t i = 0; i < client->num_names; ++i) {
+    const struct global *global = NULL;
+    for (uint32_t j = 0; j < client->num_globals; ++j) {
+      if (client->globals[j].name == client->names[i]) {
+        global = &client->globals[j];
+      }
+    }
+    if (global == NULL || strcmp(global->interface, interface) != 0) {
+      continue;
+    }
+    if (client->recorded_names[i] == recorded_name) {
+      return global;
+    }
+    ++nth;
+  }
+
+  for (uint32_t j = 0; j < client->num_globals; ++j) {
+    const struct global *global = &client->globals[j];
+    if (strcmp(global->interface, interface) != 0 || nth-- > 0) {
+      continue;
+    }
+    if (client->num_names < MAX_GLOBALS) {
+      client->recorded_names[client->num_names] = recorded_name;
+      client->names[client->num_names++] = global->name;
+    }
+    return global;
+  }
+  return NULL;
+}
+
+static const struct wl_interface *interface_by_name(const char *name) {
+  for (size_t i = 0;
+       i < sizeof(known_interfaces) / sizeof(known_interfaces[0]); ++i) {
+    if (strcmp(known_interfaces[i]->name, name) == 0) {
+      return known_interfaces[i];
+    }
+  }
+  return NULL;
+}
+
+static int create_shm_file(size_t size) {
+  int fd = memfd_create("replay", MFD_CLOEXEC);
+  if (fd >= 0 && ftruncate(fd, size) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool replay_request(struct client *client, const uint8_t *data,
+                           size_t size) {
+  /* Returns false if the request was skipped. */
+  if (size < 8) {
+    return false;
+  }
+  uint32_t id;
+  uint16_t target[2];
+  memcpy(&id, data, 4);
+  memcpy(target, data + 4, 4);
+  const uint8_t *p = data + 8;
+  const uint8_t *end = data + size;
+
+  const struct wl_interface *interface =
+      target[0] < MAX_INTERFACES ? interfaces[target[0]] : NULL;
+  struct object *object = get_object(client, id);
+  if (interface == NULL || object == NULL || object->proxy == NULL ||
+      target[1] >= interface->method_count) {
+    return false;
+  }
+  uint32_t opcode = target[1];
+  const struct wl_message *message = &interface->methods[opcode];
+
+  union wl_argument args[MAX_ARGS];
+  int fds[MAX_ARGS];
+  int num_args = 0, num_fds = 0;
+  int new_id_arg = -1;
+  const struct wl_interface *new_interface = NULL;
+  uint32_t new_version = wl_proxy_get_version(object->proxy);
+  bool nullable = false;
+  bool skip = false;
+
+  for (const char *c = message->signature; *c != '\0' && !skip; ++c) {
+    if (*c == '?') {
+      nullable = true;
+      continue;
+    }
+    if (*c >= '0' && *c <= '9') {
+      continue;
+    }
+    if (num_args == MAX_ARGS) {
+      return false;
+    }
+
+    union wl_argument *arg = &args[num_args];
+    if (*c != 'h' && p + 4 > end) {
+      return false;
+    }
+    switch (*c) {
+    case 'i':
+    case 'u':
+    case 'f':
+      memcpy(&arg->u, p, 4);
+      p += 4;
+      break;
+    case 'o': {
+      uint32_t object_id;
+      memcpy(&object_id, p, 4);
+      p += 4;
+      struct object *o = object_id != 0 ? get_object(client, object_id) : NULL;
+      arg->o = o != NULL ? (struct wl_object *)o->proxy : NULL;
+      skip = arg->o == NULL && (object_id != 0 || !nullable);
+      break;
+    }
+    case 'n':
+      memcpy(&arg->n, p, 4);
+      p += 4;
+      new_id_arg = num_args;
+      new_interface = message->types[num_args];
+      break;
+    case 's':
+    case 'a': {
+      uint32_t len;
+      memcpy(&len, p, 4);
+      p += 4;
+      if (len > (size_t)(end - p)) {
+        return false;
+      }
+      if (*c == 's') {
+        arg->s = len > 0 ? (const char *)p : NULL;
+      } else {
+        struct wl_array *array = malloc(sizeof(struct wl_array));
+        array->size = array->alloc = len;
+        array->data = (void *)p;
+        arg->a = array;
+      }
+      p += (len + 3) & ~3u;
+      break;
+    }
+    case 'h':
+      // what was passed isn't recorded, only that something was
+      arg->h = fds[num_fds++] = create_shm_file(0);
+      break;
+    }
+    nullable = false;
+    ++num_args;
+  }
+
+  // looking up arguments may have moved it
+  object = get_object(client, id);
+
+  /* Requests whose arguments only made sense to the recorded session. */
+  if (interface == &wl_registry_interface && opcode == WL_REGISTRY_BIND &&
+      !skip) {
+    const struct global *global = find_global(client, args[0].u, args[1].s);
+    new_interface = interface_by_name(args[1].s);
+    if (global == NULL || new_interface == NULL) {
+      skip = true;
+    } else {
+      args[0].u = global->name;
+      new_version = args[2].u < global->version ? args[2].u : global->version;
+      new_version = new_version < (uint32_t)new_interface->version
+                        ? new_version
+                        : (uint32_t)new_interface->version;
+      args[2].u = new_version;
+    }
+  } else if (interface == &xdg_surface_interface &&
+             opcode == XDG_SURFACE_ACK_CONFIGURE) {
+    skip = object->serial == 0;
+    args[0].u = object->serial;
+  } else if (interface == &xdg_wm_base_interface &&
+             opcode == XDG_WM_BASE_PONG) {
+    // pings are answered as they come
+    skip = true;
+  } else if (interface == &wl_shm_interface &&
+             opcode == WL_SHM_CREATE_POOL && !skip) {
+    close(fds[0]);
+    args[1].h = fds[0] = create_shm_file(args[2].i);
+  } else if (interface == &wl_shm_pool_interface &&
+             opcode == WL_SHM_POOL_RESIZE && object->pool != NULL) {
+    struct pool *pool = object->pool;
+    if (ftruncate(pool->fd, args[0].i) == 0 && pool->data != NULL) {
+      munmap(pool->data, pool->size);
+      pool->size = args[0].i;
+      pool->data = mmap(NULL, pool->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        pool->fd, 0);
+      if (pool->data == MAP_FAILED) {
+        pool->data = NULL;
+      }
+    }
+  }
+
+  // the marshalling replaces the new id with the proxy
+  uint32_t new_id = new_id_arg >= 0 ? args[new_id_arg].n : 0;
+  struct wl_proxy *proxy = NULL;
+  if (!skip) {
+    if (new_id_arg >= 0) {
+      proxy = wl_proxy_marshal_array_constructor_versioned(
+          object->proxy, opcode, args, new_interface, new_version);
+    } else {
+      wl_proxy_marshal_array(object->proxy, opcode, args);
+    }
+  }
+
+  for (int i = 0, j = 0; message->signature[i] != '\0'; ++i) {
+    char c = message->signature[i];
+    if (c == '?' || (c >= '0' && c <= '9')) {
+      continue;
+    }
+    if (j >= num_args) {
+      break;
+    }
+    if (c == 'a') {
+      free(args[j].a);
+    }
+    ++j;
+  }
+
+  if (skip) {
+    for (int i = 0; i < num_fds; ++i) {
+      if (fds[i] >= 0) {
+        close(fds[i]);
+      }
+    }
+    return false;
+  }
+
+  if (proxy != NULL) {
+    struct object *created = get_object(client, new_id);
+    object = get_object(client, id);
+    if (created != NULL) {
+      forget_object(created);
+      created->proxy = proxy;
+      created->interface = new_interface;
+      wl_proxy_add_dispatcher(proxy, dispatch_event, client,
+                              (void *)(uintptr_t)new_id);
+
+      if (interface == &wl_surface_interface &&
+          opcode == WL_SURFACE_FRAME) {
+        created->frame_requested = now_nsec();
+      } else if (interface == &wl_shm_interface &&
+                 opcode == WL_SHM_CREATE_POOL) {
+        // keeps the fd, the buffers are painted through the mapping
+        struct pool *pool = calloc(1, sizeof(struct pool));
+        pool->refs = 1;
+        pool->fd = fds[0];
+        fds[0] = -1;
+        pool->size = args[2].i;
+        pool->data = mmap(NULL, pool->size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, pool->fd, 0);
+        if (pool->data == MAP_FAILED) {
+          pool->data = NULL;
+        }
+        created->pool = pool;
+      } else if (interface == &wl_shm_pool_interface &&
+                 opcode == WL_SHM_POOL_CREATE_BUFFER && object->pool != NULL) {
+        created->pool = object->pool;
+        ++object->pool->refs;
+        created->offset = args[1].i;
+        created->width = args[2].i;
+        created->height = args[3].i;
+        created->stride = args[4].i;
+      }
+    } else {
+      wl_proxy_destroy(proxy);
+    }
+  }
+
+  for (int i = 0; i < num_fds; ++i) {
+    if (fds[i] >= 0) {
+      close(fds[i]);
+    }
+  }
+
+  // the protocols don't say which requests are destructors, their names do
+  if (strcmp(message->name, "destroy") == 0 ||
+      strcmp(message->name, "release") == 0) {
+    if (object->proxy != (struct wl_proxy *)client->display) {
+      wl_proxy_destroy(object->proxy);
+      forget_object(object);
+    }
+  }
+  return true;
+}
+
+static void replay_buffer(struct client *client, const uint8_t *data,
+                          size_t size) {
+  /* Paints what was recorded of a buffer's contents into it, a flat colour
+   * for a hash and the scaled down copy scaled up again otherwise. */
+  uint32_t header[4];
+  if (size < sizeof(header)) {
+    return;
+  }
+  memcpy(header, data, sizeof(header));
+  struct object *buffer = get_object(client, header[0]);
+  if (buffer == NULL || buffer->pool == NULL || buffer->pool->data == NULL ||
+      buffer->width != (int32_t)header[1] ||
+      buffer->height != (int32_t)header[2] ||
+      (size_t)buffer->offset + (size_t)buffer->stride * buffer->height >
+          buffer->pool->size) {
+    return;
+  }
+
+  uint8_t *pixels = buffer->pool->data + buffer->offset;
+  const uint8_t *contents = data + sizeof(header);
+  size_t contents_size = size - sizeof(header);
+
+  if (header[3] == RECORD_CONTENTS_HASH && contents_size >= 8) {
+    uint64_t hash;
+    memcpy(&hash, contents, 8);
+    uint32_t color = 0xff000000 | (uint32_t)(hash ^ hash >> 32);
+    for (int32_t y = 0; y < buffer->height; ++y) {
+      uint32_t *row = (uint32_t *)(pixels + (size_t)y * buffer->stride);
+      for (int32_t x = 0; x < buffer->width; ++x) {
+        row[x] = color;
+      }
+    }
+  } else if (header[3] == RECORD_CONTENTS_SCALED && contents_size >= 8) {
+    uint32_t scaled[2];
+    memcpy(scaled, contents, 8);
+    const uint32_t *samples = (const uint32_t *)(contents + 8);
+    if ((size_t)scaled[0] * scaled[1] * 4 > contents_size - 8) {
+      return;
+    }
+    for (int32_t y = 0; y < buffer->height; ++y) {
+      uint32_t *row = (uint32_t *)(pixels + (size_t)y * buffer->stride);
+      const uint32_t *sample_row = samples + (y / RECORD_SCALE) * scaled[0];
+      for (int32_t x = 0; x < buffer->width; ++x) {
+        row[x] = sample_row[x / RECORD_SCALE];
+      }
+    }
+  }
+}
+
+static void client_destroy(struct client *client) {
+  for (uint32_t i = 0; i < client->num_objects; ++i) {
+    pool_unref(client->objects[i].pool);
+  }
+  for (uint32_t i = 0; i < client->num_globals; ++i) {
+    free(client->globals[i].interface);
+  }
+  wl_display_disconnect(client->display);
+  clients[client->index] = NULL;
+  free(client->objects);
+  free(client);
+}
+
+static void client_create(uint16_t index) {
+  struct wl_display *display = wl_display_connect(NULL);
+  if (display == NULL) {
+    fprintf(stderr, "Can't connect to display\n");
+    exit(1);
+  }
+
+  struct client *client = calloc(1, sizeof(struct client));
+  client->display = display;
+  client->index = index;
+  struct object *object = get_object(client, 1);
+  object->proxy = (struct wl_proxy *)display;
+  object->interface = &wl_display_interface;
+  clients[index] = client;
+}
+
+static void dispatch_clients(int timeout) {
+  /* Waits up to timeout milliseconds for events of any client. */
+  struct pollfd fds[256];
+  struct client *polled[256];
+  nfds_t num_fds = 0;
+  for (uint32_t i = 0; i <= UINT16_MAX && num_fds < 256; ++i) {
+    struct client *client = clients[i];
+    if (client == NULL) {
+      continue;
+    }
+    wl_display_dispatch_pending(client->display);
+    wl_display_flush(client->display);
+    fds[num_fds].fd = wl_display_get_fd(client->display);
+    fds[num_fds].events = POLLIN;
+    polled[num_fds++] = client;
+  }
+
+  if (poll(fds, num_fds, timeout) <= 0) {
+    return;
+  }
+
+  for (nfds_t i = 0; i < num_fds; ++i) {
+    if (!(fds[i].revents & POLLIN)) {
+      continue;
+    }
+    struct client *client = polled[i];
+    if (wl_display_dispatch(client->display) < 0) {
+      fprintf(stderr, "client %u: %s\n", client->index,
+              strerror(wl_display_get_error(client->display)));
+      client_destroy(client);
+    }
+  }
+}
+
+static void wait_until(uint64_t time) {
+  for (;;) {
+    uint64_t now = now_nsec();
+    if (now >= time) {
+      dispatch_clients(0);
+      return;
+    }
+    dispatch_clients((time - now + 999999) / 1000000);
+  }
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void print_report(uint64_t recorded, uint64_t replayed) {
+  printf("replayed %llu requests in %.2f s, recorded in %.2f s, skipped %llu\n",
+         (unsigned long long)requests_replayed, replayed / 1e9, recorded / 1e9,
+         (unsigned long long)requests_skipped);
+  if (num_frame_times == 0) {
+    return;
+  }
+
+  qsort(frame_times, num_frame_times, sizeof(uint64_t), compare_u64);
+  printf("frame callbacks: %zu, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max "
+         "%.2f ms\n",
+         num_frame_times, frame_times[num_frame_times / 2] / 1e3,
+         frame_times[num_frame_times * 9 / 10] / 1e3,
+         frame_times[num_frame_times * 99 / 100] / 1e3,
+         frame_times[num_frame_times - 1] / 1e3);
+}
+
+void print_usage(const char *program_name) {
+  printf("usage: %s [-s speed] recording\n", program_name);
+  printf("  -s  replay this many times as fast, 0 as fast as possible\n");
+}
+
+int main(int argc, char **argv) {
+  double speed = 1.0;
+  int c;
+  while ((c = getopt(argc, argv, "s:h")) != -1) {
+    switch (c) {
+    case 's':
+      speed = strtod(optarg, NULL);
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 0;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind != argc - 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  FILE *file = fopen(argv[optind], "r");
+  char magic[8];
+  if (file == NULL || fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+      memcmp(magic, RECORD_MAGIC, sizeof(magic)) != 0) {
+    fprintf(stderr, "Can't read recording %s\n", argv[optind]);
+    return 1;
+  }
+
+  uint8_t *payload = NULL;
+  size_t payload_cap = 0;
+  uint64_t start = now_nsec();
+  uint64_t recorded = 0;
+
+  struct record_header header;
+  while (fread(&header, sizeof(header), 1, file) == 1) {
+    if (header.size > payload_cap) {
+      payload_cap = header.size;
+      payload = realloc(payload, payload_cap);
+    }
+    // an interface is its index followed by a name of at least the NUL
+    if (fread(payload, 1, header.size, file) != header.size ||
+        (header.type == RECORD_INTERFACE && header.size <= 4)) {
+      fprintf(stderr, "Recording is truncated\n");
+      break;
+    }
+
+    recorded = header.time;
+    if (speed > 0) {
+      wait_until(start + (uint64_t)(header.time / speed));
+    }
+
+    struct client *client = clients[header.client];
+    switch (header.type) {
+    case RECORD_CLIENT:
+      if (client == NULL) {
+        client_create(header.client);
+      }
+      break;
+    case RECORD_CLIENT_GONE:
+      if (client != NULL) {
+        wl_display_flush(client->display);
+        client_destroy(client);
+      }
+      break;
+    case RECORD_INTERFACE: {
+      uint32_t index;
+      memcpy(&index, payload, 4);
+      if (index < MAX_INTERFACES) {
+        payload[header.size - 1] = '\0';
+        interfaces[index] = interface_by_name((const char *)payload + 4);
+      }
+      break;
+    }
+    case RECORD_REQUEST:
+      if (client != NULL && replay_request(client, payload, header.size)) {
+        ++requests_replayed;
+        // globals have to be known before anything is bound
+        uint16_t target[2];
+        memcpy(target, payload + 4, 4);
+        if (interfaces[target[0]] == &wl_display_interface &&
+            target[1] == WL_DISPLAY_GET_REGISTRY) {
+          wl_display_roundtrip(client->display);
+        }
+      } else {
+        ++requests_skipped;
+      }
+      break;
+    case RECORD_BUFFER:
+      if (client != NULL) {
+        replay_buffer(client, payload, header.size);
+      }
+      break;
+    }
+
+    if (speed <= 0) {
+      dispatch_clients(0);
+    }
+  }
+
+  // the last frames
+  wait_until(now_nsec() + 100000000);
+  uint64_t replayed = now_nsec() - start;
+
+  for (uint32_t i = 0; i <= UINT16_MAX; ++i) {
+    if (clients[i] != NULL) {
+      client_destroy(clients[i]);
+    }
+  }
+  fclose(file);
+  free(payload);
+
+  print_report(recorded, replayed);
+  free(frame_times);
+  return 0;
+}
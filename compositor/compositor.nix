@@ -7,9 +7,15 @@
 , pkg-config
 , stdenv
 , systemdMinimal
+, systemtap
 , wayland
 , wayland-protocols
 , wlroots
+, xorg
+, zlib
+# the optional parts, off by default like in meson_options.txt
+, xwayland ? false
+, usdt ? false
 }:
 stdenv.mkDerivation {
   name = "dgde-compositor";
@@ -29,5 +35,12 @@ stdenv.mkDerivation {
     wayland
     wayland-protocols
     libxkbcommon
+    zlib
+  ] ++ lib.optional xwayland xorg.libxcb
+    ++ lib.optional usdt systemtap;
+
+  mesonFlags = [
+    "-Dxwayland=${lib.boolToString xwayland}"
+    "-Dusdt=${lib.boolToString usdt}"
   ];
 }
@@ -0,0 +1,432 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "accounting.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_surface.h>
+#include <wlr/util/log.h>
+
+// how many times the dispatch budget the focused client gets
+#define FOCUSED_DISPATCH_SHARE 4
+
+struct dgde_accounting {
+  struct dgde_accounting_config config;
+  struct wl_client *focused;
+
+  // sees every request right before it is dispatched
+  struct wl_protocol_logger *logger;
+  // the client whose requests are being dispatched and when the current one
+  // started, NULL between batches
+  struct client *dispatching;
+  uint64_t request_start;
+  // ends the batch with the event loop iteration
+  struct wl_event_loop *loop;
+  struct wl_event_source *batch_idle;
+
+  struct wl_listener new_surface;
+  struct wl_list clients;
+
+  // rolls the per second counters over and checks budgets
+  struct wl_event_source *rate_timer;
+  // hands held back frame callbacks to throttled clients
+  struct wl_event_source *throttle_timer;
+  int throttle_interval;
+};
+
+struct client {
+  struct wl_list link;
+  struct dgde_accounting *accounting;
+  struct wl_client *wl_client;
+  struct wl_listener destroy;
+
+  struct dgde_client_stats stats;
+  uint32_t commits;
+  uint32_t frames;
+  // in the current second
+  uint64_t dispatch_ns;
+  // used up its dispatch budget for the current second
+  bool flooding;
+
+  struct wl_list surfaces;
+};
+
+struct surface {
+  struct wl_list link;
+  struct client *client;
+  struct wlr_surface *wlr_surface;
+
+  struct wl_listener commit;
+  struct wl_listener destroy;
+
+  uint64_t buffer_bytes;
+  uint64_t texture_bytes;
+
+  // frame callbacks taken from the surface while the client is throttled
+  struct wl_list held_callbacks;
+};
+
+static void release_callbacks(struct surface *surface, uint32_t time) {
+  struct wl_resource *resource, *tmp;
+  wl_resource_for_each_safe(resource, tmp, &surface->held_callbacks) {
+    wl_callback_send_done(resource, time);
+    wl_resource_destroy(resource);
+  }
+}
+
+static void surface_destroy(struct surface *surface) {
+  struct client *client = surface->client;
+  client->stats.buffer_bytes -= surface->buffer_bytes;
+  client->stats.texture_bytes -= surface->texture_bytes;
+  --client->stats.surfaces;
+
+  // wlroots cleans up the callbacks together with the surface
+  wl_list_insert_list(&surface->wlr_surface->current.frame_callback_list,
+                      &surface->held_callbacks);
+
+  wl_list_remove(&surface->link);
+  wl_list_remove(&surface->commit.link);
+  wl_list_remove(&surface->destroy.link);
+  free(surface);
+}
+
+static void handle_surface_destroy(struct wl_listener *listener, void *data) {
+  struct surface *surface = wl_container_of(listener, surface, destroy);
+  surface_destroy(surface);
+}
+
+static uint64_t buffer_bytes(struct wlr_surface *wlr_surface) {
+  struct wl_resource *buffer = wlr_surface->current.buffer_resource;
+  if (buffer == NULL) {
+    return 0;
+  }
+
+  struct wl_shm_buffer *shm_buffer = wl_shm_buffer_get(buffer);
+  if (shm_buffer != NULL) {
+    return (uint64_t)wl_shm_buffer_get_stride(shm_buffer) *
+           wl_shm_buffer_get_height(shm_buffer);
+  }
+
+  // assume 32 bits per pixel for everything else
+  return (uint64_t)wlr_surface->current.buffer_width *
+         wlr_surface->current.buffer_height * 4;
+}
+
+static uint64_t texture_bytes(struct wlr_surface *wlr_surface) {
+  if (wlr_surface->buffer == NULL || wlr_surface->buffer->texture == NULL) {
+    return 0;
+  }
+
+  struct wlr_texture *texture = wlr_surface->buffer->texture;
+  return (uint64_t)texture->width * texture->height * 4;
+}
+
+static uint64_t now_nsec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void add_dispatch_time(struct dgde_accounting *accounting,
+                              uint64_t now) {
+  struct client *client = accounting->dispatching;
+  client->dispatch_ns += now - accounting->request_start;
+  accounting->request_start = now;
+
+  uint64_t budget = (uint64_t)accounting->config.dispatch_budget * 1000000;
+  if (client->wl_client == accounting->focused) {
+    budget *= FOCUSED_DISPATCH_SHARE;
+  }
+  if (budget == 0 || client->flooding || client->dispatch_ns <= budget) {
+    return;
+  }
+
+  /* Throttled right away instead of at the end of the second, the rest of
+   * the second belongs to the other clients. */
+  client->flooding = true;
+  client->stats.throttled = true;
+  wlr_log(WLR_INFO, "client %d used up its dispatch budget of %lu ms/s",
+          client->stats.pid, (unsigned long)(budget / 1000000));
+}
+
+static void handle_surface_commit(struct wl_listener *listener, void *data) {
+  struct surface *surface = wl_container_of(listener, surface, commit);
+  struct client *client = surface->client;
+  struct wlr_surface *wlr_surface = surface->wlr_surface;
+
+  client->stats.buffer_bytes -= surface->buffer_bytes;
+  client->stats.texture_bytes -= surface->texture_bytes;
+  surface->buffer_bytes = buffer_bytes(wlr_surface);
+  surface->texture_bytes = texture_bytes(wlr_surface);
+  client->stats.buffer_bytes += surface->buffer_bytes;
+  client->stats.texture_bytes += surface->texture_bytes;
+
+  /* Committing is the expensive request, uploads and all, and often the last
+   * one in a batch. The commit signal is emitted once all of that is done. */
+  if (client->accounting->dispatching == client) {
+    add_dispatch_time(client->accounting, now_nsec());
+  }
+
+  ++client->commits;
+  if (wl_list_empty(&wlr_surface->current.frame_callback_list)) {
+    return;
+  }
+
+  ++client->frames;
+
+  /* Clients draw when they get a frame callback, so holding them back slows
+   * a client down without it having to know about it. */
+  if (client->stats.throttled) {
+    wl_list_insert_list(surface->held_callbacks.prev,
+                        &wlr_surface->current.frame_callback_list);
+    wl_list_init(&wlr_surface->current.frame_callback_list);
+  }
+}
+
+static void client_destroy(struct client *client) {
+  if (client->accounting->dispatching == client) {
+    client->accounting->dispatching = NULL;
+  }
+
+  struct surface *surface, *tmp;
+  wl_list_for_each_safe(surface, tmp, &client->surfaces, link) {
+    surface_destroy(surface);
+  }
+
+  wl_list_remove(&client->link);
+  wl_list_remove(&client->destroy.link);
+  free(client);
+}
+
+static void handle_client_destroy(struct wl_listener *listener, void *data) {
+  struct client *client = wl_container_of(listener, client, destroy);
+  client_destroy(client);
+}
+
+static struct client *get_client(struct dgde_accounting *accounting,
+                                 struct wl_client *wl_client) {
+  struct wl_listener *listener =
+      wl_client_get_destroy_listener(wl_client, handle_client_destroy);
+  if (listener != NULL) {
+    struct client *client = wl_container_of(listener, client, destroy);
+    return client;
+  }
+
+  struct client *client = calloc(1, sizeof(struct client));
+  client->accounting = accounting;
+  client->wl_client = wl_client;
+  wl_client_get_credentials(wl_client, &client->stats.pid, NULL, NULL);
+  wl_list_init(&client->surfaces);
+  client->destroy.notify = handle_client_destroy;
+  wl_client_add_destroy_listener(wl_client, &client->destroy);
+  wl_list_insert(&accounting->clients, &client->link);
+
+  return client;
+}
+
+static void new_surface(struct wl_listener *listener, void *data) {
+  struct dgde_accounting *accounting =
+      wl_container_of(listener, accounting, new_surface);
+  struct wlr_surface *wlr_surface = data;
+
+  struct client *client =
+      get_client(accounting, wl_resource_get_client(wlr_surface->resource));
+
+  struct surface *surface = calloc(1, sizeof(struct surface));
+  surface->client = client;
+  surface->wlr_surface = wlr_surface;
+  wl_list_init(&surface->held_callbacks);
+  surface->commit.notify = handle_surface_commit;
+  wl_signal_add(&wlr_surface->events.commit, &surface->commit);
+  surface->destroy.notify = handle_surface_destroy;
+  wl_signal_add(&wlr_surface->events.destroy, &surface->destroy);
+
+  wl_list_insert(&client->surfaces, &surface->link);
+  ++client->stats.surfaces;
+}
+
+static void end_batch(void *data) {
+  /* Idle sources run once the event loop is done with everything that was
+   * ready, a batch never spans more than one iteration. */
+  struct dgde_accounting *accounting = data;
+  accounting->batch_idle = NULL;
+  accounting->dispatching = NULL;
+}
+
+static void log_request(void *data, enum wl_protocol_logger_type type,
+                        const struct wl_protocol_logger_message *message) {
+  if (type != WL_PROTOCOL_LOGGER_REQUEST) {
+    return;
+  }
+
+  /* A request ends where the next one of the same batch starts. Nothing else
+   * runs in between, all requests a client has sent are dispatched in one
+   * go. */
+  struct dgde_accounting *accounting = data;
+  uint64_t now = now_nsec();
+  struct wl_client *wl_client = wl_resource_get_client(message->resource);
+  if (accounting->dispatching != NULL &&
+      accounting->dispatching->wl_client == wl_client) {
+    add_dispatch_time(accounting, now);
+    return;
+  }
+
+  accounting->dispatching = get_client(accounting, wl_client);
+  accounting->request_start = now;
+  if (accounting->batch_idle == NULL) {
+    accounting->batch_idle =
+        wl_event_loop_add_idle(accounting->loop, end_batch, accounting);
+  }
+}
+
+static uint32_t now_msec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void check_budget(struct dgde_accounting *accounting,
+                         struct client *client) {
+  const struct dgde_accounting_config *config = &accounting->config;
+  struct dgde_client_stats *stats = &client->stats;
+
+  uint64_t memory = stats->buffer_bytes + stats->texture_bytes;
+  bool over_budget =
+      (config->memory_budget > 0 && memory > config->memory_budget) ||
+      (config->commit_budget > 0 && stats->commit_rate > config->commit_budget);
+
+  if (over_budget && !stats->over_budget) {
+    wlr_log(WLR_INFO,
+            "client %d is over budget: %lu KiB in %u surfaces, %u commits/s%s",
+            stats->pid, (unsigned long)(memory / 1024), stats->surfaces,
+            stats->commit_rate, config->throttle ? ", throttling" : "");
+  } else if (!over_budget && stats->over_budget) {
+    wlr_log(WLR_INFO, "client %d is within budget again", stats->pid);
+  }
+
+  stats->over_budget = over_budget;
+  stats->throttled = (over_budget && config->throttle) || client->flooding;
+
+  if (!stats->throttled) {
+    uint32_t time = now_msec();
+    struct surface *surface;
+    wl_list_for_each(surface, &client->surfaces, link) {
+      release_callbacks(surface, time);
+    }
+  }
+}
+
+static int update_rates(void *data) {
+  struct dgde_accounting *accounting = data;
+
+  struct client *client;
+  wl_list_for_each(client, &accounting->clients, link) {
+    client->stats.commit_rate = client->commits;
+    client->stats.frame_rate = client->frames;
+    client->stats.dispatch_time = client->dispatch_ns / 1000;
+    client->commits = 0;
+    client->frames = 0;
+    client->dispatch_ns = 0;
+    client->flooding = false;
+
+    check_budget(accounting, client);
+  }
+
+  wl_event_source_timer_update(accounting->rate_timer, 1000);
+  return 0;
+}
+
+static int release_throttled(void *data) {
+  struct dgde_accounting *accounting = data;
+  uint32_t time = now_msec();
+
+  struct client *client;
+  wl_list_for_each(client, &accounting->clients, link) {
+    if (!client->stats.throttled) {
+      continue;
+    }
+
+    struct surface *surface;
+    wl_list_for_each(surface, &client->surfaces, link) {
+      release_callbacks(surface, time);
+    }
+  }
+
+  wl_event_source_timer_update(accounting->throttle_timer,
+                               accounting->throttle_interval);
+  return 0;
+}
+
+struct dgde_accounting *
+dgde_accounting_create(struct wl_display *display,
+                       struct wlr_compositor *compositor,
+                       const struct dgde_accounting_config *config) {
+  struct dgde_accounting *accounting =
+      calloc(1, sizeof(struct dgde_accounting));
+  accounting->config = *config;
+  wl_list_init(&accounting->clients);
+
+  accounting->new_surface.notify = new_surface;
+  wl_signal_add(&compositor->events.new_surface, &accounting->new_surface);
+
+  struct wl_event_loop *loop = wl_display_get_event_loop(display);
+  accounting->loop = loop;
+  accounting->rate_timer = wl_event_loop_add_timer(loop, update_rates,
+                                                   accounting);
+  wl_event_source_timer_update(accounting->rate_timer, 1000);
+
+  accounting->logger =
+      wl_display_add_protocol_logger(display, log_request, accounting);
+
+  /* Throttled clients get to draw at the commit budget, or at 10 frames per
+   * second if they are only over their memory or dispatch budget. */
+  if (config->throttle || config->dispatch_budget > 0) {
+    accounting->throttle_interval =
+        config->commit_budget > 0 ? 1000 / config->commit_budget : 100;
+    if (accounting->throttle_interval < 1) {
+      accounting->throttle_interval = 1;
+    }
+
+    accounting->throttle_timer =
+        wl_event_loop_add_timer(loop, release_throttled, accounting);
+    wl_event_source_timer_update(accounting->throttle_timer,
+                                 accounting->throttle_interval);
+  }
+
+  return accounting;
+}
+
+void dgde_accounting_for_each_client(struct dgde_accounting *accounting,
+                                     dgde_accounting_client_fn fn,
+                                     void *userdata) {
+  struct client *client;
+  wl_list_for_each(client, &accounting->clients, link) {
+    fn(&client->stats, userdata);
+  }
+}
+
+void dgde_accounting_set_focus(struct dgde_accounting *accounting,
+                               struct wl_client *client) {
+  accounting->focused = client;
+}
+
+void dgde_accounting_destroy(struct dgde_accounting *accounting) {
+  struct client *client, *tmp;
+  wl_list_for_each_safe(client, tmp, &accounting->clients, link) {
+    client_destroy(client);
+  }
+
+  wl_list_remove(&accounting->new_surface.link);
+  wl_protocol_logger_destroy(accounting->logger);
+  if (accounting->batch_idle != NULL) {
+    wl_event_source_remove(accounting->batch_idle);
+  }
+  wl_event_source_remove(accounting->rate_timer);
+  if (accounting->throttle_timer != NULL) {
+    wl_event_source_remove(accounting->throttle_timer);
+  }
+  free(accounting);
+}
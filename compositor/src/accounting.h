@@ -0,0 +1,68 @@
+#ifndef ACCOUNTING_H
+#define ACCOUNTING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_compositor.h>
+
+/* Keeps track of what every client costs the compositor: the buffers it has
+ * committed, the textures they were uploaded to, its surfaces, how often it
+ * commits and how long its requests take to dispatch. Clients over budget are
+ * logged and, if configured, throttled by holding back their frame callbacks.
+ *
+ * With a dispatch budget, clients flooding the compositor with requests are
+ * throttled as soon as they have used it up for the current second, so that
+ * a single client can't take the event loop away from input and everyone
+ * else. The focused client gets a larger share. Request times are measured
+ * from one request to the next within a client's batch, a batch ends with
+ * the event loop iteration it was dispatched in. */
+
+struct dgde_accounting_config {
+  // buffer and texture bytes per client, 0 is unlimited
+  uint64_t memory_budget;
+  // commits per second per client, 0 is unlimited
+  uint32_t commit_budget;
+  // milliseconds per second spent dispatching a client's requests, 0 is
+  // unlimited
+  uint32_t dispatch_budget;
+  // only log clients over budget if false
+  bool throttle;
+};
+
+struct dgde_client_stats {
+  pid_t pid;
+  uint32_t surfaces;
+  uint64_t buffer_bytes;
+  uint64_t texture_bytes;
+  // per second, over the last full second
+  uint32_t commit_rate;
+  uint32_t frame_rate;
+  // microseconds per second spent dispatching its requests
+  uint32_t dispatch_time;
+  bool over_budget;
+  bool throttled;
+};
+
+struct dgde_accounting;
+
+struct dgde_accounting *
+dgde_accounting_create(struct wl_display *display,
+                       struct wlr_compositor *compositor,
+                       const struct dgde_accounting_config *config);
+
+typedef void (*dgde_accounting_client_fn)(const struct dgde_client_stats *,
+                                          void *);
+void dgde_accounting_for_each_client(struct dgde_accounting *accounting,
+                                     dgde_accounting_client_fn fn,
+                                     void *userdata);
+
+/* The client with keyboard focus, NULL for none. */
+void dgde_accounting_set_focus(struct dgde_accounting *accounting,
+                               struct wl_client *client);
+
+void dgde_accounting_destroy(struct dgde_accounting *accounting);
+
+#endif
@@ -0,0 +1,411 @@
+#define _GNU_SOURCE
+
+#include "clipboard.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <wlr/util/log.h>
+
+// mime types copied per selection, the rest are left out
+#define MAX_TYPES 16
+// moved per splice call, pipes hold 64 KiB by default
+#define CHUNK_SIZE (1 << 20)
+
+struct cached_type {
+  char *mime_type;
+  int fd;
+  size_t size;
+};
+
+/* A selection as copied into memfds, set on the seat like any other
+ * source. */
+struct cached_source {
+  struct wlr_data_source base;
+  struct dgde_clipboard *clipboard;
+  struct cached_type types[MAX_TYPES];
+  uint32_t num_types;
+};
+
+/* The selection of a client while it is being copied. */
+struct snapshot {
+  struct dgde_clipboard *clipboard;
+  // NULL once the client destroyed it
+  struct wlr_data_source *source;
+  struct wl_listener source_destroy;
+
+  struct cached_type types[MAX_TYPES];
+  // the read end of the pipe each type arrives on, -1 once it is complete
+  int pipes[MAX_TYPES];
+  struct wl_event_source *sources[MAX_TYPES];
+  uint32_t num_types;
+  uint32_t pending;
+  size_t size;
+
+  // the source has types that aren't copied
+  bool partial;
+};
+
+/* A paste being served from a cached_source. */
+struct transfer {
+  struct wl_list link;
+  struct dgde_clipboard *clipboard;
+  int from;
+  loff_t offset;
+  size_t size;
+  int to;
+  struct wl_event_source *source;
+};
+
+struct dgde_clipboard {
+  struct wl_event_loop *loop;
+  struct wlr_seat *seat;
+  uint64_t max_size;
+  char *mime_types;
+
+  // NULL unless a selection is being copied
+  struct snapshot *snapshot;
+  struct wl_list transfers;
+};
+
+static bool wanted(const struct dgde_clipboard *clipboard,
+                   const char *mime_type) {
+  const char *pattern = clipboard->mime_types;
+  while (*pattern != '\0') {
+    size_t len = strcspn(pattern, ",");
+    if (len > 0 && pattern[len - 1] == '*') {
+      if (strncmp(pattern, mime_type, len - 1) == 0) {
+        return true;
+      }
+    } else if (strlen(mime_type) == len &&
+               strncmp(pattern, mime_type, len) == 0) {
+      return true;
+    }
+
+    pattern += len;
+    if (*pattern == ',') {
+      ++pattern;
+    }
+  }
+  return false;
+}
+
+static void transfer_destroy(struct transfer *transfer) {
+  if (transfer->source != NULL) {
+    wl_event_source_remove(transfer->source);
+  }
+  close(transfer->from);
+  close(transfer->to);
+  wl_list_remove(&transfer->link);
+  free(transfer);
+}
+
+static int transfer_writable(int fd, uint32_t mask, void *data) {
+  struct transfer *transfer = data;
+
+  while (transfer->offset < (loff_t)transfer->size) {
+    size_t len = transfer->size - transfer->offset;
+    if (len > CHUNK_SIZE) {
+      len = CHUNK_SIZE;
+    }
+
+    /* Pastes are almost always into a pipe, anything else gets the data by
+     * sendfile. Both leave it in the page cache. */
+    ssize_t n = splice(transfer->from, &transfer->offset, transfer->to, NULL,
+                       len, SPLICE_F_NONBLOCK);
+    if (n < 0 && errno == EINVAL) {
+      off_t offset = transfer->offset;
+      n = sendfile(transfer->to, transfer->from, &offset, len);
+      transfer->offset = offset;
+    }
+
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN) {
+      // the client isn't reading as fast, wait until it is
+      if (transfer->source == NULL) {
+        transfer->source = wl_event_loop_add_fd(
+            transfer->clipboard->loop, transfer->to, WL_EVENT_WRITABLE,
+            transfer_writable, transfer);
+      }
+      return 0;
+    }
+    // EPIPE is the normal end of a paste the reader stopped early, as in
+    // wl-paste | head -c1
+    if (n <= 0) {
+      break;
+    }
+  }
+
+  transfer_destroy(transfer);
+  return 0;
+}
+
+static void cached_source_send(struct wlr_data_source *wlr_source,
+                               const char *mime_type, int32_t fd) {
+  struct cached_source *source = (struct cached_source *)wlr_source;
+  struct cached_type *type = NULL;
+  for (uint32_t i = 0; i < source->num_types; ++i) {
+    if (strcmp(source->types[i].mime_type, mime_type) == 0) {
+      type = &source->types[i];
+      break;
+    }
+  }
+
+  if (type == NULL) {
+    close(fd);
+    return;
+  }
+
+  /* Every paste reads its own duplicate, the source can be replaced while it
+   * is going on. */
+  struct transfer *transfer = calloc(1, sizeof(struct transfer));
+  transfer->clipboard = source->clipboard;
+  transfer->from = fcntl(type->fd, F_DUPFD_CLOEXEC, 0);
+  transfer->size = type->size;
+  transfer->to = fd;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  wl_list_insert(&source->clipboard->transfers, &transfer->link);
+
+  if (transfer->from < 0) {
+    transfer_destroy(transfer);
+    return;
+  }
+  transfer_writable(fd, WL_EVENT_WRITABLE, transfer);
+}
+
+static void cached_source_destroy(struct wlr_data_source *wlr_source) {
+  struct cached_source *source = (struct cached_source *)wlr_source;
+  for (uint32_t i = 0; i < source->num_types; ++i) {
+    free(source->types[i].mime_type);
+    close(source->types[i].fd);
+  }
+  free(source);
+}
+
+static const struct wlr_data_source_impl cached_source_impl = {
+    .send = cached_source_send,
+    .destroy = cached_source_destroy,
+};
+
+static void snapshot_destroy(struct snapshot *snapshot) {
+  for (uint32_t i = 0; i < snapshot->num_types; ++i) {
+    if (snapshot->pipes[i] >= 0) {
+      wl_event_source_remove(snapshot->sources[i]);
+      close(snapshot->pipes[i]);
+    }
+    free(snapshot->types[i].mime_type);
+    if (snapshot->types[i].fd >= 0) {
+      close(snapshot->types[i].fd);
+    }
+  }
+
+  if (snapshot->source != NULL) {
+    wl_list_remove(&snapshot->source_destroy.link);
+  }
+  snapshot->clipboard->snapshot = NULL;
+  free(snapshot);
+}
+
+static void snapshot_install(struct snapshot *snapshot) {
+  struct dgde_clipboard *clipboard = snapshot->clipboard;
+  struct cached_source *source = calloc(1, sizeof(struct cached_source));
+  wlr_data_source_init(&source->base, &cached_source_impl);
+  source->clipboard = clipboard;
+
+  for (uint32_t i = 0; i < snapshot->num_types; ++i) {
+    struct cached_type *type = &snapshot->types[i];
+    // nobody gets to change it while it is being pasted
+    fcntl(type->fd, F_ADD_SEALS,
+          F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+
+    char **mime_type = wl_array_add(&source->base.mime_types, sizeof(char *));
+    *mime_type = strdup(type->mime_type);
+    source->types[source->num_types++] = *type;
+    type->mime_type = NULL;
+    type->fd = -1;
+  }
+
+  wlr_log(WLR_DEBUG, "clipboard: copied %zu bytes in %u types", snapshot->size,
+          source->num_types);
+
+  /* Replacing the selection cancels the source of the client, its
+   * destruction must not reach the snapshot anymore. */
+  if (snapshot->source != NULL) {
+    wl_list_remove(&snapshot->source_destroy.link);
+    snapshot->source = NULL;
+  }
+  snapshot_destroy(snapshot);
+  wlr_seat_set_selection(clipboard->seat, &source->base,
+                         wl_display_next_serial(clipboard->seat->display));
+}
+
+static void snapshot_check(struct snapshot *snapshot) {
+  if (snapshot->pending > 0) {
+    return;
+  }
+  if (snapshot->num_types == 0) {
+    snapshot_destroy(snapshot);
+  } else if (!snapshot->partial || snapshot->source == NULL) {
+    snapshot_install(snapshot);
+  }
+}
+
+static void snapshot_abort(struct snapshot *snapshot, const char *reason) {
+  wlr_log(WLR_DEBUG, "clipboard: not copying the selection, %s", reason);
+  snapshot_destroy(snapshot);
+}
+
+static int snapshot_readable(int fd, uint32_t mask, void *data) {
+  struct snapshot *snapshot = data;
+  uint32_t i = 0;
+  while (i < snapshot->num_types && snapshot->pipes[i] != fd) {
+    ++i;
+  }
+  struct cached_type *type = &snapshot->types[i];
+  uint64_t max_size = snapshot->clipboard->max_size;
+
+  for (;;) {
+    // one byte more than is allowed is enough to tell it is too large
+    size_t len = max_size - snapshot->size + 1;
+    if (len > CHUNK_SIZE) {
+      len = CHUNK_SIZE;
+    }
+    loff_t offset = type->size;
+    ssize_t n = splice(fd, NULL, type->fd, &offset, len,
+                       SPLICE_F_NONBLOCK | SPLICE_F_MOVE);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN) {
+      return 0;
+    }
+    if (n < 0) {
+      snapshot_abort(snapshot, strerror(errno));
+      return 0;
+    }
+    if (n == 0) {
+      break;
+    }
+
+    type->size += n;
+    snapshot->size += n;
+    if (snapshot->size > max_size) {
+      snapshot_abort(snapshot, "it is too large");
+      return 0;
+    }
+  }
+
+  // the client closed its end, this type is complete
+  wl_event_source_remove(snapshot->sources[i]);
+  close(fd);
+  snapshot->pipes[i] = -1;
+  --snapshot->pending;
+  snapshot_check(snapshot);
+  return 0;
+}
+
+static void snapshot_source_destroy(struct wl_listener *listener,
+                                    void *data) {
+  /* The client is gone or dropped the selection. What it already wrote is
+   * still read, and then becomes the selection. */
+  struct snapshot *snapshot =
+      wl_container_of(listener, snapshot, source_destroy);
+  wl_list_remove(&snapshot->source_destroy.link);
+  snapshot->source = NULL;
+  snapshot_check(snapshot);
+}
+
+static bool snapshot_add_type(struct snapshot *snapshot,
+                              struct wlr_data_source *source,
+                              const char *mime_type) {
+  int fds[2];
+  int memfd = memfd_create("dgde-clipboard", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memfd < 0) {
+    return false;
+  }
+  if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+    close(memfd);
+    return false;
+  }
+
+  uint32_t i = snapshot->num_types++;
+  snapshot->types[i].mime_type = strdup(mime_type);
+  snapshot->types[i].fd = memfd;
+  snapshot->types[i].size = 0;
+  snapshot->pipes[i] = fds[0];
+  snapshot->sources[i] =
+      wl_event_loop_add_fd(snapshot->clipboard->loop, fds[0], WL_EVENT_READABLE,
+                           snapshot_readable, snapshot);
+  ++snapshot->pending;
+
+  // takes ownership of the write end
+  wlr_data_source_send(source, mime_type, fds[1]);
+  return true;
+}
+
+void dgde_clipboard_set_selection(struct dgde_clipboard *clipboard,
+                                  struct wlr_data_source *source,
+                                  uint32_t serial) {
+  if (clipboard->snapshot != NULL) {
+    snapshot_destroy(clipboard->snapshot);
+  }
+
+  wlr_seat_set_selection(clipboard->seat, source, serial);
+  if (source == NULL) {
+    return;
+  }
+
+  struct snapshot *snapshot = calloc(1, sizeof(struct snapshot));
+  snapshot->clipboard = clipboard;
+  snapshot->source = source;
+  snapshot->source_destroy.notify = snapshot_source_destroy;
+  wl_signal_add(&source->events.destroy, &snapshot->source_destroy);
+  clipboard->snapshot = snapshot;
+
+  char **mime_type;
+  wl_array_for_each(mime_type, &source->mime_types) {
+    if (snapshot->num_types == MAX_TYPES || !wanted(clipboard, *mime_type) ||
+        !snapshot_add_type(snapshot, source, *mime_type)) {
+      snapshot->partial = true;
+    }
+  }
+
+  if (snapshot->num_types == 0) {
+    snapshot_destroy(snapshot);
+  }
+}
+
+struct dgde_clipboard *
+dgde_clipboard_create(struct wl_event_loop *loop, struct wlr_seat *seat,
+                      const struct dgde_clipboard_config *config) {
+  struct dgde_clipboard *clipboard = calloc(1, sizeof(struct dgde_clipboard));
+  clipboard->loop = loop;
+  clipboard->seat = seat;
+  clipboard->max_size = config->max_size;
+  clipboard->mime_types = strdup(config->mime_types);
+  wl_list_init(&clipboard->transfers);
+  return clipboard;
+}
+
+void dgde_clipboard_destroy(struct dgde_clipboard *clipboard) {
+  if (clipboard->snapshot != NULL) {
+    snapshot_destroy(clipboard->snapshot);
+  }
+
+  struct transfer *transfer, *tmp;
+  wl_list_for_each_safe(transfer, tmp, &clipboard->transfers, link) {
+    transfer_destroy(transfer);
+  }
+
+  free(clipboard->mime_types);
+  free(clipboard);
+}
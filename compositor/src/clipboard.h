@@ -0,0 +1,42 @@
+#ifndef CLIPBOARD_H
+#define CLIPBOARD_H
+
+#include <stdint.h>
+
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_data_device.h>
+#include <wlr/types/wlr_seat.h>
+
+/* Keeps a copy of the selection in the compositor, so that it survives the
+ * client it was copied from and pastes don't depend on that client being
+ * responsive. Every offered mime type on the list is read into a memfd as
+ * soon as something is copied. Once that is done the copy becomes the
+ * selection, or, if the source offered types that weren't copied, once the
+ * source goes away.
+ *
+ * Data is moved between pipes and memfds with splice, a paste of a large
+ * image doesn't go through user space and never blocks the event loop. */
+
+struct dgde_clipboard_config {
+  // bytes per selection, all mime types together, a selection that is larger
+  // is not copied
+  uint64_t max_size;
+  // comma separated, a trailing * matches any suffix, e.g. "text/*,image/png"
+  const char *mime_types;
+};
+
+struct dgde_clipboard;
+
+struct dgde_clipboard *
+dgde_clipboard_create(struct wl_event_loop *loop, struct wlr_seat *seat,
+                      const struct dgde_clipboard_config *config);
+
+/* Sets the selection of the seat and starts copying it, source may be NULL
+ * to clear it. */
+void dgde_clipboard_set_selection(struct dgde_clipboard *clipboard,
+                                  struct wlr_data_source *source,
+                                  uint32_t serial);
+
+void dgde_clipboard_destroy(struct dgde_clipboard *clipboard);
+
+#endif
@@ -0,0 +1,359 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "composite.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <wlr/util/log.h>
+
+#define TILE_SIZE 128
+
+struct dgde_render_list {
+  struct dgde_render_item *items;
+  uint32_t num_items;
+  uint32_t capacity;
+};
+
+struct target {
+  uint32_t *data;
+  pixman_format_code_t format;
+  int width;
+  int height;
+  int stride;
+};
+
+struct dgde_composite_pool {
+  pthread_t *threads;
+  uint32_t num_threads;
+
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  uint64_t generation;
+  uint32_t busy;
+  bool quit;
+
+  // the current job, only written by the main thread while all workers are
+  // idle
+  const struct dgde_render_list *list;
+  struct target target;
+  pixman_color_t clear;
+  pixman_region32_t *damage;
+  uint32_t tiles_x;
+  uint32_t num_tiles;
+  atomic_uint next_tile;
+};
+
+struct dgde_render_list *dgde_render_list_create(void) {
+  return calloc(1, sizeof(struct dgde_render_list));
+}
+
+void dgde_render_list_reset(struct dgde_render_list *list) {
+  list->num_items = 0;
+}
+
+static struct dgde_render_item *push_item(struct dgde_render_list *list) {
+  if (list->num_items == list->capacity) {
+    uint32_t capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+    struct dgde_render_item *items =
+        realloc(list->items, capacity * sizeof(struct dgde_render_item));
+    if (items == NULL) {
+      return NULL;
+    }
+
+    list->items = items;
+    list->capacity = capacity;
+  }
+
+  return &list->items[list->num_items++];
+}
+
+void dgde_render_list_add_rect(struct dgde_render_list *list,
+                               const struct wlr_box *box,
+                               const float color[4]) {
+  struct dgde_render_item *item = push_item(list);
+  if (item == NULL) {
+    return;
+  }
+
+  item->type = DgdeRenderItem_Rect;
+  item->box = *box;
+  for (uint32_t i = 0; i < 4; ++i) {
+    item->color[i] = color[i];
+  }
+}
+
+void dgde_render_list_add_image(struct dgde_render_list *list,
+                                const struct wlr_box *box,
+                                pixman_image_t *image,
+                                const struct wlr_fbox *src) {
+  struct dgde_render_item *item = push_item(list);
+  if (item == NULL) {
+    return;
+  }
+
+  item->type = DgdeRenderItem_Image;
+  item->box = *box;
+  item->image.data = pixman_image_get_data(image);
+  item->image.format = pixman_image_get_format(image);
+  item->image.width = pixman_image_get_width(image);
+  item->image.height = pixman_image_get_height(image);
+  item->image.stride = pixman_image_get_stride(image);
+  if (src != NULL) {
+    item->image.src = *src;
+  } else {
+    item->image.src = (struct wlr_fbox){
+        .width = item->image.width,
+        .height = item->image.height,
+    };
+  }
+}
+
+void dgde_render_list_destroy(struct dgde_render_list *list) {
+  free(list->items);
+  free(list);
+}
+
+static pixman_color_t to_pixman_color(const float color[4]) {
+  return (pixman_color_t){
+      .red = color[0] * 0xffff,
+      .green = color[1] * 0xffff,
+      .blue = color[2] * 0xffff,
+      .alpha = color[3] * 0xffff,
+  };
+}
+
+static bool clip(const struct wlr_box *box, const pixman_box32_t *tile,
+                 pixman_box32_t *result) {
+  result->x1 = box->x > tile->x1 ? box->x : tile->x1;
+  result->y1 = box->y > tile->y1 ? box->y : tile->y1;
+  result->x2 = box->x + box->width < tile->x2 ? box->x + box->width : tile->x2;
+  result->y2 =
+      box->y + box->height < tile->y2 ? box->y + box->height : tile->y2;
+
+  return result->x1 < result->x2 && result->y1 < result->y2;
+}
+
+static void composite_rect(const struct dgde_render_item *item,
+                           pixman_image_t *dest, const pixman_box32_t *area) {
+  pixman_color_t color = to_pixman_color(item->color);
+  pixman_op_t op = item->color[3] >= 1.f ? PIXMAN_OP_SRC : PIXMAN_OP_OVER;
+  pixman_image_fill_boxes(op, dest, &color, 1, area);
+}
+
+static void composite_image(const struct dgde_render_item *item,
+                            pixman_image_t *dest, const pixman_box32_t *area) {
+  pixman_image_t *src = pixman_image_create_bits_no_clear(
+      item->image.format, item->image.width, item->image.height,
+      item->image.data, item->image.stride);
+  if (src == NULL) {
+    return;
+  }
+
+  // buffer transforms are not supported by the tiled path yet, only scaling
+  // and cropping
+  const struct wlr_fbox *crop = &item->image.src;
+  int src_x = area->x1 - item->box.x;
+  int src_y = area->y1 - item->box.y;
+  bool scaled =
+      item->box.width != crop->width || item->box.height != crop->height;
+  if (!scaled && crop->x == (int)crop->x && crop->y == (int)crop->y) {
+    /* Crops at their own size, e.g. glyphs out of the atlas, are plain
+     * copies from an offset into the image. */
+    src_x += crop->x;
+    src_y += crop->y;
+  } else {
+    struct pixman_transform transform;
+    pixman_transform_init_scale(
+        &transform, pixman_double_to_fixed(crop->width / item->box.width),
+        pixman_double_to_fixed(crop->height / item->box.height));
+    pixman_transform_translate(&transform, NULL,
+                               pixman_double_to_fixed(crop->x),
+                               pixman_double_to_fixed(crop->y));
+    pixman_image_set_transform(src, &transform);
+    pixman_image_set_filter(
+        src, scaled ? PIXMAN_FILTER_BILINEAR : PIXMAN_FILTER_NEAREST, NULL, 0);
+  }
+
+  // buffers without alpha can just be copied
+  pixman_op_t op = PIXMAN_FORMAT_A(item->image.format) == 0 ? PIXMAN_OP_SRC
+                                                             : PIXMAN_OP_OVER;
+  pixman_image_composite32(op, src, NULL, dest, src_x, src_y, 0, 0, area->x1,
+                           area->y1, area->x2 - area->x1,
+                           area->y2 - area->y1);
+  pixman_image_unref(src);
+}
+
+static void composite_tile(struct dgde_composite_pool *pool, uint32_t index) {
+  const struct target *target = &pool->target;
+  int x = (index % pool->tiles_x) * TILE_SIZE;
+  int y = (index / pool->tiles_x) * TILE_SIZE;
+  pixman_box32_t tile = {
+      .x1 = x,
+      .y1 = y,
+      .x2 = x + TILE_SIZE < target->width ? x + TILE_SIZE : target->width,
+      .y2 = y + TILE_SIZE < target->height ? y + TILE_SIZE : target->height,
+  };
+
+  if (pool->damage != NULL && pixman_region32_contains_rectangle(
+                                  pool->damage, &tile) == PIXMAN_REGION_OUT) {
+    return;
+  }
+
+  // every tile gets its own view of the target so that pixman never touches
+  // state shared with the other threads
+  pixman_image_t *dest = pixman_image_create_bits_no_clear(
+      target->format, target->width, target->height, target->data,
+      target->stride);
+  if (dest == NULL) {
+    return;
+  }
+
+  pixman_image_fill_boxes(PIXMAN_OP_SRC, dest, &pool->clear, 1, &tile);
+
+  const struct dgde_render_list *list = pool->list;
+  for (uint32_t i = 0, e = list->num_items; i < e; ++i) {
+    const struct dgde_render_item *item = &list->items[i];
+    pixman_box32_t area;
+    if (!clip(&item->box, &tile, &area)) {
+      continue;
+    }
+
+    switch (item->type) {
+    case DgdeRenderItem_Rect:
+      composite_rect(item, dest, &area);
+      break;
+    case DgdeRenderItem_Image:
+      composite_image(item, dest, &area);
+      break;
+    }
+  }
+
+  pixman_image_unref(dest);
+}
+
+static void composite_tiles(struct dgde_composite_pool *pool) {
+  uint32_t tile;
+  while ((tile = atomic_fetch_add(&pool->next_tile, 1)) < pool->num_tiles) {
+    composite_tile(pool, tile);
+  }
+}
+
+static void *worker_main(void *data) {
+  struct dgde_composite_pool *pool = data;
+  uint64_t generation = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (true) {
+    while (!pool->quit && pool->generation == generation) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+
+    if (pool->quit) {
+      break;
+    }
+
+    generation = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    composite_tiles(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->busy == 0) {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+struct dgde_composite_pool *dgde_composite_pool_create(uint32_t num_threads) {
+  struct dgde_composite_pool *pool =
+      calloc(1, sizeof(struct dgde_composite_pool));
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  atomic_init(&pool->next_tile, 0);
+
+  // the thread calling dgde_composite_pool_run also composites tiles, so it
+  // counts as one of the threads
+  uint32_t num_workers = num_threads > 0 ? num_threads - 1 : 0;
+  pool->threads = calloc(num_workers, sizeof(pthread_t));
+  // signals are left to the main thread, see dgde_log_init
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  for (uint32_t i = 0; i < num_workers; ++i) {
+    if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+      wlr_log(WLR_ERROR, "failed to create composition thread %d", i);
+      break;
+    }
+    ++pool->num_threads;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  wlr_log(WLR_DEBUG, "created composition pool with %d worker threads",
+          pool->num_threads);
+
+  return pool;
+}
+
+void dgde_composite_pool_run(struct dgde_composite_pool *pool,
+                             const struct dgde_render_list *list,
+                             pixman_image_t *target, const float clear[4],
+                             pixman_region32_t *damage) {
+  pool->list = list;
+  pool->damage = damage;
+  pool->target = (struct target){
+      .data = pixman_image_get_data(target),
+      .format = pixman_image_get_format(target),
+      .width = pixman_image_get_width(target),
+      .height = pixman_image_get_height(target),
+      .stride = pixman_image_get_stride(target),
+  };
+  pool->clear = to_pixman_color(clear);
+  pool->tiles_x = (pool->target.width + TILE_SIZE - 1) / TILE_SIZE;
+  pool->num_tiles =
+      pool->tiles_x * ((pool->target.height + TILE_SIZE - 1) / TILE_SIZE);
+  atomic_store(&pool->next_tile, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->busy = pool->num_threads;
+  ++pool->generation;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  composite_tiles(pool);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busy > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  pool->list = NULL;
+  pool->damage = NULL;
+}
+
+void dgde_composite_pool_destroy(struct dgde_composite_pool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (uint32_t i = 0, e = pool->num_threads; i < e; ++i) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->work);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->threads);
+  free(pool);
+}
@@ -0,0 +1,64 @@
+#ifndef COMPOSITE_H
+#define COMPOSITE_H
+
+#include <pixman.h>
+#include <stdint.h>
+
+#include <wlr/types/wlr_box.h>
+
+enum dgde_render_item_type {
+  DgdeRenderItem_Rect,
+  DgdeRenderItem_Image,
+};
+
+/* A single thing to draw, in output buffer coordinates. Images only reference
+ * the pixel data of the texture, the compositing threads create their own
+ * pixman images from it so that nothing is shared between them except for
+ * read-only memory. */
+struct dgde_render_item {
+  enum dgde_render_item_type type;
+  struct wlr_box box;
+
+  union {
+    float color[4];
+    struct {
+      uint32_t *data;
+      pixman_format_code_t format;
+      int width;
+      int height;
+      int stride;
+      // the part of the image stretched over the box, in buffer pixels
+      struct wlr_fbox src;
+    } image;
+  };
+};
+
+struct dgde_render_list;
+
+struct dgde_render_list *dgde_render_list_create(void);
+void dgde_render_list_reset(struct dgde_render_list *list);
+void dgde_render_list_add_rect(struct dgde_render_list *list,
+                               const struct wlr_box *box, const float color[4]);
+/* src crops the image, NULL uses all of it. */
+void dgde_render_list_add_image(struct dgde_render_list *list,
+                                const struct wlr_box *box,
+                                pixman_image_t *image,
+                                const struct wlr_fbox *src);
+void dgde_render_list_destroy(struct dgde_render_list *list);
+
+struct dgde_composite_pool;
+
+struct dgde_composite_pool *dgde_composite_pool_create(uint32_t num_threads);
+
+/* Composites all items in the list onto target, splitting the target into
+ * tiles that are distributed over the worker threads (and the calling
+ * thread). Only tiles touching damage are drawn, NULL redraws everything.
+ * Returns when the target has been drawn. */
+void dgde_composite_pool_run(struct dgde_composite_pool *pool,
+                             const struct dgde_render_list *list,
+                             pixman_image_t *target, const float clear[4],
+                             pixman_region32_t *damage);
+
+void dgde_composite_pool_destroy(struct dgde_composite_pool *pool);
+
+#endif
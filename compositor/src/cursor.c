@@ -1,4 +1,6 @@
 #include "cursor.h"
+#include "probes.h"
+#include "trace.h"
 #include "wayland-server-core.h"
 
 #include <stdint.h>
@@ -9,6 +11,12 @@
 
 #define MAX_CURSOR_HANDLERS 16
 
+enum pending {
+  Pending_None,
+  Pending_Motion,
+  Pending_MotionAbsolute,
+};
+
 struct dgde_cursor {
   struct wlr_cursor *inner;
   struct wlr_xcursor_manager *xcursor;
@@ -25,8 +33,86 @@ struct dgde_cursor {
   uint32_t num_handlers;
 
   enum dgde_cursor_mode mode;
+
+  // motion waiting to be passed on to the handlers, see queue_motion
+  struct wl_event_loop *loop;
+  struct wl_event_source *flush_idle;
+  enum pending pending;
+  uint32_t coalesced;
+  struct wlr_event_pointer_motion pending_motion;
+  struct wlr_event_pointer_motion_absolute pending_motion_absolute;
+  bool frame_pending;
 };
 
+static void dispatch_motion(struct dgde_cursor *cursor) {
+  dgde_trace_begin("pointer motion", cursor->coalesced);
+  DGDE_PROBE(motion_begin, (int)cursor->inner->x, (int)cursor->inner->y,
+             cursor->coalesced);
+
+  // ☎️
+  for (uint32_t i = 0, e = cursor->num_handlers; i < e; ++i) {
+    struct dgde_cursor_handler *handler = &cursor->handlers[i];
+    if (cursor->pending == Pending_Motion && handler->motion != NULL) {
+      handler->motion(handler->userdata, &cursor->pending_motion);
+    } else if (cursor->pending == Pending_MotionAbsolute &&
+               handler->motion_absolute != NULL) {
+      handler->motion_absolute(handler->userdata,
+                               &cursor->pending_motion_absolute);
+    }
+  }
+
+  cursor->pending = Pending_None;
+  cursor->coalesced = 0;
+  DGDE_PROBE(motion_end, (int)cursor->inner->x, (int)cursor->inner->y);
+  dgde_trace_end("pointer motion");
+}
+
+static void dispatch_frame(struct dgde_cursor *cursor) {
+  // ☎️
+  for (uint32_t i = 0, e = cursor->num_handlers; i < e; ++i) {
+    struct dgde_cursor_handler *handler = &cursor->handlers[i];
+    if (handler->frame != NULL) {
+      handler->frame(handler->userdata);
+    }
+  }
+}
+
+static void flush_motion(struct dgde_cursor *cursor) {
+  if (cursor->pending != Pending_None) {
+    dispatch_motion(cursor);
+  }
+
+  if (cursor->frame_pending) {
+    cursor->frame_pending = false;
+    dispatch_frame(cursor);
+  }
+}
+
+static void flush_idle(void *data) {
+  struct dgde_cursor *cursor = data;
+  // idle sources only fire once
+  cursor->flush_idle = NULL;
+  flush_motion(cursor);
+}
+
+static void queue_motion(struct dgde_cursor *cursor, enum pending pending) {
+  /* The cursor itself moves right away, but finding the view under it and
+   * telling the client is left until everything that queued up while the
+   * event loop was busy has been read. A burst of motion after a slow frame
+   * then costs a single hit test and motion event instead of one for each
+   * event libinput had buffered. */
+  if (cursor->pending != pending) {
+    flush_motion(cursor);
+    cursor->pending = pending;
+  }
+  ++cursor->coalesced;
+
+  if (cursor->flush_idle == NULL) {
+    cursor->flush_idle =
+        wl_event_loop_add_idle(cursor->loop, flush_idle, cursor);
+  }
+}
+
 static void on_motion(struct wl_listener *listener, void *data) {
   /* This event is forwarded by the cursor when a pointer emits a _relative_
    * pointer motion event (i.e. a delta) */
@@ -39,12 +125,17 @@ static void on_motion(struct wl_listener *listener, void *data) {
    * the cursor around without any input. */
   wlr_cursor_move(cursor->inner, event->device, event->delta_x, event->delta_y);
 
-  // ☎️
-  for (uint32_t i = 0, e = cursor->num_handlers; i < e; ++i) {
-    struct dgde_cursor_handler *handler = &cursor->handlers[i];
-    if (handler->motion != NULL) {
-      handler->motion(handler->userdata, event);
-    }
+  bool first = cursor->pending != Pending_Motion;
+  queue_motion(cursor, Pending_Motion);
+  if (first) {
+    cursor->pending_motion = *event;
+  } else {
+    // the handlers look at the cursor position, the deltas just add up
+    cursor->pending_motion.time_msec = event->time_msec;
+    cursor->pending_motion.delta_x += event->delta_x;
+    cursor->pending_motion.delta_y += event->delta_y;
+    cursor->pending_motion.unaccel_dx += event->unaccel_dx;
+    cursor->pending_motion.unaccel_dy += event->unaccel_dy;
   }
 }
 
@@ -59,13 +150,9 @@ static void on_motion_absolute(struct wl_listener *listener, void *data) {
       wl_container_of(listener, cursor, motion_absolute);
   struct wlr_event_pointer_motion_absolute *event = data;
   wlr_cursor_warp_absolute(cursor->inner, event->device, event->x, event->y);
-  // ☎️
-  for (uint32_t i = 0, e = cursor->num_handlers; i < e; ++i) {
-    struct dgde_cursor_handler *handler = &cursor->handlers[i];
-    if (handler->motion_absolute != NULL) {
-      handler->motion_absolute(handler->userdata, event);
-    }
-  }
+
+  queue_motion(cursor, Pending_MotionAbsolute);
+  cursor->pending_motion_absolute = *event;
 }
 
 static void on_button(struct wl_listener *listener, void *data) {
@@ -73,6 +160,11 @@ static void on_button(struct wl_listener *listener, void *data) {
    * event. */
   struct dgde_cursor *cursor = wl_container_of(listener, cursor, button);
   struct wlr_event_pointer_button *event = data;
+  dgde_trace_begin("pointer button", event->button);
+  DGDE_PROBE(button_begin, event->button, event->state);
+
+  // the button has to go to whatever is under the cursor now
+  flush_motion(cursor);
 
   // ☎️
   for (uint32_t i = 0, e = cursor->num_handlers; i < e; ++i) {
@@ -86,6 +178,8 @@ static void on_button(struct wl_listener *listener, void *data) {
   if (event->state == WLR_BUTTON_RELEASED) {
     dgde_cursor_reset_mode(cursor);
   }
+  DGDE_PROBE(button_end, event->button);
+  dgde_trace_end("pointer button");
 }
 
 static void on_axis(struct wl_listener *listener, void *data) {
@@ -94,6 +188,8 @@ static void on_axis(struct wl_listener *listener, void *data) {
   struct dgde_cursor *cursor = wl_container_of(listener, cursor, axis);
   struct wlr_event_pointer_axis *event = data;
   // TODO: something?
+  dgde_trace_begin("pointer axis", event->time_msec);
+  flush_motion(cursor);
 
   // ☎️
   for (uint32_t i = 0, e = cursor->num_handlers; i < e; ++i) {
@@ -102,21 +198,21 @@ static void on_axis(struct wl_listener *listener, void *data) {
       handler->axis(handler->userdata, event);
     }
   }
+  dgde_trace_end("pointer axis");
 }
 
 static void on_frame(struct wl_listener *listener, void *data) {
   /* This event is forwarded by the cursor when a pointer emits an axis event,
    * for example when you move the scroll wheel. */
   struct dgde_cursor *cursor = wl_container_of(listener, cursor, frame);
-  // TODO: something?
 
-  // ☎️
-  for (uint32_t i = 0, e = cursor->num_handlers; i < e; ++i) {
-    struct dgde_cursor_handler *handler = &cursor->handlers[i];
-    if (handler->frame != NULL) {
-      handler->frame(handler->userdata);
-    }
+  // frames end a group of events, so they wait for any motion in the group
+  if (cursor->pending != Pending_None) {
+    cursor->frame_pending = true;
+    return;
   }
+
+  dispatch_frame(cursor);
 }
 
 static void seat_request_cursor(struct wl_listener *listener, void *data) {
@@ -137,9 +233,11 @@ static void seat_request_cursor(struct wl_listener *listener, void *data) {
   }
 }
 
-struct dgde_cursor *dgde_cursor_create(struct wlr_output_layout *output_layout,
+struct dgde_cursor *dgde_cursor_create(struct wl_event_loop *loop,
+                                       struct wlr_output_layout *output_layout,
                                        struct wlr_seat *seat) {
   struct dgde_cursor *cursor = calloc(1, sizeof(struct dgde_cursor));
+  cursor->loop = loop;
 
   cursor->inner = wlr_cursor_create();
   wlr_cursor_attach_output_layout(cursor->inner, output_layout);
@@ -227,6 +325,9 @@ void dgde_cursor_add_handler(struct dgde_cursor *cursor,
 }
 
 void dgde_cursor_destroy(struct dgde_cursor *cursor) {
+  if (cursor->flush_idle != NULL) {
+    wl_event_source_remove(cursor->flush_idle);
+  }
   wlr_xcursor_manager_destroy(cursor->xcursor);
   wlr_cursor_destroy(cursor->inner);
 }
@@ -38,7 +38,10 @@ struct dgde_cursor_handler {
   dgde_cursor_frame_cb frame;
 };
 
-struct dgde_cursor *dgde_cursor_create(struct wlr_output_layout *output_layout,
+/* Motion that queued up while the event loop was busy is passed on to the
+ * handlers as a single event, once everything pending has been read. */
+struct dgde_cursor *dgde_cursor_create(struct wl_event_loop *loop,
+                                       struct wlr_output_layout *output_layout,
                                        struct wlr_seat *seat);
 
 void dgde_cursor_new_pointer(struct dgde_cursor *cursor,
@@ -1,13 +1,45 @@
 #include "decorations.h"
+#include "composite.h"
+#include "text.h"
 #include <stdint.h>
 
 const uint32_t DECORATION_SIZE[4] = {24, 7, 7, 7};
 
+/* Decorations are either drawn directly with the renderer or collected into a
+ * render list for the tiled compositor. */
+struct painter {
+  struct wlr_renderer *renderer;
+  const float *projection;
+  struct dgde_render_list *list;
+  struct dgde_glyph_atlas *atlas;
+};
+
+static void paint_rect(const struct painter *painter, const struct wlr_box *box,
+                       const float *color) {
+  if (painter->list != NULL) {
+    dgde_render_list_add_rect(painter->list, box, color);
+  } else {
+    wlr_render_rect(painter->renderer, box, color, painter->projection);
+  }
+}
+
+static void paint_text(const struct painter *painter, const struct wlr_box *box,
+                       const struct dgde_text *text, const float *color) {
+  if (painter->list != NULL) {
+    dgde_glyph_atlas_collect(painter->atlas, painter->list, text, box, color);
+  } else {
+    dgde_glyph_atlas_render(painter->atlas, painter->renderer,
+                            painter->projection, text, box, color);
+  }
+}
+
 static void draw_titlebar(const struct wlr_box *window,
-                          struct wlr_renderer *renderer,
-                          const float *projection, const float *colors[4]) {
+                          const struct dgde_text *title,
+                          const struct painter *painter,
+                          const float *colors[4]) {
 
   const float *base = colors[0];
+  const float *text = colors[1];
   const float *dark = colors[2];
   const float *light = colors[3];
 
@@ -20,23 +52,32 @@ static void draw_titlebar(const struct wlr_box *window,
 
   struct wlr_box b1 = b;
 
-  wlr_render_rect(renderer, &b, base, projection);
+  paint_rect(painter, &b, base);
 
   // "shadows"
   b1.height = 2;
-  wlr_render_rect(renderer, &b1, light, projection);
+  paint_rect(painter, &b1, light);
   b1.y = b.y + b.height - 2;
-  wlr_render_rect(renderer, &b1, dark, projection);
+  paint_rect(painter, &b1, dark);
 
   b1 = b;
   b1.width = 2;
-  wlr_render_rect(renderer, &b1, light, projection);
+  paint_rect(painter, &b1, light);
   b1.x = b.x + b.width - 2;
-  wlr_render_rect(renderer, &b1, dark, projection);
+  paint_rect(painter, &b1, dark);
+
+  // the title goes inside the shadows, with a little room on the sides
+  const struct wlr_box text_box = {
+      .x = b.x + 4,
+      .y = b.y + 2,
+      .width = b.width - 8,
+      .height = b.height - 4,
+  };
+  paint_text(painter, &text_box, title, text);
 }
 
 static void draw_borders(const struct wlr_box *window,
-                         struct wlr_renderer *renderer, const float *projection,
+                         const struct painter *painter,
                          const float *colors[4]) {
   const float *base = colors[0];
   const float *dark = colors[2];
@@ -51,17 +92,17 @@ static void draw_borders(const struct wlr_box *window,
     b.x = window->x;
     b.width = window->width;
     b.height = 1;
-    wlr_render_rect(renderer, &b, dark, projection);
+    paint_rect(painter, &b, dark);
 
     b.y += 1;
     b.height = 2;
-    wlr_render_rect(renderer, &b, light, projection);
+    paint_rect(painter, &b, light);
 
     b.y += 2;
-    wlr_render_rect(renderer, &b, base, projection);
+    paint_rect(painter, &b, base);
 
     b.y += 2;
-    wlr_render_rect(renderer, &b, dark, projection);
+    paint_rect(painter, &b, dark);
   }
 
   // left + right  border
@@ -70,24 +111,24 @@ static void draw_borders(const struct wlr_box *window,
   b.y = window->y + 1;
   b.width = 1;
   b.height = window->height - 2;
-  wlr_render_rect(renderer, &b, dark, projection);
+  paint_rect(painter, &b, dark);
 
   b.width = 2;
 
   b.y += 2;
   b.height -= 4;
   b.x += 1;
-  wlr_render_rect(renderer, &b, light, projection);
+  paint_rect(painter, &b, light);
 
   b.height -= 2;
   b.y += 2;
   b.x += 2;
-  wlr_render_rect(renderer, &b, base, projection);
+  paint_rect(painter, &b, base);
 
   b.height -= 6;
   b.y += 2;
   b.x += 2;
-  wlr_render_rect(renderer, &b, dark, projection);
+  paint_rect(painter, &b, dark);
 
   // right border
   start += window->width - DECORATION_SIZE[1];
@@ -95,29 +136,43 @@ static void draw_borders(const struct wlr_box *window,
   b.y = window->y + 7;
   b.width = 1;
   b.height = window->height - 13;
-  wlr_render_rect(renderer, &b, dark, projection);
+  paint_rect(painter, &b, dark);
 
   b.width = 2;
 
   b.y -= 2;
   b.height += 2;
   b.x += 1;
-  wlr_render_rect(renderer, &b, light, projection);
+  paint_rect(painter, &b, light);
 
   b.height += 4;
   b.y -= 2;
   b.x += 2;
-  wlr_render_rect(renderer, &b, base, projection);
+  paint_rect(painter, &b, base);
 
   b.height += 6;
   b.y -= 2;
   b.x += 2;
-  wlr_render_rect(renderer, &b, dark, projection);
+  paint_rect(painter, &b, dark);
 }
 
 void decorate_window(const struct wlr_box *window,
+                     const struct dgde_text *title,
+                     struct dgde_glyph_atlas *atlas,
                      struct wlr_renderer *renderer, const float *projection,
                      const float *colors[4]) {
-  draw_borders(window, renderer, projection, colors);
-  draw_titlebar(window, renderer, projection, colors);
+  struct painter painter = {
+      .renderer = renderer, .projection = projection, .atlas = atlas};
+  draw_borders(window, &painter, colors);
+  draw_titlebar(window, title, &painter, colors);
+}
+
+void decorate_window_collect(const struct wlr_box *window,
+                             const struct dgde_text *title,
+                             struct dgde_glyph_atlas *atlas,
+                             struct dgde_render_list *list,
+                             const float *colors[4]) {
+  struct painter painter = {.list = list, .atlas = atlas};
+  draw_borders(window, &painter, colors);
+  draw_titlebar(window, title, &painter, colors);
 }
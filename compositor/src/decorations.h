@@ -5,10 +5,22 @@
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_box.h>
 
+struct dgde_text;
+struct dgde_glyph_atlas;
+
 void decorate_window(const struct wlr_box *window,
+                     const struct dgde_text *title,
+                     struct dgde_glyph_atlas *atlas,
                      struct wlr_renderer *renderer, const float *projection,
                      const float *colors[4]);
 
+struct dgde_render_list;
+void decorate_window_collect(const struct wlr_box *window,
+                             const struct dgde_text *title,
+                             struct dgde_glyph_atlas *atlas,
+                             struct dgde_render_list *list,
+                             const float *colors[4]);
+
 extern const uint32_t DECORATION_SIZE[4];
 
 #endif
@@ -0,0 +1,17 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+
+/* The built-in titlebar font, printable ASCII only. Every glyph is a cell of
+ * FONT_WIDTH x FONT_HEIGHT pixels, one byte per row with the leftmost pixel
+ * in the highest bit. */
+
+#define FONT_FIRST_CHAR ' '
+#define FONT_NUM_GLYPHS 95
+#define FONT_WIDTH 7
+#define FONT_HEIGHT 12
+
+extern const uint8_t FONT_GLYPHS[FONT_NUM_GLYPHS][FONT_HEIGHT];
+
+#endif
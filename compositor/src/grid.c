@@ -0,0 +1,154 @@
+#include "grid.h"
+
+#include <stdlib.h>
+
+struct cell {
+  void **items;
+  uint32_t num_items;
+  uint32_t capacity;
+};
+
+struct dgde_grid {
+  uint32_t cell_size;
+  uint32_t columns;
+  uint32_t rows;
+  struct cell *cells;
+};
+
+struct cell_range {
+  uint32_t x1, y1;
+  uint32_t x2, y2;
+};
+
+static uint32_t clamp_cell(int coord, uint32_t cell_size, uint32_t num_cells) {
+  if (coord < 0) {
+    return 0;
+  }
+
+  uint32_t cell = coord / cell_size;
+  return cell < num_cells ? cell : num_cells - 1;
+}
+
+static struct cell_range cells_of(const struct dgde_grid *grid,
+                                  const struct wlr_box *box) {
+  // an empty box still lives in the cell of its position
+  int right = box->x + (box->width > 0 ? box->width - 1 : 0);
+  int bottom = box->y + (box->height > 0 ? box->height - 1 : 0);
+
+  return (struct cell_range){
+      .x1 = clamp_cell(box->x, grid->cell_size, grid->columns),
+      .y1 = clamp_cell(box->y, grid->cell_size, grid->rows),
+      .x2 = clamp_cell(right, grid->cell_size, grid->columns),
+      .y2 = clamp_cell(bottom, grid->cell_size, grid->rows),
+  };
+}
+
+static void allocate_cells(struct dgde_grid *grid, uint32_t width,
+                           uint32_t height) {
+  grid->columns = (width + grid->cell_size - 1) / grid->cell_size;
+  grid->rows = (height + grid->cell_size - 1) / grid->cell_size;
+  if (grid->columns == 0) {
+    grid->columns = 1;
+  }
+  if (grid->rows == 0) {
+    grid->rows = 1;
+  }
+
+  grid->cells = calloc(grid->columns * grid->rows, sizeof(struct cell));
+}
+
+static void free_cells(struct dgde_grid *grid) {
+  for (uint32_t i = 0, e = grid->columns * grid->rows; i < e; ++i) {
+    free(grid->cells[i].items);
+  }
+  free(grid->cells);
+}
+
+struct dgde_grid *dgde_grid_create(uint32_t width, uint32_t height,
+                                   uint32_t cell_size) {
+  struct dgde_grid *grid = calloc(1, sizeof(struct dgde_grid));
+  grid->cell_size = cell_size > 0 ? cell_size : 1;
+  allocate_cells(grid, width, height);
+
+  return grid;
+}
+
+void dgde_grid_reset(struct dgde_grid *grid, uint32_t width, uint32_t height) {
+  free_cells(grid);
+  allocate_cells(grid, width, height);
+}
+
+static void cell_add(struct cell *cell, void *item) {
+  if (cell->num_items == cell->capacity) {
+    uint32_t capacity = cell->capacity == 0 ? 4 : cell->capacity * 2;
+    void **items = realloc(cell->items, capacity * sizeof(void *));
+    if (items == NULL) {
+      return;
+    }
+
+    cell->items = items;
+    cell->capacity = capacity;
+  }
+
+  cell->items[cell->num_items++] = item;
+}
+
+static void cell_remove(struct cell *cell, void *item) {
+  for (uint32_t i = 0, e = cell->num_items; i < e; ++i) {
+    if (cell->items[i] == item) {
+      // order within a cell doesn't matter
+      cell->items[i] = cell->items[--cell->num_items];
+      return;
+    }
+  }
+}
+
+void dgde_grid_insert(struct dgde_grid *grid, void *item,
+                      const struct wlr_box *box) {
+  struct cell_range range = cells_of(grid, box);
+  for (uint32_t y = range.y1; y <= range.y2; ++y) {
+    for (uint32_t x = range.x1; x <= range.x2; ++x) {
+      cell_add(&grid->cells[y * grid->columns + x], item);
+    }
+  }
+}
+
+void dgde_grid_remove(struct dgde_grid *grid, void *item,
+                      const struct wlr_box *box) {
+  struct cell_range range = cells_of(grid, box);
+  for (uint32_t y = range.y1; y <= range.y2; ++y) {
+    for (uint32_t x = range.x1; x <= range.x2; ++x) {
+      cell_remove(&grid->cells[y * grid->columns + x], item);
+    }
+  }
+}
+
+static void query_cell(const struct cell *cell, dgde_grid_fn fn,
+                       void *userdata) {
+  for (uint32_t i = 0, e = cell->num_items; i < e; ++i) {
+    fn(cell->items[i], userdata);
+  }
+}
+
+void dgde_grid_query_point(const struct dgde_grid *grid, int x, int y,
+                           dgde_grid_fn fn, void *userdata) {
+  uint32_t column = clamp_cell(x, grid->cell_size, grid->columns);
+  uint32_t row = clamp_cell(y, grid->cell_size, grid->rows);
+  query_cell(&grid->cells[row * grid->columns + column], fn, userdata);
+}
+
+void dgde_grid_query_box(const struct dgde_grid *grid,
+                         const struct wlr_box *box, dgde_grid_fn fn,
+                         void *userdata) {
+  struct cell_range range = cells_of(grid, box);
+  for (uint32_t y = range.y1; y <= range.y2; ++y) {
+    for (uint32_t x = range.x1; x <= range.x2; ++x) {
+      query_cell(&grid->cells[y * grid->columns + x], fn, userdata);
+    }
+  }
+}
+
+void dgde_grid_destroy(struct dgde_grid *grid) {
+  free_cells(grid);
+  free(grid);
+}
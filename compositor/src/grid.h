@@ -0,0 +1,40 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <stdint.h>
+
+#include <wlr/types/wlr_box.h>
+
+/* A uniform grid over an area for finding items by position without looking
+ * at all of them. Items are opaque pointers stored in every cell their box
+ * touches, boxes reaching outside of the area are kept in the edge cells. */
+struct dgde_grid;
+
+struct dgde_grid *dgde_grid_create(uint32_t width, uint32_t height,
+                                   uint32_t cell_size);
+
+/* Removes all items and changes the covered area. */
+void dgde_grid_reset(struct dgde_grid *grid, uint32_t width, uint32_t height);
+
+void dgde_grid_insert(struct dgde_grid *grid, void *item,
+                      const struct wlr_box *box);
+/* The box has to be the one the item was inserted with. */
+void dgde_grid_remove(struct dgde_grid *grid, void *item,
+                      const struct wlr_box *box);
+
+typedef void (*dgde_grid_fn)(void *item, void *userdata);
+
+/* Calls fn for every item in the cell containing the point. Items are not
+ * checked against the point, only the cell. */
+void dgde_grid_query_point(const struct dgde_grid *grid, int x, int y,
+                           dgde_grid_fn fn, void *userdata);
+
+/* Calls fn for every item in the cells touching the box. Items spanning
+ * several of these cells are reported once for each of them. */
+void dgde_grid_query_box(const struct dgde_grid *grid,
+                         const struct wlr_box *box, dgde_grid_fn fn,
+                         void *userdata);
+
+void dgde_grid_destroy(struct dgde_grid *grid);
+
+#endif
@@ -0,0 +1,607 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "ipc.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <wlr/util/log.h>
+
+#define MAX_REQUEST_SIZE 4096
+#define MAX_QUEUED_BYTES (64 * 1024)
+#define MAX_QUEUED_MESSAGES 128
+
+struct dgde_ipc_message {
+  char *data;
+  size_t len;
+  size_t capacity;
+};
+
+struct dgde_ipc {
+  struct wl_event_loop *loop;
+  struct dgde_ipc_handler handler;
+
+  char *path;
+  int fd;
+  struct wl_event_source *source;
+
+  struct wl_list clients;
+};
+
+struct queued_message {
+  struct wl_list link;
+
+  // replies and overflow notices have no event, they are never dropped or
+  // coalesced
+  enum dgde_ipc_event event;
+  const void *key;
+  bool reply;
+
+  char *data;
+  size_t len;
+};
+
+struct client {
+  struct wl_list link;
+  struct dgde_ipc *ipc;
+
+  int fd;
+  struct wl_event_source *source;
+  uint32_t subscriptions;
+
+  char request[MAX_REQUEST_SIZE];
+  size_t request_len;
+
+  // requests are not read while a reply is waiting to be sent, which bounds
+  // what a client can make us buffer to a single reply
+  bool reply_pending;
+
+  struct wl_list queue;
+  size_t queued_bytes;
+  uint32_t queued_messages;
+  // bytes of the first message already sent
+  size_t written;
+  uint32_t dropped;
+};
+
+struct dgde_ipc_message *dgde_ipc_message_create(void) {
+  return calloc(1, sizeof(struct dgde_ipc_message));
+}
+
+static bool reserve(struct dgde_ipc_message *message, size_t len) {
+  if (message->len + len + 1 <= message->capacity) {
+    return true;
+  }
+
+  size_t capacity = message->capacity == 0 ? 256 : message->capacity;
+  while (capacity < message->len + len + 1) {
+    capacity *= 2;
+  }
+
+  char *data = realloc(message->data, capacity);
+  if (data == NULL) {
+    return false;
+  }
+
+  message->data = data;
+  message->capacity = capacity;
+  return true;
+}
+
+static void append(struct dgde_ipc_message *message, const char *data,
+                   size_t len) {
+  if (!reserve(message, len)) {
+    return;
+  }
+
+  memcpy(message->data + message->len, data, len);
+  message->len += len;
+  message->data[message->len] = '\0';
+}
+
+void dgde_ipc_message_printf(struct dgde_ipc_message *message, const char *fmt,
+                             ...) {
+  va_list args;
+  va_start(args, fmt);
+  int len = vsnprintf(NULL, 0, fmt, args);
+  va_end(args);
+
+  if (len < 0 || !reserve(message, len)) {
+    return;
+  }
+
+  va_start(args, fmt);
+  vsnprintf(message->data + message->len, len + 1, fmt, args);
+  va_end(args);
+  message->len += len;
+}
+
+void dgde_ipc_message_add_string(struct dgde_ipc_message *message,
+                                 const char *str) {
+  if (str == NULL) {
+    append(message, "null", 4);
+    return;
+  }
+
+  append(message, "\"", 1);
+  for (const char *c = str; *c != '\0'; ++c) {
+    switch (*c) {
+    case '"':
+      append(message, "\\\"", 2);
+      break;
+    case '\\':
+      append(message, "\\\\", 2);
+      break;
+    default:
+      if ((unsigned char)*c < 0x20) {
+        dgde_ipc_message_printf(message, "\\u%04x", (unsigned char)*c);
+      } else {
+        append(message, c, 1);
+      }
+      break;
+    }
+  }
+  append(message, "\"", 1);
+}
+
+void dgde_ipc_message_destroy(struct dgde_ipc_message *message) {
+  free(message->data);
+  free(message);
+}
+
+static bool set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1 &&
+         fcntl(fd, F_SETFD, FD_CLOEXEC) != -1;
+}
+
+static void client_destroy(struct client *client) {
+  struct queued_message *message, *tmp;
+  wl_list_for_each_safe(message, tmp, &client->queue, link) {
+    wl_list_remove(&message->link);
+    free(message->data);
+    free(message);
+  }
+
+  wl_list_remove(&client->link);
+  wl_event_source_remove(client->source);
+  close(client->fd);
+  free(client);
+}
+
+static bool has_request(const struct client *client) {
+  return memchr(client->request, '\n', client->request_len) != NULL;
+}
+
+static void update_mask(struct client *client) {
+  uint32_t mask = 0;
+  if (!client->reply_pending) {
+    mask |= WL_EVENT_READABLE;
+  }
+  // requests held back by a reply that went out with an event are handled
+  // in client_event, as soon as the socket reports it is writable
+  if (!wl_list_empty(&client->queue) ||
+      (!client->reply_pending && has_request(client))) {
+    mask |= WL_EVENT_WRITABLE;
+  }
+  wl_event_source_fd_update(client->source, mask);
+}
+
+static void enqueue(struct client *client, enum dgde_ipc_event event,
+                    const void *key, const char *data, size_t len) {
+  struct queued_message *message = calloc(1, sizeof(struct queued_message));
+  message->event = event;
+  message->key = key;
+
+  // every message is one line
+  message->data = malloc(len + 1);
+  memcpy(message->data, data, len);
+  message->data[len] = '\n';
+  message->len = len + 1;
+
+  wl_list_insert(client->queue.prev, &message->link);
+  client->queued_bytes += message->len;
+  ++client->queued_messages;
+}
+
+static bool coalesce(struct client *client, enum dgde_ipc_event event,
+                     const void *key, const char *data, size_t len) {
+  if (key == NULL) {
+    return false;
+  }
+
+  struct queued_message *message;
+  wl_list_for_each(message, &client->queue, link) {
+    // the first message might be partially sent already
+    if (&message->link == client->queue.next && client->written > 0) {
+      continue;
+    }
+
+    if (message->event != event || message->key != key) {
+      continue;
+    }
+
+    char *replacement = malloc(len + 1);
+    memcpy(replacement, data, len);
+    replacement[len] = '\n';
+
+    client->queued_bytes -= message->len;
+    free(message->data);
+    message->data = replacement;
+    message->len = len + 1;
+    client->queued_bytes += message->len;
+    return true;
+  }
+
+  return false;
+}
+
+static bool flush(struct client *client) {
+  while (!wl_list_empty(&client->queue)) {
+    struct queued_message *message =
+        wl_container_of(client->queue.next, message, link);
+
+    ssize_t n = send(client->fd, message->data + client->written,
+                     message->len - client->written, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+
+      wlr_log_errno(WLR_DEBUG, "ipc client write failed");
+      return false;
+    }
+
+    client->written += n;
+    if (client->written < message->len) {
+      continue;
+    }
+
+    if (message->reply) {
+      client->reply_pending = false;
+    }
+
+    wl_list_remove(&message->link);
+    client->queued_bytes -= message->len;
+    --client->queued_messages;
+    client->written = 0;
+    free(message->data);
+    free(message);
+
+    if (wl_list_empty(&client->queue) && client->dropped > 0) {
+      char buf[64];
+      int len = snprintf(buf, sizeof(buf),
+                         "{\"event\":\"overflow\",\"dropped\":%u}",
+                         client->dropped);
+      client->dropped = 0;
+      enqueue(client, 0, NULL, buf, len);
+    }
+  }
+
+  update_mask(client);
+  return true;
+}
+
+static void reply(struct client *client, const char *data, size_t len) {
+  enqueue(client, 0, NULL, data, len);
+  struct queued_message *message =
+      wl_container_of(client->queue.prev, message, link);
+  message->reply = true;
+  client->reply_pending = true;
+}
+
+static void handle_subscribe(struct client *client, char *args) {
+  uint32_t subscriptions = 0;
+  char *saveptr = NULL;
+  for (char *event = strtok_r(args, " ", &saveptr); event != NULL;
+       event = strtok_r(NULL, " ", &saveptr)) {
+    if (strcmp(event, "view") == 0) {
+      subscriptions |= DgdeIpcEvent_View;
+    } else if (strcmp(event, "focus") == 0) {
+      subscriptions |= DgdeIpcEvent_Focus;
+    } else if (strcmp(event, "workspace") == 0) {
+      subscriptions |= DgdeIpcEvent_Workspace;
+    } else {
+      const char error[] = "{\"success\":false,\"error\":\"unknown event\"}";
+      reply(client, error, sizeof(error) - 1);
+      return;
+    }
+  }
+
+  client->subscriptions |= subscriptions;
+  const char success[] = "{\"success\":true}";
+  reply(client, success, sizeof(success) - 1);
+}
+
+static void handle_log_level(struct client *client, const char *args) {
+  /* Without a level this only reports the current one. */
+  while (*args == ' ') {
+    ++args;
+  }
+  enum wlr_log_importance level;
+  if (*args != '\0') {
+    if (!dgde_log_parse_level(args, &level)) {
+      const char error[] = "{\"success\":false,\"error\":\"unknown level\"}";
+      reply(client, error, sizeof(error) - 1);
+      return;
+    }
+    dgde_log_set_level(level);
+    wlr_log(WLR_INFO, "log level set to %s over ipc",
+            dgde_log_level_name(level));
+  }
+
+  char buf[64];
+  int len = snprintf(buf, sizeof(buf), "{\"success\":true,\"level\":\"%s\"}",
+                     dgde_log_level_name(dgde_log_level()));
+  reply(client, buf, len);
+}
+
+static void handle_mirror(struct client *client, char *args) {
+  char *saveptr = NULL;
+  const char *output = strtok_r(args, " ", &saveptr);
+  const char *source = strtok_r(NULL, " ", &saveptr);
+  const char *error = "usage: mirror <output> [<source>]";
+  if (output != NULL && strtok_r(NULL, " ", &saveptr) == NULL) {
+    struct dgde_ipc *ipc = client->ipc;
+    error = ipc->handler.mirror(ipc->handler.userdata, output, source);
+  }
+
+  struct dgde_ipc_message *message = dgde_ipc_message_create();
+  if (error == NULL) {
+    dgde_ipc_message_printf(message, "{\"success\":true}");
+  } else {
+    dgde_ipc_message_printf(message, "{\"success\":false,\"error\":");
+    dgde_ipc_message_add_string(message, error);
+    dgde_ipc_message_printf(message, "}");
+  }
+  reply(client, message->data, message->len);
+  dgde_ipc_message_destroy(message);
+}
+
+static void reply_query(struct client *client, dgde_ipc_query_cb query) {
+  struct dgde_ipc_message *message = dgde_ipc_message_create();
+  query(client->ipc->handler.userdata, message);
+  reply(client, message->data, message->len);
+  dgde_ipc_message_destroy(message);
+}
+
+static void handle_request(struct client *client, char *request) {
+  struct dgde_ipc *ipc = client->ipc;
+
+  if (strcmp(request, "get_tree") == 0) {
+    reply_query(client, ipc->handler.tree);
+  } else if (strcmp(request, "get_clients") == 0) {
+    reply_query(client, ipc->handler.clients);
+  } else if (strcmp(request, "get_latency") == 0) {
+    reply_query(client, ipc->handler.latency);
+  } else if (strcmp(request, "dump_trace") == 0) {
+    reply_query(client, ipc->handler.trace);
+  } else if (strncmp(request, "log_level", 9) == 0 &&
+             (request[9] == ' ' || request[9] == '\0')) {
+    handle_log_level(client, request + 9);
+  } else if (strncmp(request, "mirror", 6) == 0 &&
+             (request[6] == ' ' || request[6] == '\0')) {
+    handle_mirror(client, request + 6);
+  } else if (strncmp(request, "subscribe", 9) == 0 &&
+             (request[9] == ' ' || request[9] == '\0')) {
+    handle_subscribe(client, request + 9);
+  } else {
+    const char error[] = "{\"success\":false,\"error\":\"unknown request\"}";
+    reply(client, error, sizeof(error) - 1);
+  }
+}
+
+static void process_requests(struct client *client) {
+  // one request at a time, the next one is handled when the reply is sent
+  while (!client->reply_pending) {
+    char *end = memchr(client->request, '\n', client->request_len);
+    if (end == NULL) {
+      break;
+    }
+
+    *end = '\0';
+    handle_request(client, client->request);
+
+    size_t consumed = end - client->request + 1;
+    client->request_len -= consumed;
+    memmove(client->request, end + 1, client->request_len);
+  }
+}
+
+static bool dispatch(struct client *client) {
+  /* Handles buffered requests for as long as their replies can be sent right
+   * away, and sends whatever else is queued. */
+  do {
+    process_requests(client);
+    if (!flush(client)) {
+      return false;
+    }
+  } while (!client->reply_pending && has_request(client));
+
+  return true;
+}
+
+static int client_event(int fd, uint32_t mask, void *data) {
+  struct client *client = data;
+
+  if (mask & (WL_EVENT_ERROR | WL_EVENT_HANGUP)) {
+    client_destroy(client);
+    return 0;
+  }
+
+  if ((mask & WL_EVENT_WRITABLE) && !flush(client)) {
+    client_destroy(client);
+    return 0;
+  }
+
+  if ((mask & WL_EVENT_READABLE) && !client->reply_pending) {
+    ssize_t n = recv(fd, client->request + client->request_len,
+                     sizeof(client->request) - client->request_len, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      client_destroy(client);
+      return 0;
+    }
+
+    if (n > 0) {
+      client->request_len += n;
+    }
+
+    if (client->request_len == sizeof(client->request) &&
+        !has_request(client)) {
+      wlr_log(WLR_DEBUG, "ipc request too long, disconnecting client");
+      client_destroy(client);
+      return 0;
+    }
+  }
+
+  // this also picks up requests that arrived while a reply was pending
+  if (!dispatch(client)) {
+    client_destroy(client);
+  }
+  return 0;
+}
+
+static int accept_client(int fd, uint32_t mask, void *data) {
+  struct dgde_ipc *ipc = data;
+
+  int client_fd = accept(fd, NULL, NULL);
+  if (client_fd < 0) {
+    wlr_log_errno(WLR_ERROR, "failed to accept ipc client");
+    return 0;
+  }
+
+  if (!set_nonblocking(client_fd)) {
+    wlr_log_errno(WLR_ERROR, "failed to set up ipc client");
+    close(client_fd);
+    return 0;
+  }
+
+  struct client *client = calloc(1, sizeof(struct client));
+  client->ipc = ipc;
+  client->fd = client_fd;
+  wl_list_init(&client->queue);
+  client->source = wl_event_loop_add_fd(ipc->loop, client_fd,
+                                        WL_EVENT_READABLE, client_event, client);
+  wl_list_insert(&ipc->clients, &client->link);
+
+  return 0;
+}
+
+struct dgde_ipc *dgde_ipc_create(struct wl_event_loop *loop, const char *path,
+                                 const struct dgde_ipc_handler *handler) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    wlr_log(WLR_ERROR, "ipc socket path too long: %s", path);
+    return NULL;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || !set_nonblocking(fd)) {
+    wlr_log_errno(WLR_ERROR, "failed to create ipc socket");
+    if (fd >= 0) {
+      close(fd);
+    }
+    return NULL;
+  }
+
+  // a stale socket from a compositor that crashed
+  unlink(path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 16) != 0) {
+    wlr_log_errno(WLR_ERROR, "failed to listen on ipc socket %s", path);
+    close(fd);
+    return NULL;
+  }
+
+  struct dgde_ipc *ipc = calloc(1, sizeof(struct dgde_ipc));
+  ipc->loop = loop;
+  ipc->handler = *handler;
+  ipc->path = strdup(path);
+  ipc->fd = fd;
+  wl_list_init(&ipc->clients);
+  ipc->source =
+      wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE, accept_client, ipc);
+
+  wlr_log(WLR_INFO, "listening for ipc clients on %s", path);
+  return ipc;
+}
+
+const char *dgde_ipc_socket_path(const struct dgde_ipc *ipc) {
+  return ipc->path;
+}
+
+bool dgde_ipc_has_subscribers(const struct dgde_ipc *ipc,
+                              enum dgde_ipc_event event) {
+  if (ipc == NULL) {
+    return false;
+  }
+
+  struct client *client;
+  wl_list_for_each(client, &ipc->clients, link) {
+    if (client->subscriptions & event) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void dgde_ipc_send_event(struct dgde_ipc *ipc, enum dgde_ipc_event event,
+                         const void *coalesce_key,
+                         struct dgde_ipc_message *message) {
+  if (ipc == NULL) {
+    dgde_ipc_message_destroy(message);
+    return;
+  }
+
+  struct client *client, *tmp;
+  wl_list_for_each_safe(client, tmp, &ipc->clients, link) {
+    if (!(client->subscriptions & event) ||
+        coalesce(client, event, coalesce_key, message->data, message->len)) {
+      continue;
+    }
+
+    if (client->queued_messages >= MAX_QUEUED_MESSAGES ||
+        client->queued_bytes + message->len + 1 > MAX_QUEUED_BYTES) {
+      ++client->dropped;
+      continue;
+    }
+
+    bool was_empty = wl_list_empty(&client->queue);
+    enqueue(client, event, coalesce_key, message->data, message->len);
+
+    /* Try to get it out right away, otherwise wait for the socket to drain.
+     * Events can be sent from within a request of this very client, so its
+     * requests are left to client_event, and so is destroying it. */
+    if (was_empty && !flush(client)) {
+      wl_event_source_fd_update(client->source, WL_EVENT_WRITABLE);
+    }
+  }
+
+  dgde_ipc_message_destroy(message);
+}
+
+void dgde_ipc_destroy(struct dgde_ipc *ipc) {
+  struct client *client, *tmp;
+  wl_list_for_each_safe(client, tmp, &ipc->clients, link) {
+    client_destroy(client);
+  }
+
+  wl_event_source_remove(ipc->source);
+  close(ipc->fd);
+  unlink(ipc->path);
+  free(ipc->path);
+  free(ipc);
+}
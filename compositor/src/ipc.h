@@ -0,0 +1,77 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <wayland-server-core.h>
+
+/* Line based IPC over a Unix socket for status bars and other tools that want
+ * to follow what the compositor is doing. Clients send one request per line:
+ *
+ *   get_tree                     outputs, workspaces, views and focus
+ *   get_clients                  resource usage of every Wayland client
+ *   get_latency                  input to present latency histogram
+ *   dump_trace                   writes the flight recorder to a file
+ *   log_level [<level>]          gets or sets the log level
+ *   mirror <output> [<source>]   shows source on output, or stops mirroring
+ *   subscribe <event> [<event>]  events are "view", "focus" and "workspace"
+ *
+ * Every reply and event is a single line of JSON. The compositor never blocks
+ * on a client: events are queued per client up to a fixed size, queued state
+ * events (focus, workspace) are replaced by newer ones of the same kind, and
+ * anything else that doesn't fit is dropped. Clients that lost events get an
+ * "overflow" event once their queue has drained and should re-read the tree.
+ */
+
+enum dgde_ipc_event {
+  DgdeIpcEvent_View = 1 << 0,
+  DgdeIpcEvent_Focus = 1 << 1,
+  DgdeIpcEvent_Workspace = 1 << 2,
+};
+
+struct dgde_ipc;
+struct dgde_ipc_message;
+
+struct dgde_ipc_message *dgde_ipc_message_create(void);
+void dgde_ipc_message_printf(struct dgde_ipc_message *message, const char *fmt,
+                             ...);
+/* Appends str as a quoted and escaped JSON string, NULL becomes null. */
+void dgde_ipc_message_add_string(struct dgde_ipc_message *message,
+                                 const char *str);
+void dgde_ipc_message_destroy(struct dgde_ipc_message *message);
+
+typedef void (*dgde_ipc_query_cb)(void *, struct dgde_ipc_message *);
+/* Returns NULL on success, otherwise what went wrong. source is NULL to stop
+ * mirroring. */
+typedef const char *(*dgde_ipc_mirror_cb)(void *, const char *output,
+                                          const char *source);
+
+struct dgde_ipc_handler {
+  void *userdata;
+  dgde_ipc_query_cb tree;
+  dgde_ipc_query_cb clients;
+  dgde_ipc_query_cb trace;
+  dgde_ipc_query_cb latency;
+  dgde_ipc_mirror_cb mirror;
+};
+
+struct dgde_ipc *dgde_ipc_create(struct wl_event_loop *loop, const char *path,
+                                 const struct dgde_ipc_handler *handler);
+
+const char *dgde_ipc_socket_path(const struct dgde_ipc *ipc);
+
+/* Lets the caller skip building events nobody listens to. */
+bool dgde_ipc_has_subscribers(const struct dgde_ipc *ipc,
+                              enum dgde_ipc_event event);
+
+/* Queues the message for every client subscribed to the event and takes
+ * ownership of it. A queued event with the same non-NULL coalesce key is
+ * replaced instead of queueing another one. */
+void dgde_ipc_send_event(struct dgde_ipc *ipc, enum dgde_ipc_event event,
+                         const void *coalesce_key,
+                         struct dgde_ipc_message *message);
+
+void dgde_ipc_destroy(struct dgde_ipc *ipc);
+
+#endif
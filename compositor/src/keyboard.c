@@ -1,4 +1,6 @@
 #include "keyboard.h"
+#include "probes.h"
+#include "trace.h"
 #include "wayland-util.h"
 
 #include <stdint.h>
@@ -16,6 +18,7 @@ struct dgde_keyboard {
 
   struct wl_listener modifiers;
   struct wl_listener key;
+  struct wl_listener destroy;
 
   struct wl_list link;
 
@@ -23,6 +26,9 @@ struct dgde_keyboard {
   void *handler_userdatas[MAX_HANDLERS];
   uint32_t handler_modifiers[MAX_HANDLERS];
   uint32_t num_handlers;
+
+  dgde_keyboard_forward_cb forward_handler;
+  void *forward_userdata;
 };
 
 static void handle_modifiers(struct wl_listener *listener, void *data) {
@@ -47,6 +53,8 @@ static void handle_key(struct wl_listener *listener, void *data) {
   struct dgde_keyboard *keyboard = wl_container_of(listener, keyboard, key);
   struct wlr_event_keyboard_key *event = data;
   struct wlr_seat *seat = keyboard->seat;
+  dgde_trace_begin("key", event->keycode);
+  DGDE_PROBE(key_begin, event->keycode, event->state);
 
   /* Translate libinput keycode -> xkbcommon */
   uint32_t keycode = event->keycode + 8;
@@ -75,7 +83,23 @@ static void handle_key(struct wl_listener *listener, void *data) {
     wlr_seat_set_keyboard(seat, keyboard->device);
     wlr_seat_keyboard_notify_key(seat, event->time_msec, event->keycode,
                                  event->state);
+
+    if (keyboard->forward_handler != NULL) {
+      keyboard->forward_handler(keyboard->forward_userdata, event);
+    }
   }
+  DGDE_PROBE(key_end, event->keycode, handled);
+  dgde_trace_end("key");
+}
+
+static void handle_destroy(struct wl_listener *listener, void *data) {
+  /* Virtual keyboards come and go with their clients. */
+  struct dgde_keyboard *keyboard = wl_container_of(listener, keyboard, destroy);
+  wl_list_remove(&keyboard->modifiers.link);
+  wl_list_remove(&keyboard->key.link);
+  wl_list_remove(&keyboard->destroy.link);
+  wl_list_remove(&keyboard->link);
+  free(keyboard);
 }
 
 struct dgde_keyboard *dgde_keyboard_create(struct wlr_input_device *device,
@@ -100,12 +124,22 @@ struct dgde_keyboard *dgde_keyboard_create(struct wlr_input_device *device,
   wl_signal_add(&device->keyboard->events.modifiers, &keyboard->modifiers);
   keyboard->key.notify = handle_key;
   wl_signal_add(&device->keyboard->events.key, &keyboard->key);
+  keyboard->destroy.notify = handle_destroy;
+  wl_signal_add(&device->events.destroy, &keyboard->destroy);
+  wl_list_init(&keyboard->link);
 
   wlr_seat_set_keyboard(keyboard->seat, device);
 
   return keyboard;
 }
 
+void dgde_keyboard_set_forward_handler(struct dgde_keyboard *keyboard,
+                                       dgde_keyboard_forward_cb handler,
+                                       void *userdata) {
+  keyboard->forward_handler = handler;
+  keyboard->forward_userdata = userdata;
+}
+
 void dgde_keyboard_add_to_list(struct dgde_keyboard *keyboard,
                                struct wl_list *list) {
   wl_list_insert(list, &keyboard->link);
@@ -9,6 +9,7 @@ struct dgde_keyboard;
 struct wlr_seat;
 struct wlr_input_device;
 struct wl_list;
+struct wlr_event_keyboard_key;
 
 struct dgde_keyboard *dgde_keyboard_create(struct wlr_input_device *device,
                                            struct wlr_seat *seat);
@@ -18,6 +19,14 @@ void dgde_keyboard_add_handler(struct dgde_keyboard *keyboard,
                                keybind_handler handler, void *userdata,
                                uint32_t modifiers);
 
+/* Called for every key event that is passed on to the focused client. */
+typedef void (*dgde_keyboard_forward_cb)(void *,
+                                         struct wlr_event_keyboard_key *);
+void dgde_keyboard_set_forward_handler(struct dgde_keyboard *keyboard,
+                                       dgde_keyboard_forward_cb handler,
+                                       void *userdata);
+
+/* The keyboard removes itself from the list when its device goes away. */
 void dgde_keyboard_add_to_list(struct dgde_keyboard *keyboard,
                                struct wl_list *list);
 
@@ -0,0 +1,182 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "latency.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <wlr/util/log.h>
+
+// anything slower than this comes from a client using another clock
+#define MAX_LATENCY_MS 10000
+// surfaces not responding by then ignored the input, e.g. a key without a
+// binding, and commits after that are unrelated to it
+#define RESPONSE_DEADLINE_MS 1000
+
+enum state {
+  // waiting for input
+  State_Idle,
+  // waiting for the surface to respond
+  State_Input,
+  // waiting for an output to show the response
+  State_Response,
+};
+
+struct dgde_latency {
+  enum state state;
+  uint32_t input_time;
+  // when the input arrived by our clock, for the response deadline
+  uint32_t started;
+
+  struct wlr_surface *surface;
+  struct wl_listener commit;
+  struct wl_listener destroy;
+
+  struct dgde_latency_stats stats;
+};
+
+static uint32_t now_msec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void stop_listening(struct dgde_latency *latency) {
+  if (latency->surface != NULL) {
+    wl_list_remove(&latency->commit.link);
+    wl_list_remove(&latency->destroy.link);
+    latency->surface = NULL;
+  }
+}
+
+static void surface_commit(struct wl_listener *listener, void *data) {
+  struct dgde_latency *latency = wl_container_of(listener, latency, commit);
+
+  if (now_msec() - latency->started > RESPONSE_DEADLINE_MS) {
+    stop_listening(latency);
+    latency->state = State_Idle;
+    return;
+  }
+
+  // commits without damage don't show anything new
+  if (!pixman_region32_not_empty(&latency->surface->buffer_damage)) {
+    return;
+  }
+
+  /* Keep the surface to find the outputs showing the response, the commits
+   * after this one don't matter anymore. */
+  wl_list_remove(&latency->commit.link);
+  wl_list_init(&latency->commit.link);
+  latency->state = State_Response;
+}
+
+static bool shown_on(struct wlr_surface *surface, struct wlr_output *output) {
+  struct wlr_surface_output *surface_output;
+  wl_list_for_each(surface_output, &surface->current_outputs, link) {
+    if (surface_output->output == output) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void surface_destroy(struct wl_listener *listener, void *data) {
+  struct dgde_latency *latency = wl_container_of(listener, latency, destroy);
+  stop_listening(latency);
+  latency->state = State_Idle;
+}
+
+struct dgde_latency *dgde_latency_create(void) {
+  struct dgde_latency *latency = calloc(1, sizeof(struct dgde_latency));
+  latency->commit.notify = surface_commit;
+  latency->destroy.notify = surface_destroy;
+  return latency;
+}
+
+void dgde_latency_input(struct dgde_latency *latency,
+                        struct wlr_surface *surface, uint32_t time_msec) {
+  if (latency->state != State_Idle) {
+    // a sample that never got a response would block all the later ones
+    if (now_msec() - latency->started <= RESPONSE_DEADLINE_MS) {
+      return;
+    }
+    stop_listening(latency);
+    latency->state = State_Idle;
+  }
+  if (surface == NULL) {
+    return;
+  }
+
+  latency->state = State_Input;
+  latency->input_time = time_msec;
+  latency->started = now_msec();
+  latency->surface = surface;
+  wl_signal_add(&surface->events.commit, &latency->commit);
+  wl_signal_add(&surface->events.destroy, &latency->destroy);
+}
+
+static uint32_t percentile(const struct dgde_latency_stats *stats,
+                           uint32_t percent) {
+  uint64_t wanted = (stats->samples * percent + 99) / 100;
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < DGDE_LATENCY_BUCKETS; ++i) {
+    seen += stats->histogram[i];
+    if (seen >= wanted) {
+      return i;
+    }
+  }
+
+  return DGDE_LATENCY_BUCKETS - 1;
+}
+
+void dgde_latency_output_commit(struct dgde_latency *latency,
+                                struct wlr_output *output) {
+  if (latency->state != State_Response) {
+    return;
+  }
+
+  /* The response was damage on the surface, which only goes into the damage
+   * of the outputs it has entered, frames of other outputs don't show it. A
+   * surface that has left all outputs won't be shown at all. */
+  struct wlr_surface *surface = latency->surface;
+  if (!shown_on(surface, output)) {
+    if (wl_list_empty(&surface->current_outputs)) {
+      stop_listening(latency);
+      latency->state = State_Idle;
+    }
+    return;
+  }
+  stop_listening(latency);
+  latency->state = State_Idle;
+
+  // timestamps wrap around after 49 days, the difference doesn't care
+  uint32_t ms = now_msec() - latency->input_time;
+  if (ms > MAX_LATENCY_MS) {
+    wlr_log(WLR_DEBUG, "dropping latency sample of %u ms, input timestamps "
+                       "don't seem to be CLOCK_MONOTONIC",
+            ms);
+    return;
+  }
+
+  struct dgde_latency_stats *stats = &latency->stats;
+  ++stats->samples;
+  ++stats->histogram[ms < DGDE_LATENCY_BUCKETS ? ms : DGDE_LATENCY_BUCKETS - 1];
+  if (ms > stats->max) {
+    stats->max = ms;
+  }
+
+  stats->p50 = percentile(stats, 50);
+  stats->p90 = percentile(stats, 90);
+  stats->p99 = percentile(stats, 99);
+}
+
+const struct dgde_latency_stats *
+dgde_latency_stats(const struct dgde_latency *latency) {
+  return &latency->stats;
+}
+
+void dgde_latency_destroy(struct dgde_latency *latency) {
+  stop_listening(latency);
+  free(latency);
+}
@@ -0,0 +1,53 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#include <wlr/types/wlr_surface.h>
+
+/* Measures how long it takes from an input event until a frame showing the
+ * client's response to it has been committed to an output.
+ *
+ * One measurement runs at a time: the first button or key event sent to a
+ * surface starts it, the next commit of that surface with damage is taken to
+ * be the response and the next commit of an output the surface has entered
+ * ends it. Input arriving in the meantime belongs to the same response and is
+ * not measured on its own. Surfaces that don't respond within a second are
+ * taken to have ignored the input, and the measurement is dropped.
+ *
+ * Input timestamps are compared to CLOCK_MONOTONIC in milliseconds, which is
+ * what libinput uses. Clients injecting input through the virtual pointer
+ * and keyboard protocols have to timestamp it the same way. */
+
+// 1 ms per bucket, the last one holds everything slower
+#define DGDE_LATENCY_BUCKETS 128
+
+struct dgde_latency_stats {
+  uint64_t samples;
+  // in milliseconds
+  uint32_t p50;
+  uint32_t p90;
+  uint32_t p99;
+  uint32_t max;
+  uint64_t histogram[DGDE_LATENCY_BUCKETS];
+};
+
+struct dgde_latency;
+
+struct dgde_latency *dgde_latency_create(void);
+
+/* A button or key event with the timestamp was delivered to the surface.
+ * Pointer motion isn't measured, many surfaces don't redraw on hover. */
+void dgde_latency_input(struct dgde_latency *latency,
+                        struct wlr_surface *surface, uint32_t time_msec);
+
+/* The output committed a newly rendered frame. */
+void dgde_latency_output_commit(struct dgde_latency *latency,
+                                struct wlr_output *output);
+
+const struct dgde_latency_stats *
+dgde_latency_stats(const struct dgde_latency *latency);
+
+void dgde_latency_destroy(struct dgde_latency *latency);
+
+#endif
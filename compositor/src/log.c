@@ -0,0 +1,276 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "log.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// a burst of a few thousand debug messages fits before anything is dropped
+#define LOG_SLOTS 4096
+// longer messages are cut off
+#define LOG_MESSAGE_SIZE 240
+// what the writer collects before a single write()
+#define LOG_BATCH_SIZE 65536
+
+struct log_slot {
+  /* Equal to the position a writer may claim the slot for while it is free,
+   * one past the position once the message in it is complete. */
+  atomic_uint_fast64_t sequence;
+  struct timespec time;
+  enum wlr_log_importance importance;
+  char text[LOG_MESSAGE_SIZE];
+};
+
+static struct log_slot slots[LOG_SLOTS];
+// next position to log to, claimed by any thread
+static atomic_uint_fast64_t head;
+// next position to write out, only touched by the writer thread
+static uint64_t tail;
+
+static atomic_int level = WLR_INFO;
+static atomic_uint dropped;
+
+static struct timespec start_time;
+static pthread_t writer;
+static bool running;
+static atomic_bool quit;
+
+/* The writer sleeps on the eventfd when the ring is empty, whoever logs
+ * the next message wakes it up. Only the first message after it went to
+ * sleep pays for a syscall. */
+static int wakeup_fd = -1;
+static atomic_bool sleeping;
+
+static const char *const level_names[] = {
+    [WLR_SILENT] = "silent",
+    [WLR_ERROR] = "error",
+    [WLR_INFO] = "info",
+    [WLR_DEBUG] = "debug",
+};
+
+static const char *const level_tags[] = {
+    [WLR_SILENT] = "",
+    [WLR_ERROR] = "[ERROR]",
+    [WLR_INFO] = "[INFO]",
+    [WLR_DEBUG] = "[DEBUG]",
+};
+
+static size_t format_line(char *buf, size_t size, const struct timespec *time,
+                          enum wlr_log_importance importance,
+                          const char *text) {
+  long ms = (time->tv_sec - start_time.tv_sec) * 1000 +
+            (time->tv_nsec - start_time.tv_nsec) / 1000000;
+  int len = snprintf(buf, size, "%02ld:%02ld:%02ld.%03ld %s %s\n",
+                     ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000,
+                     level_tags[importance], text);
+  if (len < 0) {
+    return 0;
+  }
+  return (size_t)len < size ? (size_t)len : size - 1;
+}
+
+static void write_all(const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(STDERR_FILENO, buf, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return;
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+static void log_sync(enum wlr_log_importance importance, const char *fmt,
+                     va_list args) {
+  char text[LOG_MESSAGE_SIZE];
+  vsnprintf(text, sizeof(text), fmt, args);
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  char line[LOG_MESSAGE_SIZE + 32];
+  write_all(line, format_line(line, sizeof(line), &now, importance, text));
+}
+
+static void log_callback(enum wlr_log_importance importance, const char *fmt,
+                         va_list args) {
+  if ((int)importance > atomic_load_explicit(&level, memory_order_relaxed)) {
+    return;
+  }
+
+  if (!running) {
+    log_sync(importance, fmt, args);
+    return;
+  }
+
+  /* Claims the slot at head unless the writer hasn't written out what was
+   * in it yet. The va_list can't be handed to another thread, so the message
+   * is formatted here, only the timestamp and the write are left to the
+   * writer. */
+  struct log_slot *slot;
+  uint64_t pos = atomic_load_explicit(&head, memory_order_relaxed);
+  for (;;) {
+    slot = &slots[pos % LOG_SLOTS];
+    uint64_t sequence =
+        atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (sequence == pos) {
+      if (atomic_compare_exchange_weak_explicit(&head, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (sequence < pos) {
+      // full, the writer is behind
+      atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+      return;
+    } else {
+      pos = atomic_load_explicit(&head, memory_order_relaxed);
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &slot->time);
+  slot->importance = importance;
+  vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+  atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_exchange(&sleeping, false)) {
+    uint64_t one = 1;
+    ssize_t n = write(wakeup_fd, &one, sizeof(one));
+    (void)n;
+  }
+}
+
+static bool ring_empty(void) {
+  const struct log_slot *slot = &slots[tail % LOG_SLOTS];
+  return atomic_load_explicit(&slot->sequence, memory_order_acquire) !=
+         tail + 1;
+}
+
+static size_t drain(char *batch, size_t len) {
+  /* Takes complete messages in order, a message that is still being written
+   * holds back the ones after it until it is done. */
+  while (!ring_empty() && len + LOG_MESSAGE_SIZE + 32 <= LOG_BATCH_SIZE) {
+    struct log_slot *slot = &slots[tail % LOG_SLOTS];
+    len += format_line(batch + len, LOG_BATCH_SIZE - len, &slot->time,
+                       slot->importance, slot->text);
+    atomic_store_explicit(&slot->sequence, tail + LOG_SLOTS,
+                          memory_order_release);
+    ++tail;
+  }
+
+  unsigned lost = atomic_exchange(&dropped, 0);
+  if (lost > 0 && len + 64 <= LOG_BATCH_SIZE) {
+    len += snprintf(batch + len, LOG_BATCH_SIZE - len,
+                    "(%u log messages dropped, the log writer is behind)\n",
+                    lost);
+  }
+
+  return len;
+}
+
+static void *writer_main(void *data) {
+  static char batch[LOG_BATCH_SIZE];
+
+  for (;;) {
+    size_t len = drain(batch, 0);
+    if (len > 0) {
+      write_all(batch, len);
+      continue;
+    }
+
+    if (atomic_load(&quit)) {
+      break;
+    }
+
+    /* Announces that it is about to sleep before looking at the ring one
+     * last time, a message logged in between either is seen here or
+     * wakes it up. */
+    atomic_store(&sleeping, true);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (ring_empty() && !atomic_load(&quit)) {
+      uint64_t count;
+      ssize_t n = read(wakeup_fd, &count, sizeof(count));
+      (void)n;
+    }
+    atomic_store(&sleeping, false);
+  }
+
+  return NULL;
+}
+
+void dgde_log_init(enum wlr_log_importance importance) {
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for (uint64_t i = 0; i < LOG_SLOTS; ++i) {
+    atomic_init(&slots[i].sequence, i);
+  }
+  atomic_store(&level, importance);
+
+  /* The writer starts with every signal blocked, signals the event loop
+   * handles through a signalfd, like SIGUSR1, would otherwise be delivered to
+   * it and kill the process. */
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  wakeup_fd = eventfd(0, EFD_CLOEXEC);
+  if (wakeup_fd >= 0 &&
+      pthread_create(&writer, NULL, writer_main, NULL) == 0) {
+    running = true;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  wlr_log_init(importance, log_callback);
+  if (!running) {
+    wlr_log(WLR_ERROR, "failed to start the log writer, logging synchronously");
+  }
+}
+
+void dgde_log_set_level(enum wlr_log_importance importance) {
+  atomic_store(&level, importance);
+  // wlroots checks the verbosity itself before some expensive debug output
+  wlr_log_init(importance, log_callback);
+}
+
+enum wlr_log_importance dgde_log_level(void) { return atomic_load(&level); }
+
+bool dgde_log_parse_level(const char *name,
+                          enum wlr_log_importance *importance) {
+  for (int i = 0; i < WLR_LOG_IMPORTANCE_LAST; ++i) {
+    if (strcmp(name, level_names[i]) == 0) {
+      *importance = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+const char *dgde_log_level_name(enum wlr_log_importance importance) {
+  return importance < WLR_LOG_IMPORTANCE_LAST ? level_names[importance] : "";
+}
+
+void dgde_log_finish(void) {
+  if (!running) {
+    return;
+  }
+
+  atomic_store(&quit, true);
+  uint64_t one = 1;
+  ssize_t n = write(wakeup_fd, &one, sizeof(one));
+  (void)n;
+  pthread_join(writer, NULL);
+
+  running = false;
+  close(wakeup_fd);
+  wakeup_fd = -1;
+}
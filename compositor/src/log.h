@@ -0,0 +1,32 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdbool.h>
+
+#include <wlr/util/log.h>
+
+/* Asynchronous logging for wlr_log, ours and that of wlroots. Messages below
+ * the current level are dropped before anything is formatted. The rest are
+ * formatted into a fixed size ring by whichever thread logs them, without
+ * locks or syscalls, and written out in batches by a background thread, so
+ * a slow stderr (journald, a terminal over ssh, NFS) never stalls the event
+ * loop. If the ring is full the message is dropped and counted instead of
+ * waiting for the writer. */
+
+/* Installs the wlr_log callback and starts the writer thread. */
+void dgde_log_init(enum wlr_log_importance level);
+
+/* The level can be changed at any time, e.g. over IPC to debug a running
+ * session. */
+void dgde_log_set_level(enum wlr_log_importance level);
+enum wlr_log_importance dgde_log_level(void);
+
+/* "silent", "error", "info" or "debug". */
+bool dgde_log_parse_level(const char *name, enum wlr_log_importance *level);
+const char *dgde_log_level_name(enum wlr_log_importance level);
+
+/* Writes out what is left in the ring and stops the thread, anything logged
+ * afterwards is written synchronously. */
+void dgde_log_finish(void);
+
+#endif
@@ -1,32 +1,242 @@
 #define _POSIX_C_SOURCE 200112L
 #include "cursor.h"
 #include "keyboard.h"
+#include "log.h"
 #include "server.h"
 #include "view.h"
 
 #include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <wlr/util/log.h>
 
+static void print_usage(const char *program_name) {
+  printf("usage: %s [-t composition threads] [-H virtual outputs] "
+         "[-m WIDTHxHEIGHT[@HZ]] [-u] [-b MiB] [-r commits/s] [-d ms/s] [-T] "
+         "[-e seconds] [-j ms] [-i seconds] [-l level] [-V] [-v] [-c MiB] "
+         "[-C mime types] [-R file] [-p none|hash|scaled] [-I file] "
+         "[-s speed]\n",
+         program_name);
+  printf("  -H  run headless with the given number of virtual outputs\n"
+         "  -m  mode of the virtual outputs, defaults to 1920x1080@60\n"
+         "  -u  render virtual outputs as fast as possible, up to 1000 Hz\n"
+         "  -b  buffer and texture memory budget per client\n"
+         "  -r  commit rate budget per client\n"
+         "  -d  request dispatch time per second per client before it is\n"
+         "      throttled even without -T, 0 (default) never\n"
+         "  -T  throttle clients over budget instead of just logging\n"
+         "  -e  shrink views hidden for this long, 0 (default) never\n"
+         "  -j  write a trace when a frame takes longer than this\n"
+         "  -i  turn outputs off after this long without input, 0 never\n"
+         "  -l  log level: silent, error, info (default) or debug\n"
+         "  -V  serve virtual outputs over VNC on Unix sockets in\n"
+         "      XDG_RUNTIME_DIR\n"
+         "  -v  let clients inject input with virtual pointers and keyboards\n"
+         "  -c  keep copied selections up to this size in the compositor\n"
+         "  -C  mime types kept by -c, comma separated, defaults to\n"
+         "      text/*,UTF8_STRING,STRING,TEXT,image/png\n"
+         "  -R  record all client requests into a file for replay\n"
+         "  -p  buffer contents to record, defaults to none\n"
+         "  -I  play a libinput record trace back once a window is shown and\n"
+         "      exit when done, only with -H\n"
+         "  -s  play -I this many times as fast, 0 as fast as possible\n"
+         "SIGUSR1/SIGUSR2 add/remove virtual outputs while running headless\n");
+}
+
+static void ignore_signal(int signal) {}
+
+static bool parse_mode(const char *mode, struct dgde_server_config *config) {
+  int width, height;
+  float refresh = 60.f;
+  int n = sscanf(mode, "%dx%d@%f", &width, &height, &refresh);
+  if (n < 2 || width <= 0 || height <= 0 || refresh <= 0.f) {
+    return false;
+  }
+
+  config->output_width = width;
+  config->output_height = height;
+  config->output_refresh = refresh * 1000;
+  return true;
+}
+
+static bool parse_contents(const char *name,
+                           enum dgde_record_contents *contents) {
+  static const char *const names[] = {
+      [DGDE_RECORD_CONTENTS_NONE] = "none",
+      [DGDE_RECORD_CONTENTS_HASH] = "hash",
+      [DGDE_RECORD_CONTENTS_SCALED] = "scaled",
+  };
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    if (strcmp(name, names[i]) == 0) {
+      *contents = i;
+      return true;
+    }
+  }
+  return false;
+}
+
 int main(int argc, char *argv[]) {
-  wlr_log_init(WLR_DEBUG, NULL);
-  struct dgde_server *server = dgde_server_create("seat0");
+  /* Writing to a client's pipe or socket after it closed its end must be an
+   * EPIPE, not the end of the compositor. A handler rather than SIG_IGN, so
+   * that programs started from here get the default back on exec. Set before
+   * any thread is started, threads share it. */
+  struct sigaction sigpipe = {.sa_handler = ignore_signal};
+  sigaction(SIGPIPE, &sigpipe, NULL);
+
+  struct dgde_server_config config = {
+      .seat_name = "seat0",
+      .composite_threads = 0,
+      .headless_outputs = 0,
+      .output_width = 1920,
+      .output_height = 1080,
+      .output_refresh = 60000,
+      .uncapped = false,
+      .client_memory_budget = 0,
+      .client_commit_budget = 0,
+      .client_dispatch_budget = 0,
+      .throttle_clients = false,
+      .evict_hidden_after = 0,
+      .frame_budget = 0,
+      .idle_timeout = 0,
+      .vnc = false,
+      .virtual_input = false,
+      .clipboard_size = 0,
+      .clipboard_mime_types = "text/*,UTF8_STRING,STRING,TEXT,image/png",
+      .record_path = NULL,
+      .record_contents = DGDE_RECORD_CONTENTS_NONE,
+      .input_trace = NULL,
+      .input_trace_speed = 1.0,
+  };
+  enum wlr_log_importance log_level = WLR_INFO;
+
+  int c;
+  while ((c = getopt(argc, argv,
+                     "t:H:m:ub:r:d:Te:j:i:l:Vvc:C:R:p:I:s:h")) != -1) {
+    switch (c) {
+    case 't':
+      config.composite_threads = strtoul(optarg, NULL, 10);
+      break;
+    case 'H':
+      config.headless_outputs = strtoul(optarg, NULL, 10);
+      break;
+    case 'm':
+      if (!parse_mode(optarg, &config)) {
+        printf("Invalid mode: %s\n", optarg);
+        print_usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'u':
+      config.uncapped = true;
+      break;
+    case 'b':
+      config.client_memory_budget = strtoull(optarg, NULL, 10) * 1024 * 1024;
+      break;
+    case 'r':
+      config.client_commit_budget = strtoul(optarg, NULL, 10);
+      break;
+    case 'd':
+      config.client_dispatch_budget = strtoul(optarg, NULL, 10);
+      break;
+    case 'T':
+      config.throttle_clients = true;
+      break;
+    case 'e':
+      config.evict_hidden_after = strtoul(optarg, NULL, 10);
+      break;
+    case 'j':
+      config.frame_budget = strtoul(optarg, NULL, 10);
+      break;
+    case 'i':
+      config.idle_timeout = strtoul(optarg, NULL, 10);
+      break;
+    case 'l':
+      if (!dgde_log_parse_level(optarg, &log_level)) {
+        printf("Invalid log level: %s\n", optarg);
+        print_usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'V':
+      config.vnc = true;
+      break;
+    case 'v':
+      config.virtual_input = true;
+      break;
+    case 'c':
+      config.clipboard_size = strtoull(optarg, NULL, 10) * 1024 * 1024;
+      break;
+    case 'C':
+      config.clipboard_mime_types = optarg;
+      break;
+    case 'R':
+      config.record_path = optarg;
+      break;
+    case 'p':
+      if (!parse_contents(optarg, &config.record_contents)) {
+        printf("Invalid buffer contents: %s\n", optarg);
+        print_usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'I':
+      config.input_trace = optarg;
+      break;
+    case 's':
+      config.input_trace_speed = strtod(optarg, NULL);
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 0;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind < argc) {
+    printf("Unknown arguments\n");
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  if (config.input_trace != NULL && config.headless_outputs == 0) {
+    printf("Input traces can only be played back headless\n");
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  dgde_log_init(log_level);
+  struct dgde_server *server = dgde_server_create(&config);
+  if (server == NULL) {
+    dgde_log_finish();
+    return 1;
+  }
   const char *socket = dgde_server_attach_socket(server);
   if (!socket) {
     fprintf(stderr, "failed to create Wayland socket\n");
     dgde_server_destroy(server);
+    dgde_log_finish();
     return 1;
   }
 
   setenv("WAYLAND_DISPLAY", socket, true);
+  const char *ipc_socket = dgde_server_ipc_socket(server);
+  if (ipc_socket != NULL) {
+    setenv("DGDE_IPC_SOCKET", ipc_socket, true);
+  }
   wlr_log(WLR_INFO, "Running dgde compositor on WAYLAND_DISPLAY=%s", socket);
 
   dgde_server_run(server);
 
   wlr_log(WLR_INFO, "Shutting down dgde compositor...\n");
   dgde_server_destroy(server);
+  // whatever is still in the log ring
+  dgde_log_finish();
   return 0;
 }
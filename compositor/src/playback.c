@@ -0,0 +1,406 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "playback.h"
+
+#include <linux/input-event-codes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <wayland-server.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/util/log.h>
+
+// what a wheel step scrolls, the same as libinput
+#define WHEEL_DELTA 15
+
+struct trace_event {
+  // microseconds since the recording started
+  uint64_t time;
+  // position in the file, the events of several devices are merged by time
+  uint32_t seq;
+  uint16_t type;
+  uint16_t code;
+  int32_t value;
+};
+
+// a batch is counted as the most expensive kind of event in it
+enum batch_kind {
+  Batch_Motion,
+  Batch_Axis,
+  Batch_Button,
+  Batch_Key,
+  Batch_Count,
+};
+
+static const char *const batch_names[Batch_Count] = {
+    [Batch_Motion] = "motion",
+    [Batch_Axis] = "axis",
+    [Batch_Button] = "button",
+    [Batch_Key] = "key",
+};
+
+struct batch_stats {
+  // processing time of every batch in microseconds
+  uint32_t *samples;
+  size_t count;
+  size_t cap;
+  uint64_t protocol_events;
+};
+
+struct dgde_playback {
+  struct wl_event_loop *loop;
+  struct wlr_input_device *pointer;
+  struct wlr_input_device *keyboard;
+  struct dgde_playback_handler handler;
+  double speed;
+
+  struct trace_event *events;
+  size_t num_events;
+  size_t next;
+
+  bool started;
+  struct timespec start;
+  // the next batch is due
+  struct wl_event_source *timer;
+  // readable when the next batch is overdue, so it is played in the next
+  // loop iteration
+  int wake_fd;
+  struct wl_event_source *wake_source;
+
+  // the batch being measured, until batch_done runs
+  struct wl_protocol_logger *logger;
+  struct wl_event_source *done_idle;
+  bool measuring;
+  enum batch_kind kind;
+  struct timespec batch_start;
+  uint64_t protocol_events;
+
+  struct batch_stats stats[Batch_Count];
+};
+
+static uint64_t elapsed_usec(const struct timespec *since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)(now.tv_sec - since->tv_sec) * 1000000 +
+         (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+static uint32_t now_msec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static int compare_events(const void *a, const void *b) {
+  const struct trace_event *x = a, *y = b;
+  if (x->time != y->time) {
+    return x->time < y->time ? -1 : 1;
+  }
+  return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static int compare_samples(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static bool load_trace(struct dgde_playback *playback, const char *path) {
+  FILE *file = fopen(path, "re");
+  if (file == NULL) {
+    wlr_log_errno(WLR_ERROR, "failed to open input trace %s", path);
+    return false;
+  }
+
+  size_t cap = 0;
+  char *line = NULL;
+  size_t line_size = 0;
+  while (getline(&line, &line_size, file) > 0) {
+    unsigned long long sec, usec;
+    unsigned short type, code;
+    int value;
+    if (sscanf(line, " - [ %llu , %llu , %hu , %hu , %d ]", &sec, &usec,
+               &type, &code, &value) != 5) {
+      continue;
+    }
+
+    if (playback->num_events == cap) {
+      cap = cap > 0 ? cap * 2 : 4096;
+      playback->events =
+          realloc(playback->events, cap * sizeof(struct trace_event));
+    }
+    playback->events[playback->num_events] = (struct trace_event){
+        .time = sec * 1000000 + usec,
+        .seq = playback->num_events,
+        .type = type,
+        .code = code,
+        .value = value,
+    };
+    ++playback->num_events;
+  }
+  free(line);
+  fclose(file);
+
+  if (playback->num_events == 0) {
+    wlr_log(WLR_ERROR, "no evdev events in input trace %s", path);
+    return false;
+  }
+
+  // ties keep the order of the file, so batches stay in one piece
+  qsort(playback->events, playback->num_events, sizeof(struct trace_event),
+        compare_events);
+  return true;
+}
+
+static void report(struct dgde_playback *playback) {
+  wlr_log(WLR_INFO, "input playback of %zu events done",
+          playback->num_events);
+
+  for (int kind = 0; kind < Batch_Count; ++kind) {
+    struct batch_stats *stats = &playback->stats[kind];
+    if (stats->count == 0) {
+      continue;
+    }
+
+    qsort(stats->samples, stats->count, sizeof(uint32_t), compare_samples);
+    wlr_log(WLR_INFO,
+            "%s: %zu batches, p50 %u us, p90 %u us, p99 %u us, max %u us, "
+            "%.1f protocol events each",
+            batch_names[kind], stats->count, stats->samples[stats->count / 2],
+            stats->samples[stats->count * 9 / 10],
+            stats->samples[stats->count * 99 / 100],
+            stats->samples[stats->count - 1],
+            (double)stats->protocol_events / stats->count);
+  }
+}
+
+static void schedule(struct dgde_playback *playback) {
+  if (playback->next == playback->num_events) {
+    report(playback);
+    if (playback->handler.done != NULL) {
+      playback->handler.done(playback->handler.userdata);
+    }
+    return;
+  }
+
+  int64_t delay = 0;
+  if (playback->speed > 0) {
+    uint64_t due = (playback->events[playback->next].time -
+                    playback->events[0].time) /
+                   playback->speed;
+    delay = (int64_t)due - (int64_t)elapsed_usec(&playback->start);
+  }
+
+  // timers only have millisecond resolution and 0 disarms them
+  if (delay < 1000) {
+    eventfd_write(playback->wake_fd, 1);
+  } else {
+    wl_event_source_timer_update(playback->timer, delay / 1000);
+  }
+}
+
+static void batch_done(void *data) {
+  /* Idle sources run in the order they were added, so this comes after the
+   * motion the cursor deferred while the batch was played. */
+  struct dgde_playback *playback = data;
+  playback->done_idle = NULL;
+  playback->measuring = false;
+
+  struct batch_stats *stats = &playback->stats[playback->kind];
+  if (stats->count == stats->cap) {
+    stats->cap = stats->cap > 0 ? stats->cap * 2 : 1024;
+    stats->samples = realloc(stats->samples, stats->cap * sizeof(uint32_t));
+  }
+  stats->samples[stats->count++] = elapsed_usec(&playback->batch_start);
+  stats->protocol_events += playback->protocol_events;
+
+  schedule(playback);
+}
+
+static void emit_motion(struct dgde_playback *playback, double *dx,
+                        double *dy, uint32_t time) {
+  if (*dx == 0 && *dy == 0) {
+    return;
+  }
+
+  struct wlr_event_pointer_motion event = {
+      .device = playback->pointer,
+      .time_msec = time,
+      .delta_x = *dx,
+      .delta_y = *dy,
+      .unaccel_dx = *dx,
+      .unaccel_dy = *dy,
+  };
+  wl_signal_emit(&playback->pointer->pointer->events.motion, &event);
+  *dx = *dy = 0;
+}
+
+static void emit_axis(struct dgde_playback *playback,
+                      const struct trace_event *trace, uint32_t time) {
+  // evdev counts up when scrolling up, Wayland when scrolling down
+  bool vertical = trace->code == REL_WHEEL;
+  int32_t steps = vertical ? -trace->value : trace->value;
+  struct wlr_event_pointer_axis event = {
+      .device = playback->pointer,
+      .time_msec = time,
+      .source = WLR_AXIS_SOURCE_WHEEL,
+      .orientation = vertical ? WLR_AXIS_ORIENTATION_VERTICAL
+                              : WLR_AXIS_ORIENTATION_HORIZONTAL,
+      .delta = steps * WHEEL_DELTA,
+      .delta_discrete = steps,
+  };
+  wl_signal_emit(&playback->pointer->pointer->events.axis, &event);
+}
+
+static void play_batch(struct dgde_playback *playback) {
+  clock_gettime(CLOCK_MONOTONIC, &playback->batch_start);
+  playback->measuring = true;
+  playback->kind = Batch_Motion;
+  playback->protocol_events = 0;
+
+  // input is timestamped now, so that latency.c measures the playback
+  uint32_t time = now_msec();
+  double dx = 0, dy = 0;
+  bool played = false, pointer_frame = false;
+
+  while (playback->next < playback->num_events) {
+    const struct trace_event *trace = &playback->events[playback->next++];
+    if (trace->type == EV_SYN && trace->code == SYN_REPORT) {
+      break;
+    }
+
+    if (trace->type == EV_REL &&
+        (trace->code == REL_X || trace->code == REL_Y)) {
+      *(trace->code == REL_X ? &dx : &dy) += trace->value;
+      played = pointer_frame = true;
+    } else if (trace->type == EV_REL &&
+               (trace->code == REL_WHEEL || trace->code == REL_HWHEEL)) {
+      emit_motion(playback, &dx, &dy, time);
+      emit_axis(playback, trace, time);
+      playback->kind =
+          playback->kind > Batch_Axis ? playback->kind : Batch_Axis;
+      played = pointer_frame = true;
+    } else if (trace->type == EV_KEY && trace->code >= BTN_MOUSE &&
+               trace->code < BTN_JOYSTICK) {
+      emit_motion(playback, &dx, &dy, time);
+      struct wlr_event_pointer_button event = {
+          .device = playback->pointer,
+          .time_msec = time,
+          .button = trace->code,
+          .state = trace->value ? WLR_BUTTON_PRESSED : WLR_BUTTON_RELEASED,
+      };
+      wl_signal_emit(&playback->pointer->pointer->events.button, &event);
+      playback->kind =
+          playback->kind > Batch_Button ? playback->kind : Batch_Button;
+      played = pointer_frame = true;
+    } else if (trace->type == EV_KEY && trace->code < BTN_MISC &&
+               trace->value != 2) {
+      // repeats are the compositor's business, not the trace's
+      struct wlr_event_keyboard_key event = {
+          .time_msec = time,
+          .keycode = trace->code,
+          .update_state = true,
+          .state = trace->value ? WL_KEYBOARD_KEY_STATE_PRESSED
+                                : WL_KEYBOARD_KEY_STATE_RELEASED,
+      };
+      wlr_keyboard_notify_key(playback->keyboard->keyboard, &event);
+      playback->kind = Batch_Key;
+      played = true;
+    }
+  }
+
+  emit_motion(playback, &dx, &dy, time);
+  if (pointer_frame) {
+    wl_signal_emit(&playback->pointer->pointer->events.frame,
+                   playback->pointer->pointer);
+  }
+
+  if (!played) {
+    playback->measuring = false;
+    schedule(playback);
+    return;
+  }
+  playback->done_idle =
+      wl_event_loop_add_idle(playback->loop, batch_done, playback);
+}
+
+static int timer_due(void *data) {
+  play_batch(data);
+  return 0;
+}
+
+static int wake(int fd, uint32_t mask, void *data) {
+  eventfd_t value;
+  eventfd_read(fd, &value);
+  play_batch(data);
+  return 0;
+}
+
+static void log_event(void *data, enum wl_protocol_logger_type type,
+                      const struct wl_protocol_logger_message *message) {
+  struct dgde_playback *playback = data;
+  if (type == WL_PROTOCOL_LOGGER_EVENT && playback->measuring) {
+    ++playback->protocol_events;
+  }
+}
+
+struct dgde_playback *
+dgde_playback_create(struct wl_display *display, const char *path,
+                     double speed, struct wlr_input_device *pointer,
+                     struct wlr_input_device *keyboard,
+                     const struct dgde_playback_handler *handler) {
+  struct dgde_playback *playback = calloc(1, sizeof(struct dgde_playback));
+  if (!load_trace(playback, path)) {
+    free(playback->events);
+    free(playback);
+    return NULL;
+  }
+
+  playback->loop = wl_display_get_event_loop(display);
+  playback->pointer = pointer;
+  playback->keyboard = keyboard;
+  playback->handler = *handler;
+  playback->speed = speed;
+
+  playback->timer =
+      wl_event_loop_add_timer(playback->loop, timer_due, playback);
+  playback->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  playback->wake_source = wl_event_loop_add_fd(
+      playback->loop, playback->wake_fd, WL_EVENT_READABLE, wake, playback);
+  playback->logger =
+      wl_display_add_protocol_logger(display, log_event, playback);
+
+  wlr_log(WLR_INFO, "loaded %zu input events from %s", playback->num_events,
+          path);
+  return playback;
+}
+
+void dgde_playback_start(struct dgde_playback *playback) {
+  if (playback->started) {
+    return;
+  }
+  playback->started = true;
+  clock_gettime(CLOCK_MONOTONIC, &playback->start);
+  schedule(playback);
+}
+
+void dgde_playback_destroy(struct dgde_playback *playback) {
+  if (playback->done_idle != NULL) {
+    wl_event_source_remove(playback->done_idle);
+  }
+  wl_protocol_logger_destroy(playback->logger);
+  wl_event_source_remove(playback->timer);
+  wl_event_source_remove(playback->wake_source);
+  close(playback->wake_fd);
+
+  for (int kind = 0; kind < Batch_Count; ++kind) {
+    free(playback->stats[kind].samples);
+  }
+  free(playback->events);
+  free(playback);
+}
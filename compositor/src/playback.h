@@ -0,0 +1,44 @@
+#ifndef PLAYBACK_H
+#define PLAYBACK_H
+
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_input_device.h>
+
+/* Plays an input trace back through a pointer and keyboard of the headless
+ * backend, so that the whole input path, from the cursor and keyboard
+ * through the hit tests to the events sent to clients, can be benchmarked
+ * with the same input every time.
+ *
+ * Traces are the output of `libinput record`: every line of the form
+ * `- [sec, usec, type, code, value]` is an evdev event and everything else is
+ * ignored, a hand-written trace only needs those lines. Relative motion,
+ * wheels, mouse buttons and keys are played back, absolute axes are not.
+ *
+ * Each SYN_REPORT ends a batch. How long a batch takes to process, including
+ * the motion the cursor defers to the end of the loop iteration, and how many
+ * protocol events it sends to clients are reported once the trace is done. */
+
+struct dgde_playback;
+
+typedef void (*dgde_playback_done_cb)(void *);
+
+struct dgde_playback_handler {
+  void *userdata;
+  // after the report has been logged
+  dgde_playback_done_cb done;
+};
+
+/* The trace is played back speed times as fast as it was recorded, 0 plays
+ * one batch per loop iteration. Returns NULL if the trace can't be read. */
+struct dgde_playback *
+dgde_playback_create(struct wl_display *display, const char *path,
+                     double speed, struct wlr_input_device *pointer,
+                     struct wlr_input_device *keyboard,
+                     const struct dgde_playback_handler *handler);
+
+/* Starts playing, does nothing if it already has. */
+void dgde_playback_start(struct dgde_playback *playback);
+
+void dgde_playback_destroy(struct dgde_playback *playback);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/* USDT probes for bpftrace, perf and SystemTap, built in with -Dusdt=true.
+ * They sit next to the flight recorder events of trace.h, so that live
+ * sessions can be traced without rebuilding or restarting, e.g.
+ *
+ *   bpftrace -e 'usdt:/usr/bin/dgde:dgde:frame_begin { @s[tid] = nsecs; }
+ *     usdt:/usr/bin/dgde:dgde:frame_end /@s[tid]/ {
+ *       @us[str(arg0)] = hist((nsecs - @s[tid]) / 1000); }'
+ *
+ * A probe that nothing is attached to is a single nop. Its arguments are
+ * still computed, so they have to be cheap: pointers, ids and geometry.
+ * Durations come from pairing the _begin and _end probes of the same thread.
+ *
+ *   frame_begin(output name, frame)         frame_end(output name, frame,
+ *                                                     rendered)
+ *   render_surface(view, id, x, y, w, h)    render_surface_end(view)
+ *   layout_begin(workspace, width, height)  layout_end(workspace)
+ *   motion_begin(x, y, coalesced events)    motion_end(x, y)
+ *   button_begin(button, state)             button_end(button)
+ *   key_begin(keycode, state)               key_end(keycode, handled)
+ *   view_map(view, id, x, y, w, h)
+ *   view_unmap(view, id)
+ *   view_destroy(view, id) */
+
+#ifdef DGDE_USDT
+#include <sys/sdt.h>
+#define DGDE_PROBE(name, ...) STAP_PROBEV(dgde, name, __VA_ARGS__)
+#else
+#define DGDE_PROBE(name, ...) ((void)0)
+#endif
+
+#endif
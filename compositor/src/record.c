@@ -0,0 +1,287 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "record.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <wayland-server-protocol.h>
+#include <wayland-server.h>
+#include <wlr/util/log.h>
+
+// interfaces are few, a linear search over their names is fine
+#define MAX_INTERFACES 128
+// the file is written in large chunks, not per request
+#define FILE_BUFFER_SIZE (1 << 20)
+
+#define WL_SURFACE_ATTACH 1
+
+struct client {
+  struct dgde_record *record;
+  uint16_t index;
+  struct wl_listener destroy;
+};
+
+struct dgde_record {
+  FILE *file;
+  enum dgde_record_contents contents;
+  struct timespec start;
+
+  struct wl_protocol_logger *logger;
+  struct wl_listener client_created;
+  uint16_t next_client;
+
+  const char *interfaces[MAX_INTERFACES];
+  uint16_t num_interfaces;
+
+  // payload of the record being written
+  uint8_t *payload;
+  size_t payload_len;
+  size_t payload_cap;
+};
+
+static void put(struct dgde_record *record, const void *data, size_t size) {
+  size_t padded = (size + 3) & ~(size_t)3;
+  if (record->payload_len + padded > record->payload_cap) {
+    size_t cap = record->payload_cap > 0 ? record->payload_cap * 2 : 4096;
+    while (cap < record->payload_len + padded) {
+      cap *= 2;
+    }
+    record->payload = realloc(record->payload, cap);
+    record->payload_cap = cap;
+  }
+
+  if (size > 0) {
+    memcpy(record->payload + record->payload_len, data, size);
+  }
+  memset(record->payload + record->payload_len + size, 0, padded - size);
+  record->payload_len += padded;
+}
+
+static void put_u32(struct dgde_record *record, uint32_t value) {
+  put(record, &value, sizeof(value));
+}
+
+static void write_record(struct dgde_record *record, enum dgde_record_type type,
+                         uint16_t client) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  struct dgde_record_header header = {
+      .type = type,
+      .client = client,
+      .size = record->payload_len,
+      .time = (uint64_t)(now.tv_sec - record->start.tv_sec) * 1000000000 +
+              now.tv_nsec - record->start.tv_nsec,
+  };
+
+  fwrite(&header, sizeof(header), 1, record->file);
+  fwrite(record->payload, 1, record->payload_len, record->file);
+  record->payload_len = 0;
+}
+
+static void handle_client_destroy(struct wl_listener *listener, void *data) {
+  struct client *client = wl_container_of(listener, client, destroy);
+  write_record(client->record, DGDE_RECORD_CLIENT_GONE, client->index);
+  wl_list_remove(&client->destroy.link);
+  free(client);
+}
+
+static void client_created(struct wl_listener *listener, void *data) {
+  struct dgde_record *record =
+      wl_container_of(listener, record, client_created);
+  struct wl_client *wl_client = data;
+
+  struct client *client = calloc(1, sizeof(struct client));
+  client->record = record;
+  client->index = record->next_client++;
+  client->destroy.notify = handle_client_destroy;
+  wl_client_add_destroy_listener(wl_client, &client->destroy);
+
+  write_record(record, DGDE_RECORD_CLIENT, client->index);
+}
+
+static uint16_t interface_index(struct dgde_record *record, const char *name,
+                                uint16_t client) {
+  for (uint16_t i = 0; i < record->num_interfaces; ++i) {
+    if (record->interfaces[i] == name ||
+        strcmp(record->interfaces[i], name) == 0) {
+      return i;
+    }
+  }
+
+  if (record->num_interfaces == MAX_INTERFACES) {
+    return UINT16_MAX;
+  }
+
+  uint16_t index = record->num_interfaces++;
+  record->interfaces[index] = name;
+  put_u32(record, index);
+  put(record, name, strlen(name) + 1);
+  write_record(record, DGDE_RECORD_INTERFACE, client);
+  return index;
+}
+
+static void record_buffer(struct dgde_record *record, uint16_t client,
+                          struct wl_resource *resource) {
+  /* Clients are done drawing by the time they attach a buffer, what is in
+   * it now is what gets committed. */
+  struct wl_shm_buffer *buffer = wl_shm_buffer_get(resource);
+  if (buffer == NULL) {
+    return;
+  }
+
+  uint32_t width = wl_shm_buffer_get_width(buffer);
+  uint32_t height = wl_shm_buffer_get_height(buffer);
+  int32_t stride = wl_shm_buffer_get_stride(buffer);
+  uint32_t format = wl_shm_buffer_get_format(buffer);
+  bool xrgb =
+      format == WL_SHM_FORMAT_XRGB8888 || format == WL_SHM_FORMAT_ARGB8888;
+  enum dgde_record_contents contents =
+      xrgb ? record->contents : DGDE_RECORD_CONTENTS_HASH;
+
+  put_u32(record, wl_resource_get_id(resource));
+  put_u32(record, width);
+  put_u32(record, height);
+  put_u32(record, contents);
+
+  wl_shm_buffer_begin_access(buffer);
+  const uint8_t *data = wl_shm_buffer_get_data(buffer);
+  if (contents == DGDE_RECORD_CONTENTS_SCALED) {
+    put_u32(record, (width + DGDE_RECORD_SCALE - 1) / DGDE_RECORD_SCALE);
+    put_u32(record, (height + DGDE_RECORD_SCALE - 1) / DGDE_RECORD_SCALE);
+    for (uint32_t y = 0; y < height; y += DGDE_RECORD_SCALE) {
+      const uint32_t *row = (const uint32_t *)(data + (size_t)y * stride);
+      for (uint32_t x = 0; x < width; x += DGDE_RECORD_SCALE) {
+        put_u32(record, row[x]);
+      }
+    }
+  } else {
+    /* FNV-1a over the visible part of every row, a word at a time. A byte
+     * at a time would be one multiplication per byte of a buffer attached
+     * every frame, which would slow down what is being recorded. */
+    uint64_t hash = 0xcbf29ce484222325;
+    size_t row_size = (size_t)stride < width * 4 ? (size_t)stride : width * 4;
+    for (uint32_t y = 0; y < height; ++y) {
+      const uint8_t *row = data + (size_t)y * stride;
+      size_t i = 0;
+      for (; i + 8 <= row_size; i += 8) {
+        uint64_t word;
+        memcpy(&word, row + i, 8);
+        hash = (hash ^ word) * 0x100000001b3;
+      }
+      for (; i < row_size; ++i) {
+        hash = (hash ^ row[i]) * 0x100000001b3;
+      }
+    }
+    put(record, &hash, sizeof(hash));
+  }
+  wl_shm_buffer_end_access(buffer);
+
+  write_record(record, DGDE_RECORD_BUFFER, client);
+}
+
+static void log_request(void *data, enum wl_protocol_logger_type type,
+                        const struct wl_protocol_logger_message *message) {
+  if (type != WL_PROTOCOL_LOGGER_REQUEST) {
+    return;
+  }
+
+  struct dgde_record *record = data;
+  struct wl_listener *listener = wl_client_get_destroy_listener(
+      wl_resource_get_client(message->resource), handle_client_destroy);
+  if (listener == NULL) {
+    return;
+  }
+  struct client *client = wl_container_of(listener, client, destroy);
+
+  const char *interface = wl_resource_get_class(message->resource);
+  uint16_t index = interface_index(record, interface, client->index);
+  if (index == UINT16_MAX) {
+    return;
+  }
+
+  uint16_t opcode = message->message_opcode;
+  uint16_t target[2] = {index, opcode};
+  put_u32(record, wl_resource_get_id(message->resource));
+  put(record, target, sizeof(target));
+
+  const char *signature = message->message->signature;
+  const union wl_argument *args = message->arguments;
+  for (int i = 0; *signature != '\0'; ++signature) {
+    switch (*signature) {
+    case 'i':
+    case 'u':
+    case 'f':
+    case 'n':
+      put_u32(record, args[i++].u);
+      break;
+    case 'o': {
+      struct wl_resource *object = (struct wl_resource *)args[i++].o;
+      put_u32(record, object != NULL ? wl_resource_get_id(object) : 0);
+      break;
+    }
+    case 's': {
+      const char *s = args[i++].s;
+      uint32_t size = s != NULL ? strlen(s) + 1 : 0;
+      put_u32(record, size);
+      put(record, s, size);
+      break;
+    }
+    case 'a': {
+      const struct wl_array *array = args[i++].a;
+      uint32_t size = array != NULL ? array->size : 0;
+      put_u32(record, size);
+      put(record, array != NULL ? array->data : NULL, size);
+      break;
+    }
+    case 'h':
+      ++i;
+      break;
+    default:
+      // since versions and nullability
+      break;
+    }
+  }
+  write_record(record, DGDE_RECORD_REQUEST, client->index);
+
+  if (record->contents != DGDE_RECORD_CONTENTS_NONE &&
+      strcmp(interface, "wl_surface") == 0 && opcode == WL_SURFACE_ATTACH &&
+      args[0].o != NULL) {
+    record_buffer(record, client->index, (struct wl_resource *)args[0].o);
+  }
+}
+
+struct dgde_record *dgde_record_create(struct wl_display *display,
+                                       const char *path,
+                                       enum dgde_record_contents contents) {
+  FILE *file = fopen(path, "we");
+  if (file == NULL) {
+    wlr_log_errno(WLR_ERROR, "failed to open %s for recording", path);
+    return NULL;
+  }
+
+  struct dgde_record *record = calloc(1, sizeof(struct dgde_record));
+  record->file = file;
+  record->contents = contents;
+  clock_gettime(CLOCK_MONOTONIC, &record->start);
+  setvbuf(file, NULL, _IOFBF, FILE_BUFFER_SIZE);
+  fwrite(DGDE_RECORD_MAGIC, 1, strlen(DGDE_RECORD_MAGIC), file);
+
+  record->client_created.notify = client_created;
+  wl_display_add_client_created_listener(display, &record->client_created);
+  record->logger = wl_display_add_protocol_logger(display, log_request, record);
+
+  wlr_log(WLR_INFO, "recording clients to %s", path);
+  return record;
+}
+
+void dgde_record_destroy(struct dgde_record *record) {
+  wl_protocol_logger_destroy(record->logger);
+  wl_list_remove(&record->client_created.link);
+  fclose(record->file);
+  free(record->payload);
+  free(record);
+}
@@ -0,0 +1,67 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+
+#include <wayland-server-core.h>
+
+/* Records every request of every client into a file that clients/replay
+ * can play back against another build, e.g. on the headless backend, to
+ * compare frame timings on a real workload.
+ *
+ * The file starts with the 8 byte magic "DGDEREC1" and is followed by
+ * records, all in native byte order:
+ *
+ *   u8 type, u8 reserved, u16 client, u32 payload size, u64 time in ns
+ *
+ * DGDE_RECORD_CLIENT and DGDE_RECORD_CLIENT_GONE have no payload. The first
+ * request on an interface is preceded by DGDE_RECORD_INTERFACE with a u32
+ * index and the NUL terminated interface name. DGDE_RECORD_REQUEST has the
+ * u32 object id, u16 interface index and u16 opcode, followed by the
+ * arguments in the order of the signature: integers, fixed, objects and new
+ * ids as u32, strings and arrays as u32 size and data padded to 4 bytes.
+ * Fds aren't recorded, only where they were passed.
+ *
+ * The contents of shm buffers can't be replayed from the requests. They are
+ * optionally recorded in a DGDE_RECORD_BUFFER when the buffer is attached:
+ * u32 buffer id, u32 width, u32 height and u32 dgde_record_contents, then
+ * either a u64 hash or u32 width, u32 height and the XRGB8888 pixels of a
+ * copy scaled down by DGDE_RECORD_SCALE. */
+
+#define DGDE_RECORD_MAGIC "DGDEREC1"
+#define DGDE_RECORD_SCALE 8
+
+enum dgde_record_type {
+  DGDE_RECORD_CLIENT = 1,
+  DGDE_RECORD_CLIENT_GONE = 2,
+  DGDE_RECORD_INTERFACE = 3,
+  DGDE_RECORD_REQUEST = 4,
+  DGDE_RECORD_BUFFER = 5,
+};
+
+enum dgde_record_contents {
+  DGDE_RECORD_CONTENTS_NONE = 0,
+  // enough to tell whether a frame is new, replayed as a flat colour
+  DGDE_RECORD_CONTENTS_HASH = 1,
+  DGDE_RECORD_CONTENTS_SCALED = 2,
+};
+
+struct dgde_record_header {
+  uint8_t type;
+  uint8_t reserved;
+  uint16_t client;
+  uint32_t size;
+  uint64_t time;
+};
+
+struct dgde_record;
+
+/* Returns NULL if the file can't be written. */
+struct dgde_record *dgde_record_create(struct wl_display *display,
+                                       const char *path,
+                                       enum dgde_record_contents contents);
+
+/* Writes out what is buffered and closes the file. */
+void dgde_record_destroy(struct dgde_record *record);
+
+#endif
@@ -1,56 +1,215 @@
 #define _POSIX_C_SOURCE 200112L
 
 #include "server.h"
+#include "accounting.h"
+#include "clipboard.h"
+#include "composite.h"
 #include "cursor.h"
+#include "ipc.h"
 #include "keyboard.h"
+#include "latency.h"
+#include "playback.h"
+#include "probes.h"
+#include "record.h"
+#include "text.h"
+#include "trace.h"
 #include "view.h"
+#include "vnc.h"
 #include "workspace.h"
+#ifdef DGDE_XWAYLAND
+#include "xwayland.h"
+#endif
 
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <wlr/backend/headless.h>
+#include <wlr/interfaces/wlr_input_device.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/pixman.h>
 #include <wlr/types/wlr_data_device.h>
+#include <wlr/types/wlr_idle.h>
+#include <wlr/types/wlr_idle_inhibit_v1.h>
 #include <wlr/types/wlr_matrix.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_screencopy_v1.h>
 #include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_server_decoration.h>
+#include <wlr/types/wlr_virtual_keyboard_v1.h>
+#include <wlr/types/wlr_virtual_pointer_v1.h>
+#include <wlr/types/wlr_viewporter.h>
+#include <wlr/types/wlr_xdg_decoration_v1.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/edges.h>
 #include <wlr/util/log.h>
+#include <wlr/util/region.h>
 
 struct dgde_server {
   struct wl_display *wl_display;
   struct wlr_backend *backend;
   struct wlr_renderer *renderer;
+  struct dgde_composite_pool *composite_pool;
+  // titlebar text for all outputs
+  struct dgde_glyph_atlas *glyph_atlas;
 
   struct wlr_xdg_shell *xdg_shell;
   struct wl_listener new_xdg_surface;
 
+  struct wlr_xdg_decoration_manager_v1 *xdg_decoration;
+  struct wl_listener new_xdg_decoration;
+
+#ifdef DGDE_XWAYLAND
+  // NULL if Xwayland couldn't be set up
+  struct dgde_xwayland *xwayland;
+#endif
+
   struct dgde_cursor *cursor;
 
   struct wlr_seat *seat;
   struct wl_listener new_input;
+  struct wl_listener focus_change;
   struct wl_listener request_set_selection;
   struct wl_list keyboards;
+  // NULL unless selections are copied into the compositor
+  struct dgde_clipboard *clipboard;
+
+  // input injected by clients, e.g. to measure latency
+  struct wlr_virtual_pointer_manager_v1 *virtual_pointer;
+  struct wl_listener new_virtual_pointer;
+  struct wlr_virtual_keyboard_manager_v1 *virtual_keyboard;
+  struct wl_listener new_virtual_keyboard;
+  struct dgde_latency *latency;
+
+  // outputs are turned off after idle_timeout without input, unless a client
+  // inhibits it, and turned on again by the next input
+  struct wlr_idle *idle;
+  struct wlr_idle_inhibit_manager_v1 *idle_inhibit;
+  struct wl_listener new_idle_inhibitor;
+  uint32_t num_idle_inhibitors;
+  // in milliseconds, 0 never
+  uint32_t idle_timeout;
+  struct wl_event_source *idle_timer;
+  struct timespec last_activity;
+  bool outputs_idle;
 
   struct wlr_output_layout *output_layout;
+  struct wlr_screencopy_manager_v1 *screencopy;
   struct wl_list outputs;
   struct wl_listener new_output;
+
+  // output whose active workspace gets all pointer events, e.g. while a
+  // split is resized
+  struct dgde_output *grab_output;
+
+  // holds views while there is no output to show them on
+  struct dgde_workspace *parked;
+
+  // virtual outputs when running headless
+  bool headless;
+  int32_t output_width;
+  int32_t output_height;
+  int32_t output_refresh;
+  struct wl_event_source *add_output_signal;
+  struct wl_event_source *remove_output_signal;
+  struct wl_event_source *fps_timer;
+  // virtual outputs are served over VNC
+  bool vnc;
+
+  // every frame redraws everything and asks for the next one
+  bool uncapped;
+
+  // name of the Wayland socket, which the other sockets are named after
+  const char *socket;
+
+  // NULL if there is no runtime directory to put the socket in
+  struct dgde_ipc *ipc;
+
+  struct dgde_accounting *accounting;
+
+  // NULL unless recording
+  struct dgde_record *record;
+
+  // NULL unless an input trace is played back, through its own devices
+  struct dgde_playback *playback;
+  struct wlr_input_device *playback_pointer;
+  struct wlr_input_device *playback_keyboard;
+
+  // views on workspaces hidden for longer than this are evicted, 0 never
+  uint32_t evict_after;
+  struct wl_event_source *evict_timer;
+
+  // in nanoseconds, 0 never dumps the flight recorder automatically
+  uint64_t frame_budget;
+  struct timespec last_trace_dump;
+  uint32_t trace_dumps;
 };
 
 struct dgde_output {
   struct wl_list link;
   struct dgde_server *server;
   struct wlr_output *wlr_output;
+  struct wlr_output_damage *damage;
   struct wl_listener frame;
   struct wl_listener mode;
+  struct wl_listener destroy;
+
+  // frames committed since the last frame rate report
+  uint32_t frames;
+
+  // rebuilt every frame when compositing in tiles
+  struct dgde_render_list *render_list;
 
   struct dgde_workspace *workspaces[16];
   uint32_t num_workspaces;
   uint32_t active_workspace;
+
+  // when each workspace was hidden and whether its views have been evicted
+  // since then
+  struct timespec hidden_since[16];
+  bool evicted[16];
+
+  // virtual outputs served over VNC, with their own pointer and keyboard for
+  // the input of viewers
+  struct dgde_vnc *vnc;
+  struct wlr_input_device *vnc_pointer;
+  struct wlr_input_device *vnc_keyboard;
+
+  // shows the frames of this output instead of its own workspaces
+  struct dgde_output *mirror_of;
+  struct wl_listener mirror_commit;
+  // the last frame committed on mirror_of, locked
+  struct wlr_buffer *mirror_buffer;
 };
 
+static void workspace_damage(struct dgde_output *output,
+                             struct dgde_workspace *workspace,
+                             pixman_region32_t *damage) {
+  // hidden workspaces don't need to be redrawn
+  if (output->num_workspaces == 0 ||
+      output->workspaces[output->active_workspace] != workspace) {
+    return;
+  }
+
+  if (damage == NULL) {
+    wlr_output_damage_add_whole(output->damage);
+  } else {
+    pixman_region32_t scaled;
+    pixman_region32_init(&scaled);
+    wlr_region_scale(&scaled, damage, output->wlr_output->scale);
+    wlr_output_damage_add(output->damage, &scaled);
+    pixman_region32_fini(&scaled);
+  }
+
+  /* Even an empty damage means a commit, which might be waiting for a frame
+   * callback. */
+  wlr_output_schedule_frame(output->wlr_output);
+}
+
 static void setup_workspaces(struct dgde_server *server,
                              struct dgde_output *output,
                              uint32_t num_workspaces,
@@ -68,6 +227,12 @@ static void setup_workspaces(struct dgde_server *server,
             buf, output->wlr_output->description, output, width, height);
     output->workspaces[i] =
         dgde_workspace_create(buf, server->seat, width, height);
+    dgde_workspace_set_damage_handler(
+        output->workspaces[i], (dgde_workspace_damage_cb)workspace_damage,
+        output);
+    dgde_workspace_set_visible(output->workspaces[i], output->wlr_output,
+                               i == output->active_workspace);
+    clock_gettime(CLOCK_MONOTONIC, &output->hidden_since[i]);
   }
 }
 
@@ -84,21 +249,190 @@ dgde_output_from_wlr_output(const struct wlr_output *output,
   return NULL;
 }
 
+static struct dgde_output *first_output(struct dgde_server *server) {
+  /* Where views go that have nowhere else to be, mirrors don't show their
+   * workspaces. */
+  struct dgde_output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    if (output->mirror_of == NULL) {
+      return output;
+    }
+  }
+  return NULL;
+}
+
+static struct dgde_output *pointer_output(struct dgde_server *server,
+                                          struct dgde_cursor_position *pos) {
+  /* Returns the output whose active workspace gets pointer events and the
+   * cursor position in its coordinates. While a workspace holds the pointer
+   * grab it gets all events. */
+  *pos = dgde_cursor_position(server->cursor);
+
+  struct dgde_output *output = server->grab_output;
+  if (output == NULL) {
+    struct wlr_output *wlr_output =
+        wlr_output_layout_output_at(server->output_layout, pos->x, pos->y);
+    if (wlr_output == NULL) {
+      return NULL;
+    }
+    output = dgde_output_from_wlr_output(wlr_output, server->outputs);
+  }
+
+  if (output == NULL || output->num_workspaces == 0) {
+    return NULL;
+  }
+
+  wlr_output_layout_output_coords(server->output_layout, output->wlr_output,
+                                  &pos->x, &pos->y);
+  return output;
+}
+
+static uint64_t elapsed_ns(const struct timespec *from,
+                           const struct timespec *to) {
+  return (int64_t)(to->tv_sec - from->tv_sec) * 1000000000 +
+         (to->tv_nsec - from->tv_nsec);
+}
+
+static void set_outputs_enabled(struct dgde_server *server, bool enabled) {
+  struct dgde_output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    struct wlr_output *wlr_output = output->wlr_output;
+    if (wlr_output->enabled == enabled) {
+      continue;
+    }
+
+    wlr_output_enable(wlr_output, enabled);
+    if (!wlr_output_commit(wlr_output)) {
+      wlr_log(WLR_ERROR, "failed to turn %s %s", wlr_output->name,
+              enabled ? "on" : "off");
+      continue;
+    }
+
+    if (enabled) {
+      wlr_output_damage_add_whole(output->damage);
+    }
+  }
+}
+
+static int idle_timeout(void *data) {
+  /* Input only records when it happened, the timer is re-armed here for
+   * whatever is left of the timeout so that input doesn't cost a syscall. */
+  struct dgde_server *server = data;
+  if (server->num_idle_inhibitors > 0 || server->outputs_idle) {
+    return 0;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t idle_ms = elapsed_ns(&server->last_activity, &now) / 1000000;
+  if (idle_ms < server->idle_timeout) {
+    wl_event_source_timer_update(server->idle_timer,
+                                 server->idle_timeout - idle_ms);
+    return 0;
+  }
+
+  /* Disabled outputs don't get frame events, so nothing is rendered and no
+   * frame callbacks are sent until there is input again. */
+  wlr_log(WLR_INFO, "no input for %u s, turning outputs off",
+          server->idle_timeout / 1000);
+  server->outputs_idle = true;
+  set_outputs_enabled(server, false);
+  return 0;
+}
+
+static void notify_activity(struct dgde_server *server) {
+  wlr_idle_notify_activity(server->idle, server->seat);
+  if (server->idle_timer == NULL) {
+    return;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &server->last_activity);
+  if (server->outputs_idle) {
+    wlr_log(WLR_INFO, "input while idle, turning outputs on");
+    server->outputs_idle = false;
+    set_outputs_enabled(server, true);
+    wl_event_source_timer_update(server->idle_timer, server->idle_timeout);
+  }
+}
+
+struct idle_inhibitor {
+  struct dgde_server *server;
+  struct wl_listener destroy;
+};
+
+static void set_idle_inhibited(struct dgde_server *server, bool inhibited) {
+  // also tells clients watching for idle, e.g. screen lockers
+  wlr_idle_set_enabled(server->idle, server->seat, !inhibited);
+
+  // idle time is counted from when the last inhibitor went away
+  if (!inhibited && server->idle_timer != NULL) {
+    clock_gettime(CLOCK_MONOTONIC, &server->last_activity);
+    wl_event_source_timer_update(server->idle_timer, server->idle_timeout);
+  }
+}
+
+static void idle_inhibitor_destroy(struct wl_listener *listener, void *data) {
+  struct idle_inhibitor *inhibitor =
+      wl_container_of(listener, inhibitor, destroy);
+  struct dgde_server *server = inhibitor->server;
+  wl_list_remove(&inhibitor->destroy.link);
+  free(inhibitor);
+
+  if (--server->num_idle_inhibitors == 0) {
+    set_idle_inhibited(server, false);
+  }
+}
+
+static void new_idle_inhibitor(struct wl_listener *listener, void *data) {
+  /* Video players and presentations keep the outputs on for as long as they
+   * hold an inhibitor, whether their surface is visible or not. */
+  struct dgde_server *server =
+      wl_container_of(listener, server, new_idle_inhibitor);
+  struct wlr_idle_inhibitor_v1 *wlr_inhibitor = data;
+
+  struct idle_inhibitor *inhibitor = calloc(1, sizeof(struct idle_inhibitor));
+  inhibitor->server = server;
+  inhibitor->destroy.notify = idle_inhibitor_destroy;
+  wl_signal_add(&wlr_inhibitor->events.destroy, &inhibitor->destroy);
+
+  if (server->num_idle_inhibitors++ == 0) {
+    set_idle_inhibited(server, true);
+  }
+}
+
+static bool pointer_over_unmanaged(struct dgde_server *server,
+                                   struct wlr_surface **surface, double *sx,
+                                   double *sy) {
+#ifdef DGDE_XWAYLAND
+  /* X11 menus and tooltips are above all workspaces. They get pointer events
+   * directly, without starting grabs or taking focus. */
+  if (server->xwayland != NULL && server->grab_output == NULL) {
+    struct dgde_cursor_position pos = dgde_cursor_position(server->cursor);
+    *surface = dgde_xwayland_surface_at(server->xwayland, pos.x, pos.y, sx, sy);
+    return *surface != NULL;
+  }
+#endif
+  return false;
+}
+
 static void process_cursor_motion(struct dgde_server *server,
                                   struct wlr_event_pointer_motion *event) {
-  // only send event to current workspace
-  struct dgde_cursor_position pos = dgde_cursor_position(server->cursor);
+  notify_activity(server);
 
-  struct wlr_output *wlr_output =
-      wlr_output_layout_output_at(server->output_layout, pos.x, pos.y);
-  if (wlr_output != NULL) {
+  struct wlr_surface *surface;
+  double sx, sy;
+  if (pointer_over_unmanaged(server, &surface, &sx, &sy)) {
+    wlr_seat_pointer_notify_enter(server->seat, surface, sx, sy);
+    wlr_seat_pointer_notify_motion(server->seat, event->time_msec, sx, sy);
+    return;
+  }
 
-    struct dgde_output *res =
-        dgde_output_from_wlr_output(wlr_output, server->outputs);
-    if (res != NULL && res->num_workspaces > 0) {
-      struct dgde_workspace *ws = res->workspaces[res->active_workspace];
-      dgde_workspace_on_cursor_motion(ws, server->cursor, event);
-    }
+  // only send event to current workspace
+  struct dgde_cursor_position pos;
+  struct dgde_output *output = pointer_output(server, &pos);
+  if (output != NULL) {
+    struct dgde_workspace *ws = output->workspaces[output->active_workspace];
+    dgde_workspace_on_cursor_motion(ws, server->cursor, pos, event);
   }
 }
 
@@ -118,14 +452,35 @@ static void process_cursor_motion_absolute(
 
 static void process_cursor_button(struct dgde_server *server,
                                   struct wlr_event_pointer_button *event) {
+  notify_activity(server);
+  struct wlr_surface *surface;
+  double sx, sy;
+  struct dgde_cursor_position pos;
+  struct dgde_output *output = pointer_output(server, &pos);
+  if (output != NULL && !pointer_over_unmanaged(server, &surface, &sx, &sy)) {
+    struct dgde_workspace *ws = output->workspaces[output->active_workspace];
+    bool handled =
+        dgde_workspace_on_cursor_button(ws, server->cursor, pos, event);
+
+    // the workspace keeps the pointer until the resize or move is done
+    server->grab_output = dgde_workspace_has_grab(ws) ? output : NULL;
+
+    if (handled) {
+      return;
+    }
+  }
 
   /* Notify the client with pointer focus that a button press has occurred */
   wlr_seat_pointer_notify_button(server->seat, event->time_msec, event->button,
                                  event->state);
+  dgde_latency_input(server->latency,
+                     server->seat->pointer_state.focused_surface,
+                     event->time_msec);
 }
 
 static void process_cursor_axis(struct dgde_server *server,
                                 struct wlr_event_pointer_axis *event) {
+  notify_activity(server);
   /* Notify the client with pointer focus of the axis event. */
   wlr_seat_pointer_notify_axis(server->seat, event->time_msec,
                                event->orientation, event->delta,
@@ -137,12 +492,270 @@ static void process_cursor_frame(struct dgde_server *server) {
   wlr_seat_pointer_notify_frame(server->seat);
 }
 
+static void write_view(struct dgde_ipc_message *message,
+                       struct dgde_view *view) {
+  struct dgde_view_position pos = dgde_view_position(view);
+  struct wlr_box geom = dgde_view_geometry(view);
+
+  dgde_ipc_message_printf(message, "{\"id\":%u,\"app_id\":",
+                          dgde_view_id(view));
+  dgde_ipc_message_add_string(message, dgde_view_app_id(view));
+  dgde_ipc_message_printf(message, ",\"title\":");
+  dgde_ipc_message_add_string(message, dgde_view_title(view));
+  dgde_ipc_message_printf(
+      message,
+      ",\"mapped\":%s,\"floating\":%s,\"x\":%d,\"y\":%d,\"width\":%d,"
+      "\"height\":%d}",
+      dgde_view_is_mapped(view) ? "true" : "false",
+      dgde_view_is_floating(view) ? "true" : "false", pos.x, pos.y, geom.width,
+      geom.height);
+}
+
+struct json_list {
+  struct dgde_ipc_message *message;
+  bool empty;
+};
+
+static void write_list_view(struct dgde_view *view, void *data) {
+  struct json_list *list = data;
+  if (!list->empty) {
+    dgde_ipc_message_printf(list->message, ",");
+  }
+  list->empty = false;
+  write_view(list->message, view);
+}
+
+static void write_workspace(struct dgde_ipc_message *message,
+                            struct dgde_workspace *workspace) {
+  dgde_ipc_message_printf(message, "{\"name\":");
+  dgde_ipc_message_add_string(message, dgde_workspace_name(workspace));
+  dgde_ipc_message_printf(message, ",\"views\":[");
+  struct json_list list = {.message = message, .empty = true};
+  dgde_workspace_for_each_view(workspace, write_list_view, &list);
+  dgde_ipc_message_printf(message, "]}");
+}
+
+static void write_focus(struct dgde_ipc_message *message,
+                        struct wlr_surface *surface) {
+  struct dgde_view *view = dgde_view_from_surface(surface);
+  if (view != NULL) {
+    dgde_ipc_message_printf(message, "%u", dgde_view_id(view));
+  } else {
+    dgde_ipc_message_printf(message, "null");
+  }
+}
+
+static void ipc_tree(struct dgde_server *server,
+                     struct dgde_ipc_message *message) {
+  dgde_ipc_message_printf(message, "{\"outputs\":[");
+
+  struct dgde_output *output;
+  bool first = true;
+  wl_list_for_each(output, &server->outputs, link) {
+    struct wlr_box box = {0};
+    struct wlr_box *layout_box =
+        wlr_output_layout_get_box(server->output_layout, output->wlr_output);
+    if (layout_box != NULL) {
+      box = *layout_box;
+    }
+
+    dgde_ipc_message_printf(message, first ? "{\"name\":" : ",{\"name\":");
+    first = false;
+    dgde_ipc_message_add_string(message, output->wlr_output->name);
+    dgde_ipc_message_printf(
+        message,
+        ",\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d,"
+        "\"active_workspace\":%u,\"mirror_of\":",
+        box.x, box.y, box.width, box.height, output->active_workspace);
+    dgde_ipc_message_add_string(
+        message,
+        output->mirror_of != NULL ? output->mirror_of->wlr_output->name : NULL);
+    dgde_ipc_message_printf(message, ",\"workspaces\":[");
+    for (uint32_t i = 0, e = output->num_workspaces; i < e; ++i) {
+      if (i > 0) {
+        dgde_ipc_message_printf(message, ",");
+      }
+      write_workspace(message, output->workspaces[i]);
+    }
+    dgde_ipc_message_printf(message, "]}");
+  }
+
+  // views waiting for an output
+  dgde_ipc_message_printf(message, "],\"parked\":");
+  write_workspace(message, server->parked);
+  dgde_ipc_message_printf(message, ",\"focused\":");
+  write_focus(message, server->seat->keyboard_state.focused_surface);
+  dgde_ipc_message_printf(message, "}");
+}
+
+static void write_client(const struct dgde_client_stats *stats, void *data) {
+  struct json_list *list = data;
+  dgde_ipc_message_printf(
+      list->message,
+      "%s{\"pid\":%d,\"surfaces\":%u,\"buffer_bytes\":%llu,"
+      "\"texture_bytes\":%llu,\"commit_rate\":%u,\"frame_rate\":%u,"
+      "\"dispatch_time\":%u,\"over_budget\":%s,\"throttled\":%s}",
+      list->empty ? "" : ",", stats->pid, stats->surfaces,
+      (unsigned long long)stats->buffer_bytes,
+      (unsigned long long)stats->texture_bytes, stats->commit_rate,
+      stats->frame_rate, stats->dispatch_time,
+      stats->over_budget ? "true" : "false",
+      stats->throttled ? "true" : "false");
+  list->empty = false;
+}
+
+static void ipc_clients(struct dgde_server *server,
+                        struct dgde_ipc_message *message) {
+  struct json_list list = {.message = message, .empty = true};
+  dgde_ipc_message_printf(message, "{\"clients\":[");
+  dgde_accounting_for_each_client(server->accounting, write_client, &list);
+  dgde_ipc_message_printf(message, "]}");
+}
+
+static void ipc_latency(struct dgde_server *server,
+                        struct dgde_ipc_message *message) {
+  const struct dgde_latency_stats *stats = dgde_latency_stats(server->latency);
+  dgde_ipc_message_printf(
+      message,
+      "{\"samples\":%lu,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u,"
+      "\"histogram\":[",
+      (unsigned long)stats->samples, stats->p50, stats->p90, stats->p99,
+      stats->max);
+
+  // one entry per millisecond, the last one counts everything slower
+  for (uint32_t i = 0; i < DGDE_LATENCY_BUCKETS; ++i) {
+    dgde_ipc_message_printf(message, "%s%lu", i == 0 ? "" : ",",
+                            (unsigned long)stats->histogram[i]);
+  }
+  dgde_ipc_message_printf(message, "]}");
+}
+
+static void send_view_event(struct dgde_server *server, struct dgde_view *view,
+                            const char *change) {
+  if (!dgde_ipc_has_subscribers(server->ipc, DgdeIpcEvent_View)) {
+    return;
+  }
+
+  struct dgde_ipc_message *message = dgde_ipc_message_create();
+  dgde_ipc_message_printf(message, "{\"event\":\"view\",\"change\":");
+  dgde_ipc_message_add_string(message, change);
+  dgde_ipc_message_printf(message, ",\"view\":");
+  write_view(message, view);
+  dgde_ipc_message_printf(message, "}");
+  dgde_ipc_send_event(server->ipc, DgdeIpcEvent_View, NULL, message);
+}
+
+static void view_mapped(struct dgde_server *server, struct dgde_view *view) {
+  send_view_event(server, view, "added");
+  if (server->playback != NULL) {
+    dgde_playback_start(server->playback);
+  }
+}
+
+static void view_unmapped(struct dgde_server *server, struct dgde_view *view) {
+  send_view_event(server, view, "removed");
+}
+
+static void seat_focus_change(struct wl_listener *listener, void *data) {
+  struct dgde_server *server = wl_container_of(listener, server, focus_change);
+  struct wlr_seat_keyboard_focus_change_event *event = data;
+  dgde_accounting_set_focus(
+      server->accounting,
+      event->new_surface != NULL
+          ? wl_resource_get_client(event->new_surface->resource)
+          : NULL);
+
+  if (!dgde_ipc_has_subscribers(server->ipc, DgdeIpcEvent_Focus)) {
+    return;
+  }
+
+  /* Only the latest focus matters to a client that is behind. */
+  struct dgde_ipc_message *message = dgde_ipc_message_create();
+  dgde_ipc_message_printf(message, "{\"event\":\"focus\",\"view\":");
+  write_focus(message, event->new_surface);
+  dgde_ipc_message_printf(message, "}");
+  dgde_ipc_send_event(server->ipc, DgdeIpcEvent_Focus, server->seat, message);
+}
+
+static void switch_workspace(struct dgde_output *output, uint32_t index) {
+  if (index >= output->num_workspaces ||
+      index == output->active_workspace) {
+    return;
+  }
+
+  wlr_log(WLR_DEBUG, "switching to workspace %d on output %s", index,
+          output->wlr_output->description);
+  uint32_t previous = output->active_workspace;
+  dgde_workspace_set_visible(output->workspaces[previous], output->wlr_output,
+                             false);
+  clock_gettime(CLOCK_MONOTONIC, &output->hidden_since[previous]);
+  output->evicted[previous] = false;
+
+  output->active_workspace = index;
+  dgde_workspace_set_visible(output->workspaces[index], output->wlr_output,
+                             true);
+  wlr_output_damage_add_whole(output->damage);
+  wlr_output_schedule_frame(output->wlr_output);
+
+  struct dgde_server *server = output->server;
+  if (!dgde_ipc_has_subscribers(server->ipc, DgdeIpcEvent_Workspace)) {
+    return;
+  }
+
+  struct dgde_ipc_message *message = dgde_ipc_message_create();
+  dgde_ipc_message_printf(message, "{\"event\":\"workspace\",\"output\":");
+  dgde_ipc_message_add_string(message, output->wlr_output->name);
+  dgde_ipc_message_printf(message, ",\"workspace\":%u,\"name\":", index);
+  dgde_ipc_message_add_string(
+      message, dgde_workspace_name(output->workspaces[index]));
+  dgde_ipc_message_printf(message, "}");
+  dgde_ipc_send_event(server->ipc, DgdeIpcEvent_Workspace, output, message);
+}
+
+// automatic dumps are at least this many seconds apart and only the last few
+// are kept, so a stuttering session can't fill up the disk
+#define TRACE_DUMP_INTERVAL 10
+#define TRACE_DUMPS_KEPT 8
+
+static void trace_path(struct dgde_server *server, char *path, size_t size) {
+  const char *dir = getenv("XDG_RUNTIME_DIR");
+  snprintf(path, size, "%s/dgde-trace-%d-%u.json", dir != NULL ? dir : "/tmp",
+           getpid(), server->trace_dumps++ % TRACE_DUMPS_KEPT);
+}
+
+static void ipc_trace(struct dgde_server *server,
+                      struct dgde_ipc_message *message) {
+  char path[256];
+  trace_path(server, path, sizeof(path));
+  if (!dgde_trace_dump(path)) {
+    dgde_ipc_message_printf(message, "{\"success\":false,\"error\":"
+                                     "\"failed to write trace\"}");
+    return;
+  }
+
+  dgde_ipc_message_printf(message, "{\"success\":true,\"path\":");
+  dgde_ipc_message_add_string(message, path);
+  dgde_ipc_message_printf(message, "}");
+}
+
+static struct dgde_output *output_at_cursor(struct dgde_server *server) {
+  struct dgde_cursor_position pos = dgde_cursor_position(server->cursor);
+  struct wlr_output *wlr_output =
+      wlr_output_layout_output_at(server->output_layout, pos.x, pos.y);
+  if (wlr_output != NULL) {
+    return dgde_output_from_wlr_output(wlr_output, server->outputs);
+  }
+
+  return first_output(server);
+}
+
 static bool handle_keybinding(struct dgde_server *server, xkb_keysym_t sym) {
   /*
    * Here we handle compositor keybindings. This is when the compositor is
    * processing keys, rather than passing them on to the client for its own
    * processing.
    */
+  notify_activity(server);
   switch (sym) {
   case XKB_KEY_1:
     wl_display_terminate(server->wl_display);
@@ -164,37 +777,79 @@ static bool handle_keybinding(struct dgde_server *server, xkb_keysym_t sym) {
     }
     break;
 
+  case XKB_KEY_f: {
+    // float or tile the focused view
+    struct dgde_output *output = output_at_cursor(server);
+    struct dgde_view *view =
+        dgde_view_from_surface(server->seat->keyboard_state.focused_surface);
+    if (output != NULL && output->num_workspaces > 0 && view != NULL) {
+      dgde_workspace_toggle_floating(
+          output->workspaces[output->active_workspace], view);
+    }
+    break;
+  }
+
+  case XKB_KEY_F1:
+  case XKB_KEY_F2:
+  case XKB_KEY_F3:
+  case XKB_KEY_F4: {
+    struct dgde_output *output = output_at_cursor(server);
+    if (output != NULL) {
+      switch_workspace(output, sym - XKB_KEY_F1);
+    }
+    break;
+  }
+
   default:
     return false;
   }
   return true;
 }
 
-static void output_frame(struct wl_listener *listener, void *data) {
-  /* This function is called every time an output is ready to display a frame,
-   * generally at the output's refresh rate (e.g. 60Hz). */
-  struct dgde_output *output = wl_container_of(listener, output, frame);
+static void render_output(struct dgde_output *output,
+                          struct dgde_workspace *ws,
+                          pixman_region32_t *buffer_damage,
+                          struct timespec now) {
+  struct wlr_output *wlr_output = output->wlr_output;
   struct wlr_renderer *renderer = output->server->renderer;
 
-  struct timespec now;
-  clock_gettime(CLOCK_MONOTONIC, &now);
-
-  /* wlr_output_attach_render makes the OpenGL context current. */
-  if (!wlr_output_attach_render(output->wlr_output, NULL)) {
-    return;
-  }
   /* The "effective" resolution can change if you rotate your outputs. */
   int width, height;
-  wlr_output_effective_resolution(output->wlr_output, &width, &height);
+  wlr_output_effective_resolution(wlr_output, &width, &height);
   /* Begin the renderer (calls glViewport and some other GL sanity checks) */
   wlr_renderer_begin(renderer, width, height);
 
   float color[4] = {0.3, 0.3, 0.3, 1.0};
-  wlr_renderer_clear(renderer, color);
-
-  struct dgde_workspace *ws = output->workspaces[output->active_workspace];
-  dgde_workspace_render(ws, output->server->renderer, output->wlr_output,
-                        output->server->output_layout, now);
+  if (output->server->composite_pool != NULL) {
+    /* Collect everything to draw on the main thread and let the pool
+     * composite it directly into the pixman buffer, one tile per job. Tiles
+     * that are still valid in the buffer are skipped. */
+    dgde_render_list_reset(output->render_list);
+    dgde_workspace_collect(ws, output->server->glyph_atlas, wlr_output,
+                           output->server->output_layout, now,
+                           output->render_list);
+#ifdef DGDE_XWAYLAND
+    if (output->server->xwayland != NULL) {
+      dgde_xwayland_collect(output->server->xwayland, wlr_output,
+                            output->server->output_layout,
+                            output->render_list);
+    }
+#endif
+    dgde_composite_pool_run(output->server->composite_pool,
+                            output->render_list,
+                            wlr_pixman_renderer_get_current_image(renderer),
+                            color, buffer_damage);
+  } else {
+    wlr_renderer_clear(renderer, color);
+    dgde_workspace_render(ws, renderer, output->server->glyph_atlas,
+                          wlr_output, output->server->output_layout, now);
+#ifdef DGDE_XWAYLAND
+    if (output->server->xwayland != NULL) {
+      dgde_xwayland_render(output->server->xwayland, renderer, wlr_output,
+                           output->server->output_layout);
+    }
+#endif
+  }
 
   /* Hardware cursors are rendered by the GPU on a separate plane, and can
    * be moved around without re-rendering what's beneath them - which is
@@ -203,12 +858,314 @@ static void output_frame(struct wl_listener *listener, void *data) {
    * to render here. wlr_cursor handles configuring hardware vs software
    * cursors for you,
    * and this function is a no-op when hardware cursors are in use. */
-  wlr_output_render_software_cursors(output->wlr_output, NULL);
+  wlr_output_render_software_cursors(wlr_output, NULL);
+
+  /* Tell the backend which parts of the frame changed. Screencopy clients
+   * using copy_with_damage only get woken up for these regions, VNC viewers
+   * only get sent these. */
+  int buffer_width, buffer_height;
+  wlr_output_transformed_resolution(wlr_output, &buffer_width,
+                                    &buffer_height);
+  pixman_region32_t frame_damage;
+  pixman_region32_init(&frame_damage);
+  wlr_region_transform(&frame_damage, &output->damage->current,
+                       wlr_output_transform_invert(wlr_output->transform),
+                       buffer_width, buffer_height);
+  if (output->vnc != NULL) {
+    dgde_vnc_capture(output->vnc, renderer, &frame_damage);
+  }
 
   /* Conclude rendering and swap the buffers, showing the final frame
    * on-screen. */
   wlr_renderer_end(renderer);
-  wlr_output_commit(output->wlr_output);
+
+  wlr_output_set_damage(wlr_output, &frame_damage);
+  pixman_region32_fini(&frame_damage);
+
+  if (wlr_output_commit(wlr_output)) {
+    ++output->frames;
+    dgde_latency_output_commit(output->server->latency, wlr_output);
+  }
+}
+
+static void check_frame_budget(struct dgde_output *output,
+                               const struct timespec *start) {
+  struct dgde_server *server = output->server;
+  if (server->frame_budget == 0) {
+    return;
+  }
+
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  uint64_t duration = elapsed_ns(start, &end);
+  if (duration <= server->frame_budget) {
+    return;
+  }
+
+  /* Whatever made the frame slow is in the recorder now, the events leading
+   * up to it included. */
+  if (server->last_trace_dump.tv_sec != 0 &&
+      end.tv_sec - server->last_trace_dump.tv_sec < TRACE_DUMP_INTERVAL) {
+    wlr_log(WLR_DEBUG, "frame on %s took %.1f ms", output->wlr_output->name,
+            duration / 1e6);
+    return;
+  }
+
+  /* Writing the trace takes a while, which would make the frame slower
+   * still and hold up whatever else is waiting in the event loop. */
+  char path[256];
+  server->last_trace_dump = end;
+  trace_path(server, path, sizeof(path));
+  if (dgde_trace_dump_async(path)) {
+    wlr_log(WLR_INFO, "frame on %s took %.1f ms, writing the trace to %s",
+            output->wlr_output->name, duration / 1e6, path);
+  }
+}
+
+static void mirror_commit(struct wl_listener *listener, void *data) {
+  /* Keeps the frame the mirrored output just committed. While it is locked
+   * the swapchain of that output won't draw into it. */
+  struct dgde_output *output = wl_container_of(listener, output, mirror_commit);
+  struct wlr_output_event_commit *event = data;
+  if (event->buffer == NULL) {
+    return;
+  }
+
+  wlr_buffer_unlock(output->mirror_buffer);
+  output->mirror_buffer = wlr_buffer_lock(event->buffer);
+  wlr_output_damage_add_whole(output->damage);
+}
+
+static void render_mirror(struct dgde_output *output) {
+  struct wlr_output *wlr_output = output->wlr_output;
+  struct wlr_output *source = output->mirror_of->wlr_output;
+  struct wlr_buffer *buffer = output->mirror_buffer;
+  if (buffer == NULL) {
+    return;
+  }
+
+  /* At the same size and orientation the frame of the other output is put
+   * on screen as it is, nothing is drawn or copied. That takes a backend that
+   * can scan it out, e.g. both outputs on the same GPU. VNC viewers need the
+   * frame rendered to read it back. */
+  if (output->vnc == NULL && buffer->width == wlr_output->width &&
+      buffer->height == wlr_output->height &&
+      source->transform == wlr_output->transform) {
+    wlr_output_attach_buffer(wlr_output, buffer);
+    if (wlr_output_test(wlr_output) && wlr_output_commit(wlr_output)) {
+      ++output->frames;
+      return;
+    }
+    wlr_output_rollback(wlr_output);
+  }
+
+  /* Otherwise it is drawn as a single texture, scaled to fit and
+   * letterboxed. */
+  struct wlr_renderer *renderer = output->server->renderer;
+  struct wlr_texture *texture = wlr_texture_from_buffer(renderer, buffer);
+  if (texture == NULL || !wlr_output_attach_render(wlr_output, NULL)) {
+    wlr_texture_destroy(texture);
+    return;
+  }
+
+  int width, height, source_width, source_height;
+  wlr_output_transformed_resolution(wlr_output, &width, &height);
+  wlr_output_transformed_resolution(source, &source_width, &source_height);
+  double scale_x = (double)width / source_width;
+  double scale_y = (double)height / source_height;
+  double scale = scale_x < scale_y ? scale_x : scale_y;
+  struct wlr_box box = {
+      .width = source_width * scale,
+      .height = source_height * scale,
+  };
+  box.x = (width - box.width) / 2;
+  box.y = (height - box.height) / 2;
+
+  float matrix[9];
+  wlr_matrix_project_box(matrix, &box,
+                         wlr_output_transform_invert(source->transform), 0,
+                         wlr_output->transform_matrix);
+
+  float black[4] = {0.0, 0.0, 0.0, 1.0};
+  wlr_renderer_begin(renderer, wlr_output->width, wlr_output->height);
+  wlr_renderer_clear(renderer, black);
+  wlr_render_texture_with_matrix(renderer, texture, matrix, 1.0);
+  if (output->vnc != NULL) {
+    // every frame of a mirror is redrawn as a whole
+    pixman_region32_t frame_damage;
+    pixman_region32_init_rect(&frame_damage, 0, 0, wlr_output->width,
+                              wlr_output->height);
+    dgde_vnc_capture(output->vnc, renderer, &frame_damage);
+    pixman_region32_fini(&frame_damage);
+  }
+  wlr_renderer_end(renderer);
+  wlr_texture_destroy(texture);
+
+  if (wlr_output_commit(wlr_output)) {
+    ++output->frames;
+  }
+}
+
+static void stop_mirror(struct dgde_output *output) {
+  wl_list_remove(&output->mirror_commit.link);
+  wlr_buffer_unlock(output->mirror_buffer);
+  output->mirror_buffer = NULL;
+  output->mirror_of = NULL;
+}
+
+static void unmirror(struct dgde_output *output) {
+  stop_mirror(output);
+  wlr_output_layout_add_auto(output->server->output_layout,
+                             output->wlr_output);
+  wlr_output_damage_add_whole(output->damage);
+  wlr_log(WLR_INFO, "%s no longer mirrors", output->wlr_output->name);
+}
+
+static struct dgde_output *output_by_name(struct dgde_server *server,
+                                          const char *name) {
+  struct dgde_output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    if (strcmp(output->wlr_output->name, name) == 0) {
+      return output;
+    }
+  }
+  return NULL;
+}
+
+static const char *ipc_mirror(struct dgde_server *server, const char *name,
+                              const char *source_name) {
+  struct dgde_output *output = output_by_name(server, name);
+  if (output == NULL) {
+    return "unknown output";
+  }
+
+  struct dgde_output *source = NULL;
+  if (source_name != NULL) {
+    source = output_by_name(server, source_name);
+    if (source == NULL) {
+      return "unknown output";
+    }
+    // mirrors of mirrors would need to follow each other around
+    if (source == output || source->mirror_of != NULL) {
+      return "can't mirror that output";
+    }
+    struct dgde_output *o;
+    wl_list_for_each(o, &server->outputs, link) {
+      if (o->mirror_of == output) {
+        return "output is mirrored";
+      }
+    }
+  }
+
+  if (output->mirror_of != NULL) {
+    unmirror(output);
+  }
+  if (source == NULL) {
+    return NULL;
+  }
+
+  /* A mirror is taken out of the layout so that neither the pointer nor
+   * views end up on it, its views move to the output it mirrors. */
+  wlr_output_layout_remove(server->output_layout, output->wlr_output);
+  if (server->grab_output == output) {
+    server->grab_output = NULL;
+  }
+  for (uint32_t i = 0, e = output->num_workspaces; i < e; ++i) {
+    dgde_workspace_move_views(output->workspaces[i],
+                              source->workspaces[source->active_workspace]);
+  }
+
+  output->mirror_of = source;
+  output->mirror_commit.notify = mirror_commit;
+  wl_signal_add(&source->wlr_output->events.commit, &output->mirror_commit);
+  // there is nothing to show until it draws a frame
+  wlr_output_damage_add_whole(source->damage);
+
+  wlr_log(WLR_INFO, "%s mirrors %s", output->wlr_output->name,
+          source->wlr_output->name);
+  return NULL;
+}
+
+static bool copy_pending(struct dgde_output *output) {
+  struct wlr_screencopy_frame_v1 *frame;
+  wl_list_for_each(frame, &output->server->screencopy->frames, link) {
+    // copy_with_damage waits for damage anyway
+    if (frame->output == output->wlr_output && !frame->with_damage &&
+        (frame->shm_buffer != NULL || frame->dma_buffer != NULL)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void output_frame(struct wl_listener *listener, void *data) {
+  /* This function is called every time an output is ready to display a frame,
+   * generally at the output's refresh rate (e.g. 60Hz), as long as something
+   * on it was damaged. */
+  struct dgde_output *output = wl_container_of(listener, output, frame);
+  struct dgde_workspace *ws = output->workspaces[output->active_workspace];
+
+  // turned off while idle, damage may still schedule a frame
+  if (!output->wlr_output->enabled) {
+    return;
+  }
+
+  if (output->mirror_of != NULL) {
+    render_mirror(output);
+    return;
+  }
+
+  /* There is always something to render while uncapped, the damage also
+   * schedules the next frame. */
+  if (output->server->uncapped) {
+    wlr_output_damage_add_whole(output->damage);
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  dgde_trace_begin("output frame", output->frames);
+  DGDE_PROBE(frame_begin, output->wlr_output->name, output->frames);
+
+  /* wlr_output_damage_attach_render makes the OpenGL context current and
+   * tells us which parts of the buffer are out of date. */
+  bool needs_frame;
+  pixman_region32_t buffer_damage;
+  pixman_region32_init(&buffer_damage);
+  if (!wlr_output_damage_attach_render(output->damage, &needs_frame,
+                                       &buffer_damage)) {
+    pixman_region32_fini(&buffer_damage);
+    DGDE_PROBE(frame_end, output->wlr_output->name, output->frames, false);
+    dgde_trace_end("output frame");
+    return;
+  }
+
+  /* Screencopy copies the next commit, which wouldn't come while nothing
+   * changes. Requesting a copy schedules a frame, this is it. */
+  if (!needs_frame && copy_pending(output)) {
+    needs_frame = true;
+  }
+
+  if (needs_frame) {
+    render_output(output, ws, &buffer_damage, now);
+  } else {
+    /* Nothing changed, so a static desktop costs neither rendering nor a
+     * commit. */
+    wlr_output_rollback(output->wlr_output);
+  }
+  pixman_region32_fini(&buffer_damage);
+
+  /* Clients can commit without damage just to get a frame callback, so this
+   * is sent even if nothing was drawn. */
+  dgde_workspace_send_frame_done(ws, now);
+#ifdef DGDE_XWAYLAND
+  if (output->server->xwayland != NULL) {
+    dgde_xwayland_send_frame_done(output->server->xwayland, &now);
+  }
+#endif
+  DGDE_PROBE(frame_end, output->wlr_output->name, output->frames,
+             needs_frame);
+  dgde_trace_end("output frame");
+  check_frame_budget(output, &now);
 }
 
 static void output_mode(struct wl_listener *listener, void *data) {
@@ -226,6 +1183,77 @@ static void output_mode(struct wl_listener *listener, void *data) {
   }
 }
 
+static void output_destroy(struct wl_listener *listener, void *data) {
+  struct dgde_output *output = wl_container_of(listener, output, destroy);
+  struct dgde_server *server = output->server;
+
+  wlr_log(WLR_DEBUG, "output removed: %s", output->wlr_output->description);
+
+  if (server->grab_output == output) {
+    server->grab_output = NULL;
+  }
+
+  if (output->mirror_of != NULL) {
+    stop_mirror(output);
+  }
+  struct dgde_output *mirror;
+  wl_list_for_each(mirror, &server->outputs, link) {
+    if (mirror->mirror_of == output) {
+      unmirror(mirror);
+    }
+  }
+
+  wl_list_remove(&output->link);
+  wl_list_remove(&output->frame.link);
+  wl_list_remove(&output->mode.link);
+  wl_list_remove(&output->destroy.link);
+
+  // the views go to the active workspace of another output, or are parked
+  // until a new output shows up
+  struct dgde_workspace *target = server->parked;
+  struct dgde_output *o = first_output(server);
+  if (o != NULL) {
+    target = o->workspaces[o->active_workspace];
+  }
+
+  for (uint32_t i = 0, e = output->num_workspaces; i < e; ++i) {
+    dgde_workspace_move_views(output->workspaces[i], target);
+    dgde_workspace_destroy(output->workspaces[i]);
+  }
+
+  if (output->vnc != NULL) {
+    dgde_vnc_destroy(output->vnc);
+    wlr_input_device_destroy(output->vnc_pointer);
+    wlr_input_device_destroy(output->vnc_keyboard);
+  }
+
+  dgde_render_list_destroy(output->render_list);
+  free(output);
+}
+
+static void setup_vnc(struct dgde_server *server, struct dgde_output *output) {
+  /* The input of viewers comes from devices of the headless backend, so it
+   * is handled like that of any other pointer and keyboard. */
+  output->vnc_pointer = wlr_headless_add_input_device(server->backend,
+                                                      WLR_INPUT_DEVICE_POINTER);
+  output->vnc_keyboard = wlr_headless_add_input_device(
+      server->backend, WLR_INPUT_DEVICE_KEYBOARD);
+
+  /* Named like the IPC socket, after the Wayland socket and the output. */
+  char path[256];
+  snprintf(path, sizeof(path), "%s/dgde-vnc.%s.%s.sock",
+           getenv("XDG_RUNTIME_DIR"), server->socket,
+           output->wlr_output->name);
+  struct wl_event_loop *loop = wl_display_get_event_loop(server->wl_display);
+  output->vnc =
+      dgde_vnc_create(loop, output->damage, server->output_layout, path,
+                      output->vnc_pointer, output->vnc_keyboard);
+  if (output->vnc == NULL) {
+    wlr_input_device_destroy(output->vnc_pointer);
+    wlr_input_device_destroy(output->vnc_keyboard);
+  }
+}
+
 static void new_output(struct wl_listener *listener, void *data) {
   /* This event is rasied by the backend when a new output (aka a display or
    * monitor) becomes available. */
@@ -238,12 +1266,23 @@ static void new_output(struct wl_listener *listener, void *data) {
   struct dgde_output *output = calloc(1, sizeof(struct dgde_output));
   output->wlr_output = wlr_output;
   output->server = server;
+  output->render_list = dgde_render_list_create();
+
+  /* This is added before creating the damage helper so that we get to clean
+   * up before it is destroyed together with the output. */
+  output->destroy.notify = output_destroy;
+  wl_signal_add(&wlr_output->events.destroy, &output->destroy);
+
+  /* The output damage helper only lets frame events through when something
+   * on the output changed since the last frame. */
+  output->damage = wlr_output_damage_create(wlr_output);
 
   setup_workspaces(server, output, 4, "Workspace %d");
+  dgde_workspace_move_views(server->parked, output->workspaces[0]);
 
   /* Sets up a listener for the frame notify event. */
   output->frame.notify = output_frame;
-  wl_signal_add(&wlr_output->events.frame, &output->frame);
+  wl_signal_add(&output->damage->events.frame, &output->frame);
   output->mode.notify = output_mode;
   wl_signal_add(&wlr_output->events.mode, &output->mode);
 
@@ -261,6 +1300,14 @@ static void new_output(struct wl_listener *listener, void *data) {
     if (!wlr_output_commit(wlr_output)) {
       return;
     }
+  } else if (wlr_output_is_headless(wlr_output)) {
+    /* Virtual outputs get whatever was asked for on the command line. */
+    wlr_output_set_custom_mode(wlr_output, server->output_width,
+                               server->output_height, server->output_refresh);
+    wlr_output_enable(wlr_output, true);
+    if (!wlr_output_commit(wlr_output)) {
+      return;
+    }
   }
 
   /* Adds this to the output layout. The add_auto function arranges outputs
@@ -273,8 +1320,79 @@ static void new_output(struct wl_listener *listener, void *data) {
    * output (such as DPI, scale factor, manufacturer, etc).
    */
   wlr_output_layout_add_auto(server->output_layout, wlr_output);
+
+  if (server->vnc && wlr_output_is_headless(wlr_output)) {
+    setup_vnc(server, output);
+  }
+}
+
+static void place_view(struct dgde_server *server, struct dgde_view *view) {
+  struct dgde_output *o = first_output(server);
+  if (o == NULL) {
+    wlr_log(WLR_DEBUG, "no outputs, parking new view");
+    dgde_workspace_add_view(server->parked, view);
+  } else {
+    struct dgde_workspace *workspace = o->workspaces[o->active_workspace];
+    wlr_log(WLR_DEBUG, "inserting view into workspace %d on output %s (%p)",
+            o->active_workspace, o->wlr_output->description, o);
+
+    dgde_workspace_add_view(workspace, view);
+  }
+}
+
+static void watch_view(struct dgde_server *server, struct dgde_view *view) {
+  // only mapped views are interesting to ipc clients
+  struct dgde_view_handler handler = {
+      .userdata = server,
+      .map = (dgde_view_cb)view_mapped,
+      .unmap = (dgde_view_cb)view_unmapped,
+  };
+  dgde_view_add_handler(view, &handler);
+}
+
+static void add_view(struct dgde_server *server, struct dgde_view *view) {
+  place_view(server, view);
+  watch_view(server, view);
 }
 
+#ifdef DGDE_XWAYLAND
+static void xwayland_unmap(struct dgde_server *server,
+                           struct dgde_view *view) {
+  if (dgde_workspace_remove_view(server->parked, view)) {
+    return;
+  }
+
+  struct dgde_output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    for (uint32_t i = 0, e = output->num_workspaces; i < e; ++i) {
+      if (dgde_workspace_remove_view(output->workspaces[i], view)) {
+        return;
+      }
+    }
+  }
+}
+
+static void xwayland_damage(struct dgde_server *server,
+                            const struct wlr_box *box) {
+  /* Override-redirect windows aren't on a workspace, they can be on any
+   * output. */
+  struct dgde_output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    double ox = box->x, oy = box->y;
+    wlr_output_layout_output_coords(server->output_layout, output->wlr_output,
+                                    &ox, &oy);
+    float scale = output->wlr_output->scale;
+    struct wlr_box scaled = {
+        .x = ox * scale,
+        .y = oy * scale,
+        .width = box->width * scale,
+        .height = box->height * scale,
+    };
+    wlr_output_damage_add_box(output->damage, &scaled);
+  }
+}
+#endif
+
 static void new_xdg_surface(struct wl_listener *listener, void *data) {
   /* This event is raised when wlr_xdg_shell receives a new xdg surface from a
    * client, either a toplevel (application window) or popup. */
@@ -285,25 +1403,26 @@ static void new_xdg_surface(struct wl_listener *listener, void *data) {
     return;
   }
 
-  struct dgde_output *o = wl_container_of(server->outputs.next, o, link);
-
-  struct dgde_workspace *workspace = o->workspaces[o->active_workspace];
-  wlr_log(WLR_DEBUG, "inserting view into workspace %d on output %s (%p)",
-          o->active_workspace, o->wlr_output->description, o);
+  add_view(server, dgde_view_create(xdg_surface, server->seat));
+}
 
-  dgde_workspace_add_view(workspace, xdg_surface);
+static void key_forwarded(struct dgde_server *server,
+                          struct wlr_event_keyboard_key *event) {
+  notify_activity(server);
+  dgde_latency_input(server->latency,
+                     server->seat->keyboard_state.focused_surface,
+                     event->time_msec);
 }
 
-static void new_input(struct wl_listener *listener, void *data) {
-  /* This event is raised by the backend when a new input device becomes
-   * available. */
-  struct dgde_server *server = wl_container_of(listener, server, new_input);
-  struct wlr_input_device *device = data;
+static void add_input_device(struct dgde_server *server,
+                             struct wlr_input_device *device) {
   switch (device->type) {
   case WLR_INPUT_DEVICE_KEYBOARD: {
     struct dgde_keyboard *keyboard = dgde_keyboard_create(device, server->seat);
     dgde_keyboard_add_handler(keyboard, (keybind_handler)handle_keybinding,
                               server, WLR_MODIFIER_ALT);
+    dgde_keyboard_set_forward_handler(
+        keyboard, (dgde_keyboard_forward_cb)key_forwarded, server);
 
     dgde_keyboard_add_to_list(keyboard, &server->keyboards);
     break;
@@ -324,6 +1443,69 @@ static void new_input(struct wl_listener *listener, void *data) {
   wlr_seat_set_capabilities(server->seat, caps);
 }
 
+/* The decorations of a toplevel that asked which side should draw them. */
+struct decoration {
+  struct wlr_xdg_toplevel_decoration_v1 *wlr_decoration;
+  struct wl_listener request_mode;
+  struct wl_listener destroy;
+};
+
+static void decoration_request_mode(struct wl_listener *listener, void *data) {
+  /* Whatever the client prefers, we draw the titlebar and borders anyway so
+   * it should leave them, and its shadows, out of its buffers. */
+  struct decoration *decoration =
+      wl_container_of(listener, decoration, request_mode);
+  wlr_xdg_toplevel_decoration_v1_set_mode(
+      decoration->wlr_decoration,
+      WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE);
+}
+
+static void decoration_destroy(struct wl_listener *listener, void *data) {
+  struct decoration *decoration =
+      wl_container_of(listener, decoration, destroy);
+  wl_list_remove(&decoration->request_mode.link);
+  wl_list_remove(&decoration->destroy.link);
+  free(decoration);
+}
+
+static void new_xdg_decoration(struct wl_listener *listener, void *data) {
+  struct wlr_xdg_toplevel_decoration_v1 *wlr_decoration = data;
+  struct decoration *decoration = calloc(1, sizeof(struct decoration));
+  decoration->wlr_decoration = wlr_decoration;
+
+  decoration->request_mode.notify = decoration_request_mode;
+  wl_signal_add(&wlr_decoration->events.request_mode,
+                &decoration->request_mode);
+  decoration->destroy.notify = decoration_destroy;
+  wl_signal_add(&wlr_decoration->events.destroy, &decoration->destroy);
+
+  // clients don't have to ask for a mode, tell them right away
+  decoration_request_mode(&decoration->request_mode, NULL);
+}
+
+static void new_input(struct wl_listener *listener, void *data) {
+  /* This event is raised by the backend when a new input device becomes
+   * available. */
+  struct dgde_server *server = wl_container_of(listener, server, new_input);
+  add_input_device(server, data);
+}
+
+static void new_virtual_pointer(struct wl_listener *listener, void *data) {
+  /* Virtual devices are driven by clients, e.g. test tools injecting
+   * timestamped input, and otherwise work like real ones. */
+  struct dgde_server *server =
+      wl_container_of(listener, server, new_virtual_pointer);
+  struct wlr_virtual_pointer_v1_new_pointer_event *event = data;
+  add_input_device(server, &event->new_pointer->input_device);
+}
+
+static void new_virtual_keyboard(struct wl_listener *listener, void *data) {
+  struct dgde_server *server =
+      wl_container_of(listener, server, new_virtual_keyboard);
+  struct wlr_virtual_keyboard_v1 *keyboard = data;
+  add_input_device(server, &keyboard->input_device);
+}
+
 static void seat_request_set_selection(struct wl_listener *listener,
                                        void *data) {
   /* This event is raised by the seat when a client wants to set the selection,
@@ -333,10 +1515,155 @@ static void seat_request_set_selection(struct wl_listener *listener,
   struct dgde_server *server =
       wl_container_of(listener, server, request_set_selection);
   struct wlr_seat_request_set_selection_event *event = data;
-  wlr_seat_set_selection(server->seat, event->source, event->serial);
+  if (server->clipboard != NULL) {
+    dgde_clipboard_set_selection(server->clipboard, event->source,
+                                 event->serial);
+  } else {
+    wlr_seat_set_selection(server->seat, event->source, event->serial);
+  }
 }
 
-struct dgde_server *dgde_server_create(const char *seat_name) {
+static int evict_hidden(void *data) {
+  /* Workspaces that have not been looked at for a while are probably not
+   * going to be soon, so their views don't need full size buffers. */
+  struct dgde_server *server = data;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  struct dgde_output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    for (uint32_t i = 0, e = output->num_workspaces; i < e; ++i) {
+      if (i == output->active_workspace || output->evicted[i] ||
+          now.tv_sec - output->hidden_since[i].tv_sec < server->evict_after) {
+        continue;
+      }
+
+      dgde_workspace_evict(output->workspaces[i]);
+      output->evicted[i] = true;
+    }
+  }
+
+  wl_event_source_timer_update(server->evict_timer, 5000);
+  return 0;
+}
+
+static int add_output_signal(int signal_number, void *data) {
+  struct dgde_server *server = data;
+  wlr_log(WLR_INFO, "adding virtual output");
+  wlr_headless_add_output(server->backend, server->output_width,
+                          server->output_height);
+  return 0;
+}
+
+static int remove_output_signal(int signal_number, void *data) {
+  /* Removes the most recently added output, its views move to the remaining
+   * outputs. */
+  struct dgde_server *server = data;
+  if (wl_list_empty(&server->outputs)) {
+    return 0;
+  }
+
+  struct dgde_output *o = wl_container_of(server->outputs.next, o, link);
+  wlr_log(WLR_INFO, "removing virtual output %s", o->wlr_output->name);
+  wlr_output_destroy(o->wlr_output);
+  return 0;
+}
+
+static int report_fps(void *data) {
+  struct dgde_server *server = data;
+  struct dgde_output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    wlr_log(WLR_INFO, "%s: %d frames/s", output->wlr_output->name,
+            output->frames);
+    output->frames = 0;
+  }
+
+  const struct dgde_latency_stats *stats = dgde_latency_stats(server->latency);
+  if (stats->samples > 0) {
+    wlr_log(WLR_INFO,
+            "input latency: p50 %u ms, p90 %u ms, p99 %u ms, max %u ms over "
+            "%lu samples",
+            stats->p50, stats->p90, stats->p99, stats->max,
+            (unsigned long)stats->samples);
+  }
+
+  wl_event_source_timer_update(server->fps_timer, 1000);
+  return 0;
+}
+
+static void playback_done(struct dgde_server *server) {
+  wl_display_terminate(server->wl_display);
+}
+
+static bool setup_playback(struct dgde_server *server,
+                           const struct dgde_server_config *config) {
+  /* Like the input of VNC viewers, the trace comes from devices of the
+   * headless backend and takes the same path as real input. */
+  server->playback_pointer = wlr_headless_add_input_device(
+      server->backend, WLR_INPUT_DEVICE_POINTER);
+  server->playback_keyboard = wlr_headless_add_input_device(
+      server->backend, WLR_INPUT_DEVICE_KEYBOARD);
+
+  struct dgde_playback_handler handler = {
+      .userdata = server,
+      .done = (dgde_playback_done_cb)playback_done,
+  };
+  server->playback = dgde_playback_create(
+      server->wl_display, config->input_trace, config->input_trace_speed,
+      server->playback_pointer, server->playback_keyboard, &handler);
+  if (server->playback == NULL) {
+    wlr_input_device_destroy(server->playback_pointer);
+    wlr_input_device_destroy(server->playback_keyboard);
+    return false;
+  }
+  return true;
+}
+
+static bool setup_headless(struct dgde_server *server,
+                           const struct dgde_server_config *config) {
+  struct wl_event_loop *loop = wl_display_get_event_loop(server->wl_display);
+
+  server->output_width = config->output_width;
+  server->output_height = config->output_height;
+  server->output_refresh = config->output_refresh;
+  /* The headless backend paces frames with a timer at the refresh rate of
+   * the output, in whole milliseconds. Uncapped outputs run it as fast as it
+   * goes. */
+  server->uncapped = config->uncapped;
+  if (server->uncapped) {
+    server->output_refresh = 1000000;
+  }
+  server->vnc = config->vnc && getenv("XDG_RUNTIME_DIR") != NULL;
+  if (config->vnc && !server->vnc) {
+    wlr_log(WLR_ERROR, "XDG_RUNTIME_DIR is not set, vnc is disabled");
+  }
+
+  /* These are announced once the backend is started. */
+  for (uint32_t i = 0; i < config->headless_outputs; ++i) {
+    wlr_headless_add_output(server->backend, server->output_width,
+                            server->output_height);
+  }
+
+  /* Outputs can be added and removed at runtime with signals, e.g. from a
+   * load test script. */
+  server->add_output_signal =
+      wl_event_loop_add_signal(loop, SIGUSR1, add_output_signal, server);
+  server->remove_output_signal =
+      wl_event_loop_add_signal(loop, SIGUSR2, remove_output_signal, server);
+
+  server->fps_timer = wl_event_loop_add_timer(loop, report_fps, server);
+  wl_event_source_timer_update(server->fps_timer, 1000);
+
+  /* A benchmark without its input would run forever, rather than not at
+   * all. */
+  if (config->input_trace != NULL && !setup_playback(server, config)) {
+    return false;
+  }
+  return true;
+}
+
+struct dgde_server *
+dgde_server_create(const struct dgde_server_config *config) {
 
   struct dgde_server *server = calloc(1, sizeof(struct dgde_server));
   /* The Wayland display is managed by libwayland. It handles accepting
@@ -346,8 +1673,14 @@ struct dgde_server *dgde_server_create(const char *seat_name) {
   /* The backend is a wlroots feature which abstracts the underlying input and
    * output hardware. The autocreate option will choose the most suitable
    * backend based on the current environment, such as opening an X11 window
-   * if an X11 server is running. */
-  server->backend = wlr_backend_autocreate(server->wl_display);
+   * if an X11 server is running. The headless backend has no input and only
+   * virtual outputs, which makes for deterministic sessions in load tests. */
+  server->headless = config->headless_outputs > 0;
+  if (server->headless) {
+    server->backend = wlr_headless_backend_create(server->wl_display);
+  } else {
+    server->backend = wlr_backend_autocreate(server->wl_display);
+  }
 
   /* If we don't provide a renderer, autocreate makes a GLES2 renderer for us.
    * The renderer is responsible for defining the various pixel formats it
@@ -355,15 +1688,58 @@ struct dgde_server *dgde_server_create(const char *seat_name) {
   server->renderer = wlr_backend_get_renderer(server->backend);
   wlr_renderer_init_wl_display(server->renderer, server->wl_display);
 
+  /* Tiled composition works directly on pixman images, so it is only
+   * available when the backend picked the pixman renderer (WLR_RENDERER=pixman
+   * or no GPU available). */
+  if (config->composite_threads > 0) {
+    if (wlr_renderer_is_pixman(server->renderer)) {
+      server->composite_pool =
+          dgde_composite_pool_create(config->composite_threads);
+    } else {
+      wlr_log(WLR_INFO, "not using tiled composition, renderer is not pixman");
+    }
+  }
+
+  // every glyph of the titlebar font is rasterized into it once
+  server->glyph_atlas = dgde_glyph_atlas_create();
+
   /* This creates some hands-off wlroots interfaces. The compositor is
    * necessary for clients to allocate surfaces and the data device manager
    * handles the clipboard. Each of these wlroots interfaces has room for you
    * to dig your fingers in and play with their behavior if you want. Note that
    * the clients cannot set the selection directly without compositor approval,
    * see the handling of the request_set_selection event below.*/
-  wlr_compositor_create(server->wl_display, server->renderer);
+  struct wlr_compositor *compositor =
+      wlr_compositor_create(server->wl_display, server->renderer);
   wlr_data_device_manager_create(server->wl_display);
 
+  /* Lets clients attach buffers of a different size than their surface and
+   * crop them, e.g. a small video frame or a single pixel that is scaled up
+   * when drawing. */
+  wlr_viewporter_create(server->wl_display);
+
+  /* Tracks buffers, textures and commit rates of every client so that we can
+   * tell who is responsible for what, see get_clients over IPC. */
+  struct dgde_accounting_config accounting_config = {
+      .memory_budget = config->client_memory_budget,
+      .commit_budget = config->client_commit_budget,
+      .dispatch_budget = config->client_dispatch_budget,
+      .throttle = config->throttle_clients,
+  };
+  server->accounting = dgde_accounting_create(server->wl_display, compositor,
+                                              &accounting_config);
+
+  /* Clients that connect from now on are recorded for clients/replay. */
+  if (config->record_path != NULL) {
+    server->record = dgde_record_create(
+        server->wl_display, config->record_path, config->record_contents);
+  }
+
+  /* Lets clients capture output contents. Copies go straight from the
+   * rendered buffer into the client's shm buffer, and copy_with_damage is
+   * driven by the damage set on each output commit. */
+  server->screencopy = wlr_screencopy_manager_v1_create(server->wl_display);
+
   /* Creates an output layout, which a wlroots utility for working with an
    * arrangement of screens in a physical layout. */
   server->output_layout = wlr_output_layout_create();
@@ -383,19 +1759,72 @@ struct dgde_server *dgde_server_create(const char *seat_name) {
   wl_list_init(&server->keyboards);
   server->new_input.notify = new_input;
   wl_signal_add(&server->backend->events.new_input, &server->new_input);
-  server->seat = wlr_seat_create(server->wl_display, seat_name);
+  server->seat = wlr_seat_create(server->wl_display, config->seat_name);
   server->request_set_selection.notify = seat_request_set_selection;
   wl_signal_add(&server->seat->events.request_set_selection,
                 &server->request_set_selection);
+  if (config->clipboard_size > 0) {
+    struct dgde_clipboard_config clipboard_config = {
+        .max_size = config->clipboard_size,
+        .mime_types = config->clipboard_mime_types,
+    };
+    server->clipboard = dgde_clipboard_create(
+        wl_display_get_event_loop(server->wl_display), server->seat,
+        &clipboard_config);
+  }
+  server->focus_change.notify = seat_focus_change;
+  wl_signal_add(&server->seat->keyboard_state.events.focus_change,
+                &server->focus_change);
+
+  server->latency = dgde_latency_create();
+  if (config->virtual_input) {
+    server->virtual_pointer =
+        wlr_virtual_pointer_manager_v1_create(server->wl_display);
+    server->new_virtual_pointer.notify = new_virtual_pointer;
+    wl_signal_add(&server->virtual_pointer->events.new_virtual_pointer,
+                  &server->new_virtual_pointer);
+    server->virtual_keyboard =
+        wlr_virtual_keyboard_manager_v1_create(server->wl_display);
+    server->new_virtual_keyboard.notify = new_virtual_keyboard;
+    wl_signal_add(&server->virtual_keyboard->events.new_virtual_keyboard,
+                  &server->new_virtual_keyboard);
+  }
 
   server->xdg_shell = wlr_xdg_shell_create(server->wl_display);
   server->new_xdg_surface.notify = new_xdg_surface;
   wl_signal_add(&server->xdg_shell->events.new_surface,
                 &server->new_xdg_surface);
 
+  /* Windows get their titlebar and borders from decorations.c, clients are
+   * told so with xdg-decoration, or the older KDE protocol some toolkits
+   * still use, instead of drawing and shadowing their own as well. */
+  server->xdg_decoration =
+      wlr_xdg_decoration_manager_v1_create(server->wl_display);
+  server->new_xdg_decoration.notify = new_xdg_decoration;
+  wl_signal_add(&server->xdg_decoration->events.new_toplevel_decoration,
+                &server->new_xdg_decoration);
+  wlr_server_decoration_manager_set_default_mode(
+      wlr_server_decoration_manager_create(server->wl_display),
+      WLR_SERVER_DECORATION_MANAGER_MODE_SERVER);
+
+#ifdef DGDE_XWAYLAND
+  /* Only the X11 sockets exist until an X11 client shows up, sessions
+   * without any don't get an X server at all. */
+  struct dgde_xwayland_handler xwayland_handler = {
+      .userdata = server,
+      .new_view = (dgde_xwayland_view_cb)watch_view,
+      .map = (dgde_xwayland_view_cb)place_view,
+      .unmap = (dgde_xwayland_view_cb)xwayland_unmap,
+      .damage = (dgde_xwayland_damage_cb)xwayland_damage,
+  };
+  server->xwayland = dgde_xwayland_create(server->wl_display, compositor,
+                                          server->seat, &xwayland_handler);
+#endif
+
   // create a cursor
   struct dgde_cursor *cursor =
-      dgde_cursor_create(server->output_layout, server->seat);
+      dgde_cursor_create(wl_display_get_event_loop(server->wl_display),
+                         server->output_layout, server->seat);
   struct dgde_cursor_handler cursor_handler = {
       .button = (dgde_cursor_button_cb)process_cursor_button,
       .motion = (dgde_cursor_motion_cb)process_cursor_motion,
@@ -407,13 +1836,75 @@ struct dgde_server *dgde_server_create(const char *seat_name) {
   dgde_cursor_add_handler(cursor, &cursor_handler);
 
   server->cursor = cursor;
+
+  /* Not shown anywhere, the size only matters for the configure events views
+   * get while they are parked. */
+  server->parked = dgde_workspace_create("Parked", server->seat, 1920, 1080);
+
+  server->evict_after = config->evict_hidden_after;
+  server->frame_budget = (uint64_t)config->frame_budget * 1000000;
+  if (server->evict_after > 0) {
+    server->evict_timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(server->wl_display), evict_hidden, server);
+    wl_event_source_timer_update(server->evict_timer, 5000);
+  }
+
+  server->idle = wlr_idle_create(server->wl_display);
+  server->idle_inhibit = wlr_idle_inhibit_v1_create(server->wl_display);
+  server->new_idle_inhibitor.notify = new_idle_inhibitor;
+  wl_signal_add(&server->idle_inhibit->events.new_inhibitor,
+                &server->new_idle_inhibitor);
+  server->idle_timeout = config->idle_timeout * 1000;
+  if (server->idle_timeout > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &server->last_activity);
+    server->idle_timer = wl_event_loop_add_timer(
+        wl_display_get_event_loop(server->wl_display), idle_timeout, server);
+    wl_event_source_timer_update(server->idle_timer, server->idle_timeout);
+  }
+
+  if (server->headless && !setup_headless(server, config)) {
+    dgde_server_destroy(server);
+    return NULL;
+  }
+
   return server;
 }
 
 const char *dgde_server_attach_socket(struct dgde_server *server) {
 
   /* Add a Unix socket to the Wayland display. */
-  return wl_display_add_socket_auto(server->wl_display);
+  const char *socket = wl_display_add_socket_auto(server->wl_display);
+  if (socket == NULL) {
+    return NULL;
+  }
+  server->socket = socket;
+
+  /* The IPC socket sits next to the Wayland one and is named after it, so
+   * that several compositors can run side by side. */
+  const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+  if (runtime_dir == NULL) {
+    wlr_log(WLR_INFO, "XDG_RUNTIME_DIR is not set, ipc is disabled");
+    return socket;
+  }
+
+  char path[256];
+  snprintf(path, sizeof(path), "%s/dgde-ipc.%s.sock", runtime_dir, socket);
+  struct dgde_ipc_handler handler = {
+      .userdata = server,
+      .tree = (dgde_ipc_query_cb)ipc_tree,
+      .clients = (dgde_ipc_query_cb)ipc_clients,
+      .trace = (dgde_ipc_query_cb)ipc_trace,
+      .latency = (dgde_ipc_query_cb)ipc_latency,
+      .mirror = (dgde_ipc_mirror_cb)ipc_mirror,
+  };
+  server->ipc = dgde_ipc_create(
+      wl_display_get_event_loop(server->wl_display), path, &handler);
+
+  return socket;
+}
+
+const char *dgde_server_ipc_socket(struct dgde_server *server) {
+  return server->ipc != NULL ? dgde_ipc_socket_path(server->ipc) : NULL;
 }
 
 void dgde_server_run(struct dgde_server *server) {
@@ -427,12 +1918,43 @@ void dgde_server_run(struct dgde_server *server) {
     return;
   }
 
+  /* Run the Wayland event loop. This does not return until you exit the
+   * compositor, or a nested backend loses its parent display. */
   wl_display_run(server->wl_display);
 }
 
 void dgde_server_destroy(struct dgde_server *server) {
+  // before the clients, a selection being copied must not be installed now
+  if (server->clipboard != NULL) {
+    dgde_clipboard_destroy(server->clipboard);
+  }
   wl_display_destroy_clients(server->wl_display);
+#ifdef DGDE_XWAYLAND
+  if (server->xwayland != NULL) {
+    dgde_xwayland_destroy(server->xwayland);
+  }
+#endif
+
+  if (server->ipc != NULL) {
+    dgde_ipc_destroy(server->ipc);
+  }
+  dgde_accounting_destroy(server->accounting);
+  if (server->record != NULL) {
+    dgde_record_destroy(server->record);
+  }
+  if (server->playback != NULL) {
+    dgde_playback_destroy(server->playback);
+    wlr_input_device_destroy(server->playback_pointer);
+    wlr_input_device_destroy(server->playback_keyboard);
+  }
+  dgde_latency_destroy(server->latency);
+  dgde_glyph_atlas_destroy(server->glyph_atlas);
+
   wl_display_destroy(server->wl_display);
 
+  if (server->composite_pool != NULL) {
+    dgde_composite_pool_destroy(server->composite_pool);
+  }
+
   free(server);
 }
@@ -2,16 +2,87 @@
 #define SERVER_H
 
 #include "cursor.h"
+#include "record.h"
 #include "wayland-util.h"
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_pointer.h>
 #include <xkbcommon/xkbcommon.h>
 
 struct dgde_server;
 
-struct dgde_server *dgde_server_create(const char *seat_name);
+struct dgde_server_config {
+  const char *seat_name;
+
+  // number of threads used to composite outputs in tiles when running on the
+  // pixman renderer, 0 renders everything on the main thread
+  uint32_t composite_threads;
+
+  // run on the headless backend with this many virtual outputs instead of
+  // autodetecting the backend, 0 autodetects
+  uint32_t headless_outputs;
+  int32_t output_width;
+  int32_t output_height;
+  // in mHz
+  int32_t output_refresh;
+  // render virtual outputs as fast as possible instead of at their refresh
+  // rate
+  bool uncapped;
+
+  // per client budgets, 0 is unlimited
+  uint64_t client_memory_budget;
+  uint32_t client_commit_budget;
+  // milliseconds per second a client's requests may take before the client is
+  // throttled regardless of throttle_clients, 0 is unlimited
+  uint32_t client_dispatch_budget;
+  // hold back frame callbacks of clients over budget instead of just logging
+  bool throttle_clients;
+
+  // seconds after which views on hidden workspaces are asked to shrink their
+  // buffers, 0 never
+  uint32_t evict_hidden_after;
+
+  // frames taking longer than this many milliseconds to render and commit
+  // dump the flight recorder, 0 never
+  uint32_t frame_budget;
+
+  // seconds without input after which outputs are turned off, 0 never
+  uint32_t idle_timeout;
+
+  // serve virtual outputs over VNC on Unix sockets in XDG_RUNTIME_DIR
+  bool vnc;
+
+  // let clients inject input through the virtual pointer and keyboard
+  // protocols, e.g. to measure latency. Any client can then type into any
+  // other, so this is off unless asked for.
+  bool virtual_input;
+
+  // bytes of the selection kept in the compositor, so that it can be pasted
+  // after its client is gone, 0 leaves it with the client
+  uint64_t clipboard_size;
+  // comma separated, a trailing * matches any suffix
+  const char *clipboard_mime_types;
+
+  // record all requests of all clients into this file, see record.h
+  const char *record_path;
+  enum dgde_record_contents record_contents;
+
+  // play this input trace back once the first view is mapped and stop when
+  // it is done, only when running headless, see playback.h
+  const char *input_trace;
+  // 1 plays it as recorded, 0 as fast as possible
+  double input_trace_speed;
+};
+
+/* Returns NULL if the input trace to play back can't be read. */
+struct dgde_server *
+dgde_server_create(const struct dgde_server_config *config);
 const char *dgde_server_attach_socket(struct dgde_server *server);
+/* Path of the IPC socket, NULL if IPC is not available. Only valid after
+ * dgde_server_attach_socket. */
+const char *dgde_server_ipc_socket(struct dgde_server *server);
 void dgde_server_run(struct dgde_server *server);
 void dgde_server_destroy(struct dgde_server *server);
 
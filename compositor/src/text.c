@@ -0,0 +1,185 @@
+#include "text.h"
+#include "composite.h"
+#include "font.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+#include <pixman.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_matrix.h>
+
+// all glyphs side by side in a single row
+#define ATLAS_WIDTH (FONT_NUM_GLYPHS * FONT_WIDTH)
+#define ATLAS_HEIGHT FONT_HEIGHT
+#define ATLAS_STRIDE (ATLAS_WIDTH * 4)
+
+#define SPACE_GLYPH (' ' - FONT_FIRST_CHAR)
+#define UNKNOWN_GLYPH ('?' - FONT_FIRST_CHAR)
+
+struct dgde_glyph_atlas {
+  // premultiplied ARGB8888, every glyph in the color below
+  uint32_t pixels[ATLAS_WIDTH * ATLAS_HEIGHT];
+  pixman_image_t *image;
+  float color[4];
+  bool rasterized;
+
+  // uploaded when first drawn with a renderer
+  struct wlr_renderer *renderer;
+  struct wlr_texture *texture;
+};
+
+void dgde_text_layout(struct dgde_text *text, const char *utf8) {
+  text->num_glyphs = 0;
+  if (utf8 == NULL) {
+    return;
+  }
+
+  const unsigned char *c = (const unsigned char *)utf8;
+  while (*c != '\0' && text->num_glyphs < DGDE_TEXT_MAX_GLYPHS) {
+    uint8_t glyph;
+    if (*c >= FONT_FIRST_CHAR && *c < FONT_FIRST_CHAR + FONT_NUM_GLYPHS) {
+      glyph = *c - FONT_FIRST_CHAR;
+    } else if (*c < 0x80) {
+      // tabs and other control characters
+      glyph = SPACE_GLYPH;
+    } else {
+      // one glyph per code point, not per byte
+      glyph = UNKNOWN_GLYPH;
+      while ((c[1] & 0xc0) == 0x80) {
+        ++c;
+      }
+    }
+
+    text->glyphs[text->num_glyphs++] = glyph;
+    ++c;
+  }
+}
+
+int dgde_text_width(const struct dgde_text *text) {
+  return text->num_glyphs * FONT_WIDTH;
+}
+
+int dgde_text_height(void) { return FONT_HEIGHT; }
+
+struct dgde_glyph_atlas *dgde_glyph_atlas_create(void) {
+  struct dgde_glyph_atlas *atlas = calloc(1, sizeof(struct dgde_glyph_atlas));
+  atlas->image = pixman_image_create_bits(PIXMAN_a8r8g8b8, ATLAS_WIDTH,
+                                          ATLAS_HEIGHT, atlas->pixels,
+                                          ATLAS_STRIDE);
+  return atlas;
+}
+
+static void rasterize(struct dgde_glyph_atlas *atlas, const float color[4]) {
+  if (atlas->rasterized &&
+      memcmp(atlas->color, color, sizeof(atlas->color)) == 0) {
+    return;
+  }
+
+  uint32_t pixel = (uint32_t)(color[3] * 255) << 24 |
+                   (uint32_t)(color[0] * 255) << 16 |
+                   (uint32_t)(color[1] * 255) << 8 | (uint32_t)(color[2] * 255);
+  for (uint32_t g = 0; g < FONT_NUM_GLYPHS; ++g) {
+    for (uint32_t y = 0; y < FONT_HEIGHT; ++y) {
+      uint32_t *row = &atlas->pixels[y * ATLAS_WIDTH + g * FONT_WIDTH];
+      for (uint32_t x = 0; x < FONT_WIDTH; ++x) {
+        row[x] = FONT_GLYPHS[g][y] & (0x80 >> x) ? pixel : 0;
+      }
+    }
+  }
+
+  memcpy(atlas->color, color, sizeof(atlas->color));
+  atlas->rasterized = true;
+
+  // uploaded again with the new pixels when it is needed
+  if (atlas->texture != NULL) {
+    wlr_texture_destroy(atlas->texture);
+    atlas->texture = NULL;
+  }
+}
+
+static bool glyph_box(const struct dgde_text *text, uint32_t index,
+                      const struct wlr_box *box, struct wlr_box *glyph,
+                      struct wlr_fbox *src) {
+  *glyph = (struct wlr_box){
+      .x = box->x + index * FONT_WIDTH,
+      .y = box->y + (box->height - FONT_HEIGHT) / 2,
+      .width = FONT_WIDTH,
+      .height = FONT_HEIGHT,
+  };
+  *src = (struct wlr_fbox){
+      .x = text->glyphs[index] * FONT_WIDTH,
+      .y = 0,
+      .width = FONT_WIDTH,
+      .height = FONT_HEIGHT,
+  };
+
+  return glyph->x + glyph->width <= box->x + box->width;
+}
+
+void dgde_glyph_atlas_render(struct dgde_glyph_atlas *atlas,
+                             struct wlr_renderer *renderer,
+                             const float projection[9],
+                             const struct dgde_text *text,
+                             const struct wlr_box *box, const float color[4]) {
+  rasterize(atlas, color);
+  if (atlas->texture == NULL || atlas->renderer != renderer) {
+    if (atlas->texture != NULL) {
+      wlr_texture_destroy(atlas->texture);
+    }
+    atlas->texture =
+        wlr_texture_from_pixels(renderer, DRM_FORMAT_ARGB8888, ATLAS_STRIDE,
+                                ATLAS_WIDTH, ATLAS_HEIGHT, atlas->pixels);
+    atlas->renderer = renderer;
+    if (atlas->texture == NULL) {
+      return;
+    }
+  }
+
+  struct wlr_box glyph;
+  struct wlr_fbox src;
+  for (uint32_t i = 0; i < text->num_glyphs; ++i) {
+    if (!glyph_box(text, i, box, &glyph, &src)) {
+      break;
+    }
+    if (text->glyphs[i] == SPACE_GLYPH) {
+      continue;
+    }
+
+    float matrix[9];
+    wlr_matrix_project_box(matrix, &glyph, WL_OUTPUT_TRANSFORM_NORMAL, 0,
+                           projection);
+    wlr_render_subtexture_with_matrix(renderer, atlas->texture, &src, matrix,
+                                      1.f);
+  }
+}
+
+void dgde_glyph_atlas_collect(struct dgde_glyph_atlas *atlas,
+                              struct dgde_render_list *list,
+                              const struct dgde_text *text,
+                              const struct wlr_box *box, const float color[4]) {
+  rasterize(atlas, color);
+
+  /* The compositing threads only read the pixels, they are never written
+   * while the list is being composited. */
+  struct wlr_box glyph;
+  struct wlr_fbox src;
+  for (uint32_t i = 0; i < text->num_glyphs; ++i) {
+    if (!glyph_box(text, i, box, &glyph, &src)) {
+      break;
+    }
+    if (text->glyphs[i] != SPACE_GLYPH) {
+      dgde_render_list_add_image(list, &glyph, atlas->image, &src);
+    }
+  }
+}
+
+void dgde_glyph_atlas_destroy(struct dgde_glyph_atlas *atlas) {
+  if (atlas->texture != NULL) {
+    wlr_texture_destroy(atlas->texture);
+  }
+  pixman_image_unref(atlas->image);
+  free(atlas);
+}
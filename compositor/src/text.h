@@ -0,0 +1,51 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stdint.h>
+
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_box.h>
+
+/* Titlebar text. A title is laid out into glyphs from the built-in font when
+ * it changes, and drawing it is one textured quad per glyph out of an atlas
+ * that has every glyph rasterized in it. Nothing is rasterized per frame, no
+ * matter how often a client changes its title. */
+
+// longer titles are cut off, they wouldn't fit a titlebar anyway
+#define DGDE_TEXT_MAX_GLYPHS 160
+
+struct dgde_text {
+  uint32_t num_glyphs;
+  // indices into the font
+  uint8_t glyphs[DGDE_TEXT_MAX_GLYPHS];
+};
+
+/* Lays out UTF-8 text, anything outside of printable ASCII is shown as '?'. */
+void dgde_text_layout(struct dgde_text *text, const char *utf8);
+
+/* The size of a line of text in pixels. */
+int dgde_text_width(const struct dgde_text *text);
+int dgde_text_height(void);
+
+struct dgde_glyph_atlas;
+struct dgde_render_list;
+
+struct dgde_glyph_atlas *dgde_glyph_atlas_create(void);
+
+/* Draws text at the left edge of box and vertically centered in it, glyphs
+ * that don't fit the box are left out. The atlas is rasterized again if the
+ * color changes, which it rarely does. */
+void dgde_glyph_atlas_render(struct dgde_glyph_atlas *atlas,
+                             struct wlr_renderer *renderer,
+                             const float projection[9],
+                             const struct dgde_text *text,
+                             const struct wlr_box *box, const float color[4]);
+void dgde_glyph_atlas_collect(struct dgde_glyph_atlas *atlas,
+                              struct dgde_render_list *list,
+                              const struct dgde_text *text,
+                              const struct wlr_box *box, const float color[4]);
+
+/* Has to be called before the renderer the atlas was drawn with is. */
+void dgde_glyph_atlas_destroy(struct dgde_glyph_atlas *atlas);
+
+#endif
@@ -0,0 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <wlr/util/log.h>
+
+// a few seconds of a busy desktop, 24 bytes each
+#define TRACE_EVENTS 16384
+
+struct trace_event {
+  uint64_t time_ns;
+  const char *name;
+  uint32_t arg;
+  // Chrome trace phase: 'B'egin, 'E'nd or 'i'nstant
+  char phase;
+};
+
+static struct trace_event events[TRACE_EVENTS];
+// total number of events recorded, the ring holds the last TRACE_EVENTS
+static uint64_t num_events;
+
+static void record(char phase, const char *name, uint32_t arg) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  struct trace_event *event = &events[num_events++ % TRACE_EVENTS];
+  event->time_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+  event->name = name;
+  event->arg = arg;
+  event->phase = phase;
+}
+
+void dgde_trace_begin(const char *name, uint32_t arg) {
+  record('B', name, arg);
+}
+
+void dgde_trace_end(const char *name) { record('E', name, 0); }
+
+void dgde_trace_instant(const char *name, uint32_t arg) {
+  record('i', name, arg);
+}
+
+/* Writes the events of a ring that has seen count events in total. */
+static bool write_trace(const char *path, const struct trace_event *ring,
+                        uint64_t count) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    wlr_log_errno(WLR_ERROR, "failed to open %s for the trace", path);
+    return false;
+  }
+
+  uint64_t first = count > TRACE_EVENTS ? count - TRACE_EVENTS : 0;
+  int pid = getpid();
+
+  /* The oldest events may end spans whose beginning has already been
+   * overwritten, those are left out so that the viewer doesn't get confused
+   * about the nesting. */
+  uint32_t depth = 0;
+  bool empty = true;
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  for (uint64_t i = first; i < count; ++i) {
+    const struct trace_event *event = &ring[i % TRACE_EVENTS];
+    if (event->phase == 'E') {
+      if (depth == 0) {
+        continue;
+      }
+      --depth;
+    } else if (event->phase == 'B') {
+      ++depth;
+    }
+
+    fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lu.%03lu,"
+               "\"pid\":%d,\"tid\":%d",
+            empty ? "" : ",", event->name, event->phase,
+            (unsigned long)(event->time_ns / 1000),
+            (unsigned long)(event->time_ns % 1000), pid, pid);
+    if (event->phase == 'i') {
+      fprintf(f, ",\"s\":\"t\"");
+    }
+    if (event->phase != 'E') {
+      fprintf(f, ",\"args\":{\"arg\":%u}", event->arg);
+    }
+    fprintf(f, "}");
+    empty = false;
+  }
+  fprintf(f, "\n]}\n");
+
+  bool ok = !ferror(f);
+  if (fclose(f) != 0) {
+    ok = false;
+  }
+
+  if (!ok) {
+    wlr_log(WLR_ERROR, "failed to write the trace to %s", path);
+  }
+  return ok;
+}
+
+bool dgde_trace_dump(const char *path) {
+  return write_trace(path, events, num_events);
+}
+
+struct dump {
+  char *path;
+  uint64_t count;
+  struct trace_event ring[TRACE_EVENTS];
+};
+
+static void *dump_main(void *data) {
+  struct dump *dump = data;
+  if (write_trace(dump->path, dump->ring, dump->count)) {
+    wlr_log(WLR_INFO, "trace written to %s", dump->path);
+  }
+  free(dump->path);
+  free(dump);
+  return NULL;
+}
+
+bool dgde_trace_dump_async(const char *path) {
+  // a copy of the ring is a few hundred KiB, writing it out takes far longer
+  struct dump *dump = malloc(sizeof(struct dump));
+  if (dump == NULL) {
+    return false;
+  }
+  dump->path = strdup(path);
+  dump->count = num_events;
+  memcpy(dump->ring, events, sizeof(events));
+
+  /* Signals the event loop handles through a signalfd must not end up on
+   * this thread. */
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  pthread_t thread;
+  int err = pthread_create(&thread, NULL, dump_main, dump);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (err != 0) {
+    wlr_log(WLR_ERROR, "failed to start writing the trace to %s", path);
+    free(dump->path);
+    free(dump);
+    return false;
+  }
+
+  pthread_detach(thread);
+  return true;
+}
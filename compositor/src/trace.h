@@ -0,0 +1,27 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Flight recorder: a fixed size ring of timestamped events that is always
+ * recording and can be written out as a Chrome trace (chrome://tracing or
+ * ui.perfetto.dev) after something went wrong, e.g. a frame took too long.
+ *
+ * Recording an event is a clock read and a few stores, so it is cheap enough
+ * to leave on. Events may only be recorded on the main thread and names have
+ * to be string literals since only the pointer is kept. */
+
+void dgde_trace_begin(const char *name, uint32_t arg);
+void dgde_trace_end(const char *name);
+void dgde_trace_instant(const char *name, uint32_t arg);
+
+/* Writes everything currently in the ring to a file, oldest event first. */
+bool dgde_trace_dump(const char *path);
+
+/* Like dgde_trace_dump, but only copies the ring and leaves the writing to a
+ * thread of its own, which logs when it is done. Returns false if the
+ * thread can't be started. */
+bool dgde_trace_dump_async(const char *path);
+
+#endif
@@ -1,52 +1,545 @@
 #include "view.h"
+#include "composite.h"
+#include "probes.h"
+#include "text.h"
 #include "src/cursor.h"
+#include "trace.h"
 #include "wayland-util.h"
 
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <wlr/render/pixman.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/edges.h>
+#ifdef DGDE_XWAYLAND
+#include <wlr/xwayland.h>
+#endif
 
 #define MAX_HANDLERS 16
 
+// hidden views are asked to shrink their buffers to this fraction of their
+// size when evicted
+#define SNAPSHOT_SCALE 4
+#define SNAPSHOT_MIN_SIZE 32
+
+// the colour of a buffer that has the same pixel everywhere
+struct solid_color {
+  bool solid;
+  // premultiplied, like the buffer
+  float color[4];
+};
+
 struct dgde_view {
+  uint32_t id;
   struct wlr_xdg_surface *xdg_surface;
   struct wlr_seat *seat;
 
   struct wl_listener map;
   struct wl_listener unmap;
   struct wl_listener destroy;
+  struct wl_listener commit;
+  struct wl_listener new_popup;
+  struct wl_listener new_subsurface;
   struct wl_listener request_move;
   struct wl_listener request_resize;
+  struct wl_listener set_title;
+
+#ifdef DGDE_XWAYLAND
+  // set instead of the xdg surface for X11 windows
+  struct wlr_xwayland_surface *xwayland_surface;
+  struct wl_listener request_configure;
+#endif
 
   bool mapped;
   bool floating;
   int x, y;
+  int width, height;
+
+  // the window geometry at the last commit, the surface is drawn offset by it
+  struct wlr_box geometry;
+
+  // the size the layout wants the view to have
+  struct dgde_view_size size;
+
+  // the output the view is shown on, NULL while hidden
+  struct wlr_output *output;
+
+  // the last configure sent, new sizes wait until the client has acked it
+  // so that clients get at most one configure per commit
+  uint32_t configure_serial;
+  bool size_pending;
+  // X11 has no configure serials, instead the size last configured and the
+  // size the window had at the time
+  struct dgde_view_size configured;
+  struct dgde_view_size configured_from;
+
+  // configured down to a small snapshot while hidden
+  bool evicted;
+  // interactively resized, the last buffer is scaled to the new size
+  bool resizing;
+  // the last buffer is scaled to the size until the client has caught up
+  // after being evicted or resized
+  bool stretched;
+
+  // popups and subsurfaces, only tracked for damage
+  struct wl_list children;
+
+  // of the toplevel surface
+  struct solid_color solid;
+
+  // laid out once per title change, not per frame
+  struct dgde_text title;
 
   dgde_view_interaction_handler handler_functions[MAX_HANDLERS];
   void *handler_userdatas[MAX_HANDLERS];
   uint32_t num_handlers;
+
+  struct dgde_view_handler handlers[MAX_HANDLERS];
+  uint32_t num_event_handlers;
+};
+
+struct view_child {
+  struct dgde_view *view;
+  struct wlr_surface *surface;
+  struct wl_list link;
+
+  struct solid_color solid;
+
+  struct wl_listener commit;
+  struct wl_listener unmap;
+  struct wl_listener destroy;
+  struct wl_listener new_popup;
+  struct wl_listener new_subsurface;
 };
 
+static void emit_damage(struct dgde_view *view, pixman_region32_t *damage) {
+  for (uint32_t h = 0, e = view->num_event_handlers; h < e; ++h) {
+    struct dgde_view_handler *handler = &view->handlers[h];
+    if (handler->damage != NULL) {
+      handler->damage(handler->userdata, view, damage);
+    }
+  }
+}
+
+static struct wlr_surface *view_surface(const struct dgde_view *view) {
+#ifdef DGDE_XWAYLAND
+  // NULL until the X11 window is mapped
+  if (view->xwayland_surface != NULL) {
+    return view->xwayland_surface->surface;
+  }
+#endif
+  return view->xdg_surface->surface;
+}
+
+static void for_each_surface(const struct dgde_view *view,
+                             wlr_surface_iterator_func_t iterator,
+                             void *data) {
+#ifdef DGDE_XWAYLAND
+  /* X11 windows have no popups, their menus are override-redirect windows of
+   * their own. */
+  if (view->xwayland_surface != NULL) {
+    if (view->xwayland_surface->surface != NULL) {
+      wlr_surface_for_each_surface(view->xwayland_surface->surface, iterator,
+                                   data);
+    }
+    return;
+  }
+#endif
+  wlr_xdg_surface_for_each_surface(view->xdg_surface, iterator, data);
+}
+
+static void set_activated(const struct dgde_view *view, bool activated) {
+#ifdef DGDE_XWAYLAND
+  if (view->xwayland_surface != NULL) {
+    wlr_xwayland_surface_activate(view->xwayland_surface, activated);
+    return;
+  }
+#endif
+  wlr_xdg_toplevel_set_activated(view->xdg_surface, activated);
+}
+
+static void damage_surface_box(struct wlr_surface *surface, int sx, int sy,
+                               void *data) {
+  pixman_region32_t *damage = data;
+  pixman_region32_union_rect(damage, damage, sx, sy, surface->current.width,
+                             surface->current.height);
+}
+
+static void damage_surface(struct wlr_surface *surface, int sx, int sy,
+                           void *data) {
+  pixman_region32_t *damage = data;
+  pixman_region32_t surface_damage;
+  pixman_region32_init(&surface_damage);
+  wlr_surface_get_effective_damage(surface, &surface_damage);
+  pixman_region32_translate(&surface_damage, sx, sy);
+  pixman_region32_union(damage, damage, &surface_damage);
+  pixman_region32_fini(&surface_damage);
+}
+
+static void surface_origin(const struct dgde_view *view, int *x, int *y) {
+  *x = view->x - view->geometry.x;
+  *y = view->y - view->geometry.y;
+}
+
+static void damage_whole_view(struct dgde_view *view) {
+  pixman_region32_t damage;
+  pixman_region32_init(&damage);
+  for_each_surface(view, damage_surface_box, &damage);
+  int x, y;
+  surface_origin(view, &x, &y);
+  pixman_region32_translate(&damage, x, y);
+  emit_damage(view, &damage);
+  pixman_region32_fini(&damage);
+}
+
+static bool solid_pixels(const uint8_t *data, int32_t width, int32_t height,
+                         int32_t stride, uint32_t *pixel) {
+  // the first differing pixel is usually found right away
+  *pixel = *(const uint32_t *)data;
+  for (int32_t y = 0; y < height; ++y) {
+    const uint32_t *row = (const uint32_t *)(data + (size_t)y * stride);
+    for (int32_t x = 0; x < width; ++x) {
+      if (row[x] != *pixel) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static void detect_solid(struct wlr_surface *surface,
+                         struct solid_color *solid) {
+  /* Clients filling a surface with a single colour (backgrounds, dimming,
+   * placeholders) get it drawn as a rectangle instead of a texture. Only
+   * newly attached buffers need to be looked at, the contents of a buffer
+   * can't change without attaching it again. */
+  if (!(surface->current.committed & WLR_SURFACE_STATE_BUFFER)) {
+    return;
+  }
+
+  solid->solid = false;
+  struct wl_resource *resource = surface->current.buffer_resource;
+  struct wl_shm_buffer *buffer =
+      resource != NULL ? wl_shm_buffer_get(resource) : NULL;
+  if (buffer == NULL) {
+    return;
+  }
+
+  uint32_t format = wl_shm_buffer_get_format(buffer);
+  if (format != WL_SHM_FORMAT_ARGB8888 && format != WL_SHM_FORMAT_XRGB8888) {
+    return;
+  }
+
+  int32_t width = wl_shm_buffer_get_width(buffer);
+  int32_t height = wl_shm_buffer_get_height(buffer);
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+
+  uint32_t pixel;
+  wl_shm_buffer_begin_access(buffer);
+  solid->solid = solid_pixels(wl_shm_buffer_get_data(buffer), width, height,
+                              wl_shm_buffer_get_stride(buffer), &pixel);
+  wl_shm_buffer_end_access(buffer);
+
+  if (format == WL_SHM_FORMAT_XRGB8888) {
+    pixel |= 0xff000000;
+  }
+  solid->color[0] = ((pixel >> 16) & 0xff) / 255.f;
+  solid->color[1] = ((pixel >> 8) & 0xff) / 255.f;
+  solid->color[2] = (pixel & 0xff) / 255.f;
+  solid->color[3] = (pixel >> 24) / 255.f;
+}
+
+static const struct solid_color *find_solid(const struct dgde_view *view,
+                                            const struct wlr_surface *surface) {
+  if (surface == view_surface(view)) {
+    return &view->solid;
+  }
+
+  struct view_child *child;
+  wl_list_for_each(child, &view->children, link) {
+    if (child->surface == surface) {
+      return &child->solid;
+    }
+  }
+
+  return NULL;
+}
+
+static void view_child_create(struct dgde_view *view,
+                              struct wlr_surface *surface,
+                              struct wlr_xdg_surface *xdg_surface);
+
+static void child_commit(struct wl_listener *listener, void *data) {
+  /* Popups and desynchronized subsurfaces commit on their own. They are small
+   * and rare enough to just redraw the whole view. */
+  struct view_child *child = wl_container_of(listener, child, commit);
+  detect_solid(child->surface, &child->solid);
+  if (child->view->mapped) {
+    damage_whole_view(child->view);
+  }
+}
+
+static void child_unmap(struct wl_listener *listener, void *data) {
+  /* The child is no longer part of the view so we don't know where it was,
+   * damage everything the view might have covered. */
+  struct view_child *child = wl_container_of(listener, child, unmap);
+  emit_damage(child->view, NULL);
+}
+
+static void child_new_popup(struct wl_listener *listener, void *data) {
+  struct view_child *child = wl_container_of(listener, child, new_popup);
+  struct wlr_xdg_popup *popup = data;
+  view_child_create(child->view, popup->base->surface, popup->base);
+}
+
+static void child_new_subsurface(struct wl_listener *listener, void *data) {
+  struct view_child *child = wl_container_of(listener, child, new_subsurface);
+  struct wlr_subsurface *subsurface = data;
+  view_child_create(child->view, subsurface->surface, NULL);
+}
+
+static void view_child_destroy(struct view_child *child) {
+  wl_list_remove(&child->commit.link);
+  wl_list_remove(&child->destroy.link);
+  wl_list_remove(&child->new_subsurface.link);
+  wl_list_remove(&child->unmap.link);
+  wl_list_remove(&child->new_popup.link);
+  wl_list_remove(&child->link);
+  free(child);
+}
+
+static void child_destroy(struct wl_listener *listener, void *data) {
+  struct view_child *child = wl_container_of(listener, child, destroy);
+  emit_damage(child->view, NULL);
+  view_child_destroy(child);
+}
+
+static void view_child_create(struct dgde_view *view,
+                              struct wlr_surface *surface,
+                              struct wlr_xdg_surface *xdg_surface) {
+  struct view_child *child = calloc(1, sizeof(struct view_child));
+  child->view = view;
+  child->surface = surface;
+
+  child->commit.notify = child_commit;
+  wl_signal_add(&surface->events.commit, &child->commit);
+  child->destroy.notify = child_destroy;
+  wl_signal_add(&surface->events.destroy, &child->destroy);
+  child->new_subsurface.notify = child_new_subsurface;
+  wl_signal_add(&surface->events.new_subsurface, &child->new_subsurface);
+
+  if (view->output != NULL) {
+    wlr_surface_send_enter(surface, view->output);
+  }
+
+  // popups can be unmapped and have popups of their own, subsurfaces can't
+  wl_list_init(&child->unmap.link);
+  wl_list_init(&child->new_popup.link);
+  if (xdg_surface != NULL) {
+    child->unmap.notify = child_unmap;
+    wl_signal_add(&xdg_surface->events.unmap, &child->unmap);
+    child->new_popup.notify = child_new_popup;
+    wl_signal_add(&xdg_surface->events.new_popup, &child->new_popup);
+  }
+
+  wl_list_insert(&view->children, &child->link);
+}
+
+static void view_map(struct dgde_view *view) {
+  view->mapped = true;
+  dgde_view_focus(view);
+
+  for (uint32_t h = 0, e = view->num_event_handlers; h < e; ++h) {
+    struct dgde_view_handler *handler = &view->handlers[h];
+    if (handler->map != NULL) {
+      handler->map(handler->userdata, view);
+    }
+  }
+  // after the handlers, the layout has placed it by now
+  DGDE_PROBE(view_map, view, view->id, view->x, view->y, view->width,
+             view->height);
+}
+
+static void view_unmap(struct dgde_view *view) {
+  view->mapped = false;
+  DGDE_PROBE(view_unmap, view, view->id);
+
+  for (uint32_t h = 0, e = view->num_event_handlers; h < e; ++h) {
+    struct dgde_view_handler *handler = &view->handlers[h];
+    if (handler->unmap != NULL) {
+      handler->unmap(handler->userdata, view);
+    }
+  }
+}
+
 static void xdg_surface_map(struct wl_listener *listener, void *data) {
   /* Called when the surface is mapped, or ready to display on-screen. */
   struct dgde_view *view = wl_container_of(listener, view, map);
-  view->mapped = true;
-  dgde_view_focus(view);
+  view_map(view);
 }
 
 static void xdg_surface_unmap(struct wl_listener *listener, void *data) {
   /* Called when the surface is unmapped, and should no longer be shown. */
   struct dgde_view *view = wl_container_of(listener, view, unmap);
-  view->mapped = false;
+  view_unmap(view);
+}
+
+static bool configure_acked(const struct dgde_view *view) {
+  return view->configure_serial == 0 ||
+         view->xdg_surface->configure_serial >= view->configure_serial;
+}
+
+/* Whether the client has drawn at the size it was configured with. X11
+ * windows have caught up once their size changes, to the configured size or
+ * to whatever the client settled on instead, e.g. rounded to its size hints.
+ * Others have once they acked the configure. */
+static bool drawn_configured_size(const struct dgde_view *view) {
+#ifdef DGDE_XWAYLAND
+  if (view->xwayland_surface != NULL) {
+    struct wlr_box geometry = dgde_view_geometry(view);
+    return (geometry.width == view->configured.width &&
+            geometry.height == view->configured.height) ||
+           geometry.width != view->configured_from.width ||
+           geometry.height != view->configured_from.height;
+  }
+#endif
+  return configure_acked(view);
+}
+
+static void configure(struct dgde_view *view, int width, int height) {
+#ifdef DGDE_XWAYLAND
+  if (view->xwayland_surface != NULL) {
+    // the window is simply resized, nothing to wait for before the next one
+    wlr_xwayland_surface_configure(view->xwayland_surface, view->x, view->y,
+                                   width, height);
+    struct wlr_box geometry = dgde_view_geometry(view);
+    view->configured = (struct dgde_view_size){width, height};
+    view->configured_from =
+        (struct dgde_view_size){geometry.width, geometry.height};
+    view->size_pending = false;
+    return;
+  }
+#endif
+  uint32_t serial = wlr_xdg_toplevel_set_size(view->xdg_surface, width, height);
+  // 0 means that nothing changed and nothing was sent
+  if (serial != 0) {
+    view->configure_serial = serial;
+  }
+  view->size_pending = false;
+}
+
+static void xdg_surface_commit(struct wl_listener *listener, void *data) {
+  /* Called every time the client commits new state for the toplevel surface,
+   * this is where we find out what parts of the view need to be redrawn. */
+  struct dgde_view *view = wl_container_of(listener, view, commit);
+  dgde_trace_instant("commit", view->id);
+  detect_solid(view_surface(view), &view->solid);
+
+  /* Clients drawing their own shadows have a geometry smaller than the
+   * surface, those told to leave decorations to us usually don't. */
+  struct wlr_box geometry = dgde_view_geometry(view);
+  bool moved =
+      geometry.x != view->geometry.x || geometry.y != view->geometry.y;
+  view->geometry = geometry;
+
+  /* A commit after acking the last configure is a good time for the next
+   * one, this paces configures to the rate the client can keep up with. */
+  bool caught_up = false;
+  if (configure_acked(view)) {
+    if (view->size_pending) {
+      configure(view, view->size.width, view->size.height);
+    } else if (view->stretched && drawn_configured_size(view)) {
+      view->stretched = false;
+      caught_up = true;
+    }
+  }
+
+  if (!view->mapped) {
+    return;
+  }
+
+  // the surface moved, or has been drawn scaled until now
+  if (caught_up || moved) {
+    emit_damage(view, NULL);
+    return;
+  }
+
+  struct wlr_surface *surface = view_surface(view);
+  if (surface->current.width != view->width ||
+      surface->current.height != view->height) {
+    // the old contents might be larger than the new ones
+    view->width = surface->current.width;
+    view->height = surface->current.height;
+    emit_damage(view, NULL);
+    return;
+  }
+
+  /* This also picks up synchronized subsurfaces since their state is applied
+   * together with the parent. */
+  pixman_region32_t damage;
+  pixman_region32_init(&damage);
+  for_each_surface(view, damage_surface, &damage);
+  int x, y;
+  surface_origin(view, &x, &y);
+  pixman_region32_translate(&damage, x, y);
+  emit_damage(view, &damage);
+  pixman_region32_fini(&damage);
+}
+
+static void xdg_surface_new_popup(struct wl_listener *listener, void *data) {
+  struct dgde_view *view = wl_container_of(listener, view, new_popup);
+  struct wlr_xdg_popup *popup = data;
+  view_child_create(view, popup->base->surface, popup->base);
+}
+
+static void xdg_surface_new_subsurface(struct wl_listener *listener,
+                                       void *data) {
+  struct dgde_view *view = wl_container_of(listener, view, new_subsurface);
+  struct wlr_subsurface *subsurface = data;
+  view_child_create(view, subsurface->surface, NULL);
 }
 
 static void xdg_surface_destroy(struct wl_listener *listener, void *data) {
   /* Called when the surface is destroyed and should never be shown again. */
   struct dgde_view *view = wl_container_of(listener, view, destroy);
+  DGDE_PROBE(view_destroy, view, view->id);
+
+  for (uint32_t h = 0, e = view->num_event_handlers; h < e; ++h) {
+    struct dgde_view_handler *handler = &view->handlers[h];
+    if (handler->destroy != NULL) {
+      handler->destroy(handler->userdata, view);
+    }
+  }
+
+  struct view_child *child, *tmp;
+  wl_list_for_each_safe(child, tmp, &view->children, link) {
+    view_child_destroy(child);
+  }
+
+  wl_list_remove(&view->map.link);
+  wl_list_remove(&view->unmap.link);
+  wl_list_remove(&view->destroy.link);
+  wl_list_remove(&view->commit.link);
+  wl_list_remove(&view->new_popup.link);
+  wl_list_remove(&view->new_subsurface.link);
+  wl_list_remove(&view->request_move.link);
+  wl_list_remove(&view->request_resize.link);
+  wl_list_remove(&view->set_title.link);
+#ifdef DGDE_XWAYLAND
+  if (view->xwayland_surface != NULL) {
+    wl_list_remove(&view->request_configure.link);
+    view->xwayland_surface->data = NULL;
+    free(view);
+    return;
+  }
+#endif
+  view->xdg_surface->data = NULL;
   free(view);
 }
 
@@ -59,8 +552,8 @@ static void xdg_toplevel_request_move(struct wl_listener *listener,
    * client, to prevent the client from requesting this whenever they want. */
   struct dgde_view *view = wl_container_of(listener, view, request_move);
   for (uint32_t h = 0, e = view->num_handlers; h < e; ++h) {
-    view->handler_functions[h](view->handler_userdatas, view, DgdeCursor_Move,
-                               0);
+    view->handler_functions[h](view->handler_userdatas[h], view,
+                               DgdeCursor_Move, 0);
   }
 }
 
@@ -74,18 +567,43 @@ static void xdg_toplevel_request_resize(struct wl_listener *listener,
   struct wlr_xdg_toplevel_resize_event *event = data;
   struct dgde_view *view = wl_container_of(listener, view, request_resize);
   for (uint32_t h = 0, e = view->num_handlers; h < e; ++h) {
-    view->handler_functions[h](view->handler_userdatas, view, DgdeCursor_Resize,
-                               event->edges);
+    view->handler_functions[h](view->handler_userdatas[h], view,
+                               DgdeCursor_Resize, event->edges);
   }
 }
 
-struct dgde_view *dgde_view_create(struct wlr_xdg_surface *surface,
-                                   struct wlr_seat *seat) {
+static void xdg_toplevel_set_title(struct wl_listener *listener, void *data) {
+  /* Terminals may do this many times per second, this only costs a layout
+   * and a redraw of the titlebar. */
+  struct dgde_view *view = wl_container_of(listener, view, set_title);
+  dgde_text_layout(&view->title, dgde_view_title(view));
+
+  for (uint32_t h = 0, e = view->num_event_handlers; h < e; ++h) {
+    struct dgde_view_handler *handler = &view->handlers[h];
+    if (handler->title != NULL) {
+      handler->title(handler->userdata, view);
+    }
+  }
+}
+
+static struct dgde_view *view_alloc(struct wlr_seat *seat) {
+  // ids are never reused so that external tools can tell views apart
+  static uint32_t next_id = 1;
+
   struct dgde_view *view = calloc(1, sizeof(struct dgde_view));
-  view->xdg_surface = surface;
+  view->id = next_id++;
   view->seat = seat;
   view->mapped = false;
-  view->floating = false; // TODO: ?
+  wl_list_init(&view->children);
+
+  return view;
+}
+
+struct dgde_view *dgde_view_create(struct wlr_xdg_surface *surface,
+                                   struct wlr_seat *seat) {
+  struct dgde_view *view = view_alloc(seat);
+  view->xdg_surface = surface;
+  surface->data = view;
 
   // internal events
   view->map.notify = xdg_surface_map;
@@ -94,21 +612,109 @@ struct dgde_view *dgde_view_create(struct wlr_xdg_surface *surface,
   wl_signal_add(&view->xdg_surface->events.unmap, &view->unmap);
   view->destroy.notify = xdg_surface_destroy;
   wl_signal_add(&view->xdg_surface->events.destroy, &view->destroy);
+  view->commit.notify = xdg_surface_commit;
+  wl_signal_add(&view->xdg_surface->surface->events.commit, &view->commit);
+
+  // damage tracking for child surfaces
+  view->new_popup.notify = xdg_surface_new_popup;
+  wl_signal_add(&view->xdg_surface->events.new_popup, &view->new_popup);
+  view->new_subsurface.notify = xdg_surface_new_subsurface;
+  wl_signal_add(&view->xdg_surface->surface->events.new_subsurface,
+                &view->new_subsurface);
 
   struct wlr_xdg_toplevel *toplevel = view->xdg_surface->toplevel;
   view->request_move.notify = xdg_toplevel_request_move;
   wl_signal_add(&toplevel->events.request_move, &view->request_move);
   view->request_resize.notify = xdg_toplevel_request_resize;
   wl_signal_add(&toplevel->events.request_resize, &view->request_resize);
+  view->set_title.notify = xdg_toplevel_set_title;
+  wl_signal_add(&toplevel->events.set_title, &view->set_title);
+  dgde_text_layout(&view->title, toplevel->title);
 
   return view;
 }
 
+#ifdef DGDE_XWAYLAND
+static void xwayland_surface_map(struct wl_listener *listener, void *data) {
+  /* The wl_surface of an X11 window is only known once it is mapped, and it
+   * can be a different one every time. */
+  struct dgde_view *view = wl_container_of(listener, view, map);
+  wl_signal_add(&view->xwayland_surface->surface->events.commit,
+                &view->commit);
+  view_map(view);
+}
+
+static void xwayland_surface_unmap(struct wl_listener *listener, void *data) {
+  struct dgde_view *view = wl_container_of(listener, view, unmap);
+  view_unmap(view);
+  wl_list_remove(&view->commit.link);
+  wl_list_init(&view->commit.link);
+}
+
+static void xwayland_surface_request_configure(struct wl_listener *listener,
+                                               void *data) {
+  /* Windows that aren't shown yet can have the size they want, the layout
+   * decides once they are mapped. */
+  struct dgde_view *view = wl_container_of(listener, view, request_configure);
+  struct wlr_xwayland_surface_configure_event *event = data;
+  if (!view->mapped) {
+    wlr_xwayland_surface_configure(view->xwayland_surface, event->x, event->y,
+                                   event->width, event->height);
+    return;
+  }
+
+  configure(view, view->size.width, view->size.height);
+}
+
+static void xwayland_surface_request_resize(struct wl_listener *listener,
+                                            void *data) {
+  struct wlr_xwayland_resize_event *event = data;
+  struct dgde_view *view = wl_container_of(listener, view, request_resize);
+  for (uint32_t h = 0, e = view->num_handlers; h < e; ++h) {
+    view->handler_functions[h](view->handler_userdatas[h], view,
+                               DgdeCursor_Resize, event->edges);
+  }
+}
+
+struct dgde_view *
+dgde_view_create_xwayland(struct wlr_xwayland_surface *surface,
+                          struct wlr_seat *seat) {
+  struct dgde_view *view = view_alloc(seat);
+  view->xwayland_surface = surface;
+  surface->data = view;
+
+  view->map.notify = xwayland_surface_map;
+  wl_signal_add(&surface->events.map, &view->map);
+  view->unmap.notify = xwayland_surface_unmap;
+  wl_signal_add(&surface->events.unmap, &view->unmap);
+  view->destroy.notify = xdg_surface_destroy;
+  wl_signal_add(&surface->events.destroy, &view->destroy);
+  view->request_configure.notify = xwayland_surface_request_configure;
+  wl_signal_add(&surface->events.request_configure, &view->request_configure);
+
+  // added and removed with the wl_surface on map and unmap
+  view->commit.notify = xdg_surface_commit;
+  wl_list_init(&view->commit.link);
+  wl_list_init(&view->new_popup.link);
+  wl_list_init(&view->new_subsurface.link);
+
+  view->request_move.notify = xdg_toplevel_request_move;
+  wl_signal_add(&surface->events.request_move, &view->request_move);
+  view->request_resize.notify = xwayland_surface_request_resize;
+  wl_signal_add(&surface->events.request_resize, &view->request_resize);
+  view->set_title.notify = xdg_toplevel_set_title;
+  wl_signal_add(&surface->events.set_title, &view->set_title);
+  dgde_text_layout(&view->title, surface->title);
+
+  return view;
+}
+#endif
+
 void dgde_view_focus(const struct dgde_view *view) {
   /* Note: this function only deals with keyboard focus. */
   struct wlr_seat *seat = view->seat;
   struct wlr_surface *prev_surface = seat->keyboard_state.focused_surface;
-  if (prev_surface == view->xdg_surface->surface) {
+  if (prev_surface == view_surface(view)) {
     /* Don't re-focus an already focused surface. */
     return;
   }
@@ -119,13 +725,14 @@ void dgde_view_focus(const struct dgde_view *view) {
      * it no longer has focus and the client will repaint accordingly, e.g.
      * stop displaying a caret.
      */
-    struct wlr_xdg_surface *previous =
-        wlr_xdg_surface_from_wlr_surface(seat->keyboard_state.focused_surface);
-    wlr_xdg_toplevel_set_activated(previous, false);
+    struct dgde_view *previous = dgde_view_from_surface(prev_surface);
+    if (previous != NULL) {
+      set_activated(previous, false);
+    }
   }
 
   /* Activate the new surface */
-  wlr_xdg_toplevel_set_activated(view->xdg_surface, true);
+  set_activated(view, true);
 
   /*
    * Tell the seat to have the keyboard enter this surface. wlroots will keep
@@ -133,7 +740,7 @@ void dgde_view_focus(const struct dgde_view *view) {
    * clients without additional work on your part.
    */
   struct wlr_keyboard *keyboard = wlr_seat_get_keyboard(seat);
-  wlr_seat_keyboard_notify_enter(seat, view->xdg_surface->surface,
+  wlr_seat_keyboard_notify_enter(seat, view_surface(view),
                                  keyboard->keycodes, keyboard->num_keycodes,
                                  &keyboard->modifiers);
 }
@@ -148,12 +755,21 @@ struct wlr_surface *dgde_view_surface_at(struct dgde_view *view, double lx,
    * surface pointer to that wlr_surface and the sx and sy coordinates to the
    * coordinates relative to that surface's top-left corner.
    */
-  double view_sx = lx - view->x;
-  double view_sy = ly - view->y;
+  int x, y;
+  surface_origin(view, &x, &y);
+  double view_sx = lx - x;
+  double view_sy = ly - y;
 
   double _sx, _sy;
-  struct wlr_surface *surface = wlr_xdg_surface_surface_at(
-      view->xdg_surface, view_sx, view_sy, &_sx, &_sy);
+  struct wlr_surface *surface;
+#ifdef DGDE_XWAYLAND
+  if (view->xwayland_surface != NULL) {
+    surface = wlr_surface_surface_at(view->xwayland_surface->surface, view_sx,
+                                     view_sy, &_sx, &_sy);
+  } else
+#endif
+    surface = wlr_xdg_surface_surface_at(view->xdg_surface, view_sx, view_sy,
+                                         &_sx, &_sy);
   if (surface != NULL) {
     *sx = _sx;
     *sy = _sy;
@@ -163,10 +779,23 @@ struct wlr_surface *dgde_view_surface_at(struct dgde_view *view, double lx,
   return NULL;
 }
 
-struct dgde_view *dgde_view_at(struct wl_list *views, double lx, double ly,
-                               double *sx, double *sy) {
-  /* This iterates over all of our surfaces and attempts to find one under the
-   * cursor. This relies on server->views being ordered from top-to-bottom. */
+struct dgde_view *dgde_view_at(struct dgde_view *const *views,
+                               uint32_t num_views, double lx, double ly,
+                               struct wlr_surface **surface, double *sx,
+                               double *sy) {
+  /* The views are ordered from top to bottom, so the first one with a
+   * surface under the point is the one that gets the input. */
+  for (uint32_t i = 0; i < num_views; ++i) {
+    if (!views[i]->mapped) {
+      continue;
+    }
+
+    struct wlr_surface *s = dgde_view_surface_at(views[i], lx, ly, sx, sy);
+    if (s != NULL) {
+      *surface = s;
+      return views[i];
+    }
+  }
 
   return NULL;
 }
@@ -182,17 +811,66 @@ void dgde_view_add_interaction_handler(struct dgde_view *view,
   }
 }
 
+void dgde_view_add_handler(struct dgde_view *view,
+                           const struct dgde_view_handler *handler) {
+  if (view->num_event_handlers < MAX_HANDLERS) {
+    view->handlers[view->num_event_handlers++] = *handler;
+  }
+}
+
+void dgde_view_remove_handlers(struct dgde_view *view, void *userdata) {
+  uint32_t kept = 0;
+  for (uint32_t h = 0, e = view->num_event_handlers; h < e; ++h) {
+    if (view->handlers[h].userdata != userdata) {
+      view->handlers[kept++] = view->handlers[h];
+    }
+  }
+  view->num_event_handlers = kept;
+
+  kept = 0;
+  for (uint32_t h = 0, e = view->num_handlers; h < e; ++h) {
+    if (view->handler_userdatas[h] != userdata) {
+      view->handler_functions[kept] = view->handler_functions[h];
+      view->handler_userdatas[kept++] = view->handler_userdatas[h];
+    }
+  }
+  view->num_handlers = kept;
+}
+
 struct dgde_view_position dgde_view_position(const struct dgde_view *view) {
   return (struct dgde_view_position){.x = view->x, .y = view->y};
 }
 
 void dgde_view_set_position(struct dgde_view *view,
                             struct dgde_view_position position) {
+  bool moved = view->x != position.x || view->y != position.y;
   view->x = position.x;
   view->y = position.y;
+
+#ifdef DGDE_XWAYLAND
+  /* X11 clients place their menus themselves, they need to know where their
+   * window is. */
+  struct wlr_xwayland_surface *xs = view->xwayland_surface;
+  if (xs != NULL && moved) {
+    wlr_xwayland_surface_configure(xs, view->x, view->y, xs->width,
+                                   xs->height);
+  }
+#else
+  (void)moved;
+#endif
 }
 
 struct wlr_box dgde_view_geometry(const struct dgde_view *view) {
+#ifdef DGDE_XWAYLAND
+  // all of an X11 window is the window, decorations are separate windows
+  if (view->xwayland_surface != NULL) {
+    struct wlr_surface *surface = view->xwayland_surface->surface;
+    return (struct wlr_box){
+        .width = surface != NULL ? surface->current.width : 0,
+        .height = surface != NULL ? surface->current.height : 0,
+    };
+  }
+#endif
   struct wlr_box b;
   wlr_xdg_surface_get_geometry(view->xdg_surface, &b);
 
@@ -200,13 +878,183 @@ struct wlr_box dgde_view_geometry(const struct dgde_view *view) {
 }
 
 void dgde_view_set_size(struct dgde_view *view, struct dgde_view_size size) {
-  wlr_xdg_toplevel_set_size(view->xdg_surface, size.width, size.height);
+  view->size = size;
+
+  // an evicted view gets its size when it is shown again
+  if (view->evicted) {
+    return;
+  }
+
+  if (!configure_acked(view)) {
+    view->size_pending = true;
+    return;
+  }
+
+  configure(view, size.width, size.height);
+}
+
+void dgde_view_set_resizing(struct dgde_view *view, bool resizing) {
+  view->resizing = resizing;
+
+  // keep showing the scaled buffer until the client has caught up
+  if (!resizing && (view->size_pending || !drawn_configured_size(view))) {
+    view->stretched = true;
+  }
+}
+
+static void send_enter(struct wlr_surface *surface, int sx, int sy,
+                       void *data) {
+  wlr_surface_send_enter(surface, data);
+}
+
+static void send_leave(struct wlr_surface *surface, int sx, int sy,
+                       void *data) {
+  wlr_surface_send_leave(surface, data);
+}
+
+void dgde_view_set_visible(struct dgde_view *view, struct wlr_output *output,
+                           bool visible) {
+  struct wlr_output *new_output = visible ? output : NULL;
+  if (view->output == new_output) {
+    return;
+  }
+
+  /* Clients use enter and leave to find out whether they are visible, many
+   * stop drawing while they are not on any output. */
+  if (view->output != NULL) {
+    for_each_surface(view, send_leave, view->output);
+  }
+  view->output = new_output;
+  if (view->output != NULL) {
+    for_each_surface(view, send_enter, view->output);
+  }
+
+  if (visible && view->evicted) {
+    /* Show the snapshot scaled up until the client has drawn at its full
+     * size again. */
+    view->evicted = false;
+    view->stretched = true;
+    configure(view, view->size.width, view->size.height);
+  }
+}
+
+void dgde_view_evict(struct dgde_view *view) {
+  if (view->output != NULL || view->evicted || !view->mapped) {
+    return;
+  }
+
+  /* We can't free the texture of a client's buffer, but we can ask the
+   * client for a much smaller one, which it draws the next time it is shown
+   * or right away if it keeps drawing while hidden. */
+  int width = view->size.width / SNAPSHOT_SCALE;
+  int height = view->size.height / SNAPSHOT_SCALE;
+  view->evicted = true;
+  configure(view, width > SNAPSHOT_MIN_SIZE ? width : SNAPSHOT_MIN_SIZE,
+            height > SNAPSHOT_MIN_SIZE ? height : SNAPSHOT_MIN_SIZE);
 }
 
 bool dgde_view_is_mapped(const struct dgde_view *view) { return view->mapped; }
 
+bool dgde_view_is_floating(const struct dgde_view *view) {
+  return view->floating;
+}
+
+void dgde_view_set_floating(struct dgde_view *view, bool floating) {
+  view->floating = floating;
+}
+
+bool dgde_view_wants_floating(const struct dgde_view *view) {
+  /* Dialogs have a parent and windows with a fixed size can't be tiled
+   * without leaving a gap, both look better floating. */
+#ifdef DGDE_XWAYLAND
+  struct wlr_xwayland_surface *xs = view->xwayland_surface;
+  if (xs != NULL) {
+    const struct wlr_xwayland_surface_size_hints *hints = xs->size_hints;
+    if (xs->parent != NULL || xs->modal) {
+      return true;
+    }
+    return hints != NULL && hints->min_width > 0 && hints->min_height > 0 &&
+           hints->min_width == hints->max_width &&
+           hints->min_height == hints->max_height;
+  }
+#endif
+  struct wlr_xdg_toplevel *toplevel = view->xdg_surface->toplevel;
+  if (toplevel->parent != NULL) {
+    return true;
+  }
+
+  const struct wlr_xdg_toplevel_state *state = &toplevel->current;
+  return state->min_width > 0 && state->min_height > 0 &&
+         state->min_width == state->max_width &&
+         state->min_height == state->max_height;
+}
+
+void dgde_view_add_opaque_region(const struct dgde_view *view,
+                                 pixman_region32_t *region) {
+  // scaled buffers don't cover exactly what their opaque region says
+  if (!view->mapped || view->evicted || view->resizing || view->stretched) {
+    return;
+  }
+
+  struct wlr_surface *surface = view_surface(view);
+  pixman_region32_t opaque;
+  pixman_region32_init(&opaque);
+  pixman_region32_copy(&opaque, &surface->opaque_region);
+  int x, y;
+  surface_origin(view, &x, &y);
+  pixman_region32_translate(&opaque, x, y);
+  pixman_region32_union(region, region, &opaque);
+  pixman_region32_fini(&opaque);
+}
+
+uint32_t dgde_view_id(const struct dgde_view *view) { return view->id; }
+
+const char *dgde_view_title(const struct dgde_view *view) {
+#ifdef DGDE_XWAYLAND
+  if (view->xwayland_surface != NULL) {
+    return view->xwayland_surface->title;
+  }
+#endif
+  return view->xdg_surface->toplevel->title;
+}
+
+const struct dgde_text *dgde_view_title_text(const struct dgde_view *view) {
+  return &view->title;
+}
+
+const char *dgde_view_app_id(const struct dgde_view *view) {
+#ifdef DGDE_XWAYLAND
+  // the closest thing X11 has to an app id
+  if (view->xwayland_surface != NULL) {
+    return view->xwayland_surface->class;
+  }
+#endif
+  return view->xdg_surface->toplevel->app_id;
+}
+
+struct dgde_view *dgde_view_from_surface(struct wlr_surface *surface) {
+#ifdef DGDE_XWAYLAND
+  if (surface != NULL && wlr_surface_is_xwayland_surface(surface)) {
+    // override-redirect windows have no view, their data stays NULL
+    return wlr_xwayland_surface_from_wlr_surface(surface)->data;
+  }
+#endif
+
+  if (surface == NULL || !wlr_surface_is_xdg_surface(surface)) {
+    return NULL;
+  }
+
+  struct wlr_xdg_surface *xdg_surface =
+      wlr_xdg_surface_from_wlr_surface(surface);
+  if (xdg_surface->role != WLR_XDG_SURFACE_ROLE_TOPLEVEL) {
+    return NULL;
+  }
+
+  return xdg_surface->data;
+}
+
 bool dgde_view_is_focused(const struct dgde_view *view) {
-  return view->xdg_surface->surface ==
+  return view_surface(view) ==
          wlr_surface_get_root_surface(
              view->seat->pointer_state.focused_surface);
 }
@@ -219,14 +1067,48 @@ struct render_data {
   struct wlr_renderer *renderer;
   const struct dgde_view *view;
   const struct timespec *when;
+  struct dgde_render_list *list;
 };
 
+static struct wlr_box surface_box(const struct render_data *rdata,
+                                  const struct wlr_surface *surface, int sx,
+                                  int sy) {
+  struct wlr_output *output = rdata->output;
+
+  /* The view has a position in layout coordinates. If you have two displays,
+   * one next to the other, both 1080p, a view on the rightmost display might
+   * have layout coordinates of 2000,100. We need to translate that to
+   * output-local coordinates, or (2000 - 1920). */
+  double ox = 0, oy = 0;
+  int x, y;
+  surface_origin(rdata->view, &x, &y);
+  wlr_output_layout_output_coords(rdata->output_layout, output, &ox, &oy);
+  ox += x + sx, oy += y + sy;
+
+  int width = surface->current.width;
+  int height = surface->current.height;
+  const struct dgde_view *view = rdata->view;
+  if ((view->evicted || view->resizing || view->stretched) &&
+      surface == view_surface(view)) {
+    // the last buffer fills the space the view is going to have
+    width = view->size.width;
+    height = view->size.height;
+  }
+
+  /* We also have to apply the scale factor for HiDPI outputs. This is only
+   * part of the puzzle, TinyWL does not fully support HiDPI. */
+  return (struct wlr_box){
+      .x = ox * output->scale,
+      .y = oy * output->scale,
+      .width = width * output->scale,
+      .height = height * output->scale,
+  };
+}
+
 static void render_surface(struct wlr_surface *surface, int sx, int sy,
                            void *data) {
   struct render_data *rdata = data;
-  const struct dgde_view *view = rdata->view;
   struct wlr_output *output = rdata->output;
-  struct wlr_output_layout *output_layout = rdata->output_layout;
 
   /* We first obtain a wlr_texture, which is a GPU resource. wlroots
    * automatically handles negotiating these with the client. The underlying
@@ -238,23 +1120,20 @@ static void render_surface(struct wlr_surface *surface, int sx, int sy,
     return;
   }
 
-  /* The view has a position in layout coordinates. If you have two displays,
-   * one next to the other, both 1080p, a view on the rightmost display might
-   * have layout coordinates of 2000,100. We need to translate that to
-   * output-local coordinates, or (2000 - 1920). */
-  double ox = 0, oy = 0;
-  struct dgde_view_position view_pos = dgde_view_position(view);
-  wlr_output_layout_output_coords(output_layout, output, &ox, &oy);
-  ox += view_pos.x + sx, oy += view_pos.y + sy;
+  dgde_trace_begin("render surface", rdata->view->id);
+  struct wlr_box box = surface_box(rdata, surface, sx, sy);
+  DGDE_PROBE(render_surface, rdata->view, rdata->view->id, box.x, box.y,
+             box.width, box.height);
 
-  /* We also have to apply the scale factor for HiDPI outputs. This is only
-   * part of the puzzle, TinyWL does not fully support HiDPI. */
-  struct wlr_box box = {
-      .x = ox * output->scale,
-      .y = oy * output->scale,
-      .width = surface->current.width * output->scale,
-      .height = surface->current.height * output->scale,
-  };
+  // a fill is cheaper than sampling a texture of the same colour
+  const struct solid_color *solid = find_solid(rdata->view, surface);
+  if (solid != NULL && solid->solid) {
+    wlr_render_rect(rdata->renderer, &box, solid->color,
+                    output->transform_matrix);
+    DGDE_PROBE(render_surface_end, rdata->view);
+    dgde_trace_end("render surface");
+    return;
+  }
 
   /*
    * Those familiar with OpenGL are also familiar with the role of matricies
@@ -272,13 +1151,52 @@ static void render_surface(struct wlr_surface *surface, int sx, int sy,
       wlr_output_transform_invert(surface->current.transform);
   wlr_matrix_project_box(matrix, &box, transform, 0, output->transform_matrix);
 
+  /* Clients using wp_viewporter may attach a buffer of any size and only
+   * show part of it, the source box is the part of the buffer to stretch over
+   * the surface. */
+  struct wlr_fbox src;
+  wlr_surface_get_buffer_source_box(surface, &src);
+
   /* This takes our matrix, the texture, and an alpha, and performs the actual
    * rendering on the GPU. */
-  wlr_render_texture_with_matrix(rdata->renderer, texture, matrix, 1);
+  wlr_render_subtexture_with_matrix(rdata->renderer, texture, &src, matrix, 1);
+  DGDE_PROBE(render_surface_end, rdata->view);
+  dgde_trace_end("render surface");
+}
 
+static void collect_surface(struct wlr_surface *surface, int sx, int sy,
+                            void *data) {
+  struct render_data *rdata = data;
+
+  /* The tiled compositor works directly on the pixels of the pixman texture,
+   * so there is nothing to draw for surfaces without one. */
+  struct wlr_texture *texture = wlr_surface_get_texture(surface);
+  if (texture == NULL) {
+    return;
+  }
+
+  struct wlr_box box = surface_box(rdata, surface, sx, sy);
+  const struct solid_color *solid = find_solid(rdata->view, surface);
+  if (solid != NULL && solid->solid) {
+    dgde_render_list_add_rect(rdata->list, &box, solid->color);
+    return;
+  }
+
+  if (!wlr_texture_is_pixman(texture)) {
+    return;
+  }
+  struct wlr_fbox src;
+  wlr_surface_get_buffer_source_box(surface, &src);
+  dgde_render_list_add_image(rdata->list, &box,
+                             wlr_pixman_texture_get_image(texture), &src);
+}
+
+static void send_frame_done(struct wlr_surface *surface, int sx, int sy,
+                            void *data) {
   /* This lets the client know that we've displayed that frame and it can
    * prepare another one now if it likes. */
-  wlr_surface_send_frame_done(surface, rdata->when);
+  const struct timespec *when = data;
+  wlr_surface_send_frame_done(surface, when);
 }
 
 void dgde_view_render(const struct dgde_view *view, struct wlr_output *output,
@@ -292,10 +1210,38 @@ void dgde_view_render(const struct dgde_view *view, struct wlr_output *output,
       .output_layout = output_layout,
       .output = output,
       .view = view,
-      .renderer = view->xdg_surface->surface->renderer,
+      .renderer = view_surface(view)->renderer,
       .when = now,
   };
 
   // This handles subsurfaces and popup surfaces as well
-  wlr_xdg_surface_for_each_surface(view->xdg_surface, render_surface, &rdata);
+  for_each_surface(view, render_surface, &rdata);
+}
+
+void dgde_view_collect(const struct dgde_view *view, struct wlr_output *output,
+                       struct wlr_output_layout *output_layout,
+                       const struct timespec *now,
+                       struct dgde_render_list *list) {
+  if (!view->mapped) {
+    return;
+  }
+
+  struct render_data rdata = {
+      .output_layout = output_layout,
+      .output = output,
+      .view = view,
+      .when = now,
+      .list = list,
+  };
+
+  for_each_surface(view, collect_surface, &rdata);
+}
+
+void dgde_view_send_frame_done(const struct dgde_view *view,
+                               const struct timespec *now) {
+  if (!view->mapped) {
+    return;
+  }
+
+  for_each_surface(view, send_frame_done, (void *)now);
 }
@@ -4,11 +4,13 @@
 #include "server.h"
 #include "src/cursor.h"
 
+#include <pixman.h>
 #include <stdint.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_compositor.h>
 
 struct dgde_view;
+struct dgde_text;
 struct wlr_xdg_surface;
 
 struct dgde_view_position {
@@ -24,8 +26,20 @@ struct dgde_view_size {
 struct dgde_view *dgde_view_create(struct wlr_xdg_surface *surface,
                                    struct wlr_seat *seat);
 
-struct dgde_view *dgde_view_at(struct wl_list *views, double lx, double ly,
-                               double *sx, double *sy);
+#ifdef DGDE_XWAYLAND
+struct wlr_xwayland_surface;
+/* A view for a managed X11 window, laid out and decorated like any other. */
+struct dgde_view *
+dgde_view_create_xwayland(struct wlr_xwayland_surface *surface,
+                          struct wlr_seat *seat);
+#endif
+
+/* Finds the topmost of the views, ordered from top to bottom, that has a
+ * surface at the layout coordinates. */
+struct dgde_view *dgde_view_at(struct dgde_view *const *views,
+                               uint32_t num_views, double lx, double ly,
+                               struct wlr_surface **surface, double *sx,
+                               double *sy);
 
 struct wlr_surface *dgde_view_surface_at(struct dgde_view *view, double lx,
                                          double ly, double *sx, double *sy);
@@ -34,21 +48,91 @@ void dgde_view_focus(const struct dgde_view *view);
 bool dgde_view_is_focused(const struct dgde_view *view);
 bool dgde_view_is_mapped(const struct dgde_view *view);
 
+bool dgde_view_is_floating(const struct dgde_view *view);
+void dgde_view_set_floating(struct dgde_view *view, bool floating);
+/* Dialogs and fixed size windows should float instead of being tiled. */
+bool dgde_view_wants_floating(const struct dgde_view *view);
+
+/* Adds the parts of the view that are known to be opaque, in layout
+ * coordinates, to the region. */
+void dgde_view_add_opaque_region(const struct dgde_view *view,
+                                 pixman_region32_t *region);
+
+uint32_t dgde_view_id(const struct dgde_view *view);
+const char *dgde_view_title(const struct dgde_view *view);
+/* The title laid out for the titlebar. */
+const struct dgde_text *dgde_view_title_text(const struct dgde_view *view);
+const char *dgde_view_app_id(const struct dgde_view *view);
+
+/* Returns the view of a toplevel surface, NULL for anything else. */
+struct dgde_view *dgde_view_from_surface(struct wlr_surface *surface);
+
 typedef void (*dgde_view_interaction_handler)(void *, struct dgde_view *,
                                               enum dgde_cursor_mode, uint32_t);
 void dgde_view_add_interaction_handler(struct dgde_view *view,
                                        dgde_view_interaction_handler handler,
                                        void *userdata);
 
+typedef void (*dgde_view_cb)(void *, struct dgde_view *);
+/* Damage is in layout coordinates, NULL means that anything the view might
+ * have covered needs to be redrawn. */
+typedef void (*dgde_view_damage_cb)(void *, struct dgde_view *,
+                                    pixman_region32_t *);
+
+struct dgde_view_handler {
+  void *userdata;
+  dgde_view_cb map;
+  dgde_view_cb unmap;
+  dgde_view_cb destroy;
+  dgde_view_damage_cb damage;
+  // the title changed, the titlebar needs to be redrawn
+  dgde_view_cb title;
+};
+
+void dgde_view_add_handler(struct dgde_view *view,
+                           const struct dgde_view_handler *handler);
+void dgde_view_remove_handlers(struct dgde_view *view, void *userdata);
+
+/* The position is where the window geometry starts, i.e. the part of the
+ * surface inside the decorations. Client-side shadows and titlebars that are
+ * part of the surface but outside of its geometry end up outside of it. */
 struct dgde_view_position dgde_view_position(const struct dgde_view *view);
 void dgde_view_set_position(struct dgde_view *view,
                             struct dgde_view_position position);
 
+/* The window geometry set by the client, x and y are the offset of the
+ * window in the surface. */
 struct wlr_box dgde_view_geometry(const struct dgde_view *view);
+
+/* Configures the view with the size. While the client hasn't acked the last
+ * configure, only the latest size is kept and sent on its next commit. */
 void dgde_view_set_size(struct dgde_view *view, struct dgde_view_size size);
 
+/* While resizing, the last buffer is drawn scaled to the size the view is
+ * going to have. */
+void dgde_view_set_resizing(struct dgde_view *view, bool resizing);
+
+/* Sends enter/leave for the output so that clients know whether they are
+ * visible. */
+void dgde_view_set_visible(struct dgde_view *view, struct wlr_output *output,
+                           bool visible);
+
+/* Asks a hidden view to shrink its buffers down to a small snapshot, which is
+ * shown scaled up when the view becomes visible until the client has drawn
+ * at its full size again. */
+void dgde_view_evict(struct dgde_view *view);
+
 void dgde_view_render(const struct dgde_view *view, struct wlr_output *output,
                       struct wlr_output_layout *output_layout,
                       const struct timespec *now);
 
+void dgde_view_send_frame_done(const struct dgde_view *view,
+                               const struct timespec *now);
+
+struct dgde_render_list;
+void dgde_view_collect(const struct dgde_view *view, struct wlr_output *output,
+                       struct wlr_output_layout *output_layout,
+                       const struct timespec *now,
+                       struct dgde_render_list *list);
+
 #endif
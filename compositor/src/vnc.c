@@ -0,0 +1,1043 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "vnc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input-event-codes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <drm_fourcc.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/util/log.h>
+#include <xkbcommon/xkbcommon.h>
+
+// changes are found per tile, small enough that a blinking caret doesn't
+// resend much of the line it is on
+#define DIFF_TILE 16
+// fixed by the ZRLE encoding
+#define ZRLE_TILE 64
+
+#define MAX_CLIENTS 8
+#define INPUT_SIZE 4096
+// what handle_message returns for a protocol error
+#define MESSAGE_ERROR ((size_t)-1)
+
+enum client_state {
+  ClientState_Version,
+  ClientState_Security,
+  ClientState_Init,
+  ClientState_Normal,
+};
+
+enum rfb_message {
+  RfbMessage_SetPixelFormat = 0,
+  RfbMessage_SetEncodings = 2,
+  RfbMessage_UpdateRequest = 3,
+  RfbMessage_KeyEvent = 4,
+  RfbMessage_PointerEvent = 5,
+  RfbMessage_ClientCutText = 6,
+};
+
+enum rfb_encoding {
+  RfbEncoding_Raw = 0,
+  RfbEncoding_Zrle = 16,
+  RfbEncoding_DesktopSize = -223,
+};
+
+struct pixel_format {
+  uint8_t bpp;
+  uint8_t depth;
+  bool big_endian;
+  bool true_colour;
+  uint16_t max[3];
+  uint8_t shift[3];
+};
+
+// what we read back from the renderer, XRGB8888 in memory order
+static const struct pixel_format native_format = {
+    .bpp = 32,
+    .depth = 24,
+    .big_endian = false,
+    .true_colour = true,
+    .max = {255, 255, 255},
+    .shift = {16, 8, 0},
+};
+
+struct buffer {
+  uint8_t *data;
+  size_t len;
+  size_t cap;
+};
+
+struct vnc_client {
+  struct wl_list link;
+  struct dgde_vnc *vnc;
+  int fd;
+  struct wl_event_source *source;
+
+  enum client_state state;
+  int minor_version;
+
+  uint8_t input[INPUT_SIZE];
+  size_t input_len;
+  // what is left of a clipboard message, which we ignore
+  uint32_t skip;
+
+  // written out as the socket allows, the next update is only put together
+  // once the last one is gone
+  struct buffer output;
+  size_t output_sent;
+
+  struct pixel_format format;
+  // compressed pixels leave out the unused byte of 32 bit pixels
+  uint8_t cpixel_size;
+  uint8_t cpixel_offset;
+
+  bool zrle;
+  bool desktop_size;
+  z_stream zstream;
+  bool zstream_ready;
+
+  bool update_requested;
+  bool resized;
+  // in the framebuffer, not sent yet
+  pixman_region32_t dirty;
+
+  // input to release when the viewer goes away
+  uint8_t buttons;
+  uint32_t pressed[8];
+};
+
+struct dgde_vnc {
+  struct wlr_output_damage *damage;
+  struct wlr_output_layout *layout;
+  struct wlr_input_device *pointer;
+  struct wlr_input_device *keyboard;
+
+  int listen_fd;
+  char *path;
+  struct wl_event_source *listen_source;
+  struct wl_event_loop *loop;
+
+  struct wl_list clients;
+  uint32_t num_clients;
+
+  // what the viewers have been sent or are about to be, XRGB8888
+  uint32_t *fb;
+  int width;
+  int height;
+  // it isn't kept up to date while nobody is watching, nothing is sent until
+  // a frame read back all of it
+  bool fb_valid;
+
+  // a damaged rectangle as read back from the renderer
+  uint32_t *scratch;
+  size_t scratch_size;
+
+  // uncompressed ZRLE tiles of one rectangle
+  struct buffer tiles;
+};
+
+static uint32_t now_msec(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static uint8_t *buffer_reserve(struct buffer *buffer, size_t size) {
+  if (buffer->len + size > buffer->cap) {
+    size_t cap = buffer->cap > 0 ? buffer->cap * 2 : 4096;
+    while (cap < buffer->len + size) {
+      cap *= 2;
+    }
+    buffer->data = realloc(buffer->data, cap);
+    buffer->cap = cap;
+  }
+  return buffer->data + buffer->len;
+}
+
+static void put_u8(struct buffer *buffer, uint8_t value) {
+  *buffer_reserve(buffer, 1) = value;
+  buffer->len += 1;
+}
+
+static void put_u16(struct buffer *buffer, uint16_t value) {
+  uint8_t *p = buffer_reserve(buffer, 2);
+  p[0] = value >> 8;
+  p[1] = value;
+  buffer->len += 2;
+}
+
+static void put_u32(struct buffer *buffer, uint32_t value) {
+  uint8_t *p = buffer_reserve(buffer, 4);
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+  buffer->len += 4;
+}
+
+static void put_bytes(struct buffer *buffer, const void *data, size_t size) {
+  memcpy(buffer_reserve(buffer, size), data, size);
+  buffer->len += size;
+}
+
+static uint16_t get_u16(const uint8_t *p) { return p[0] << 8 | p[1]; }
+
+static uint32_t get_u32(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void put_pixel_format(struct buffer *buffer,
+                             const struct pixel_format *format) {
+  put_u8(buffer, format->bpp);
+  put_u8(buffer, format->depth);
+  put_u8(buffer, format->big_endian);
+  put_u8(buffer, format->true_colour);
+  for (int i = 0; i < 3; ++i) {
+    put_u16(buffer, format->max[i]);
+  }
+  for (int i = 0; i < 3; ++i) {
+    put_u8(buffer, format->shift[i]);
+  }
+  put_bytes(buffer, "\0\0\0", 3);
+}
+
+static bool valid_pixel_format(const struct pixel_format *format) {
+  /* The shifts and maxima come from the viewer, every channel has to fit
+   * into the pixel before anything is shifted by them. */
+  if (!format->true_colour ||
+      (format->bpp != 8 && format->bpp != 16 && format->bpp != 32) ||
+      format->depth > format->bpp) {
+    return false;
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (format->shift[i] >= format->bpp ||
+        (uint64_t)format->max[i] << format->shift[i] >> format->bpp != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void set_pixel_format(struct vnc_client *client,
+                             const struct pixel_format *format) {
+  client->format = *format;
+
+  /* A 32 bit pixel with all of its colour in three of its bytes is sent as
+   * just those bytes in ZRLE. */
+  uint32_t used = 0;
+  for (int i = 0; i < 3; ++i) {
+    used |= (uint32_t)format->max[i] << format->shift[i];
+  }
+  client->cpixel_size = format->bpp / 8;
+  client->cpixel_offset = 0;
+  if (format->bpp == 32 && format->depth <= 24) {
+    if ((used & 0xff000000) == 0) {
+      client->cpixel_size = 3;
+      client->cpixel_offset = format->big_endian ? 1 : 0;
+    } else if ((used & 0x000000ff) == 0) {
+      client->cpixel_size = 3;
+      client->cpixel_offset = format->big_endian ? 0 : 1;
+    }
+  }
+}
+
+static uint32_t convert_pixel(const struct pixel_format *format,
+                              uint32_t xrgb) {
+  uint32_t value = 0;
+  for (int i = 0; i < 3; ++i) {
+    uint32_t c = (xrgb >> native_format.shift[i]) & 0xff;
+    value |= (c * format->max[i] / 255) << format->shift[i];
+  }
+  return value;
+}
+
+static void put_pixel(struct buffer *buffer, const struct vnc_client *client,
+                      uint32_t xrgb, bool compressed) {
+  const struct pixel_format *format = &client->format;
+  uint32_t value = convert_pixel(format, xrgb);
+  uint8_t bytes[4];
+  int size = format->bpp / 8;
+  for (int i = 0; i < size; ++i) {
+    int shift = format->big_endian ? (size - 1 - i) * 8 : i * 8;
+    bytes[i] = value >> shift;
+  }
+
+  if (compressed) {
+    put_bytes(buffer, bytes + client->cpixel_offset, client->cpixel_size);
+  } else {
+    put_bytes(buffer, bytes, size);
+  }
+}
+
+static void client_destroy(struct vnc_client *client) {
+  struct dgde_vnc *vnc = client->vnc;
+  uint32_t time = now_msec();
+
+  /* Whatever the viewer held down is let go of, or it would stay pressed. */
+  struct wlr_keyboard *keyboard = vnc->keyboard->keyboard;
+  for (uint32_t keycode = 0; keycode < 256; ++keycode) {
+    if (client->pressed[keycode / 32] & (1u << keycode % 32)) {
+      struct wlr_event_keyboard_key event = {
+          .time_msec = time,
+          .keycode = keycode,
+          .update_state = true,
+          .state = WL_KEYBOARD_KEY_STATE_RELEASED,
+      };
+      wlr_keyboard_notify_key(keyboard, &event);
+    }
+  }
+
+  static const uint32_t buttons[] = {BTN_LEFT, BTN_MIDDLE, BTN_RIGHT};
+  struct wlr_pointer *pointer = vnc->pointer->pointer;
+  for (int i = 0; i < 3; ++i) {
+    if (client->buttons & (1 << i)) {
+      struct wlr_event_pointer_button event = {
+          .device = vnc->pointer,
+          .time_msec = time,
+          .button = buttons[i],
+          .state = WLR_BUTTON_RELEASED,
+      };
+      wl_signal_emit(&pointer->events.button, &event);
+    }
+  }
+  if (client->buttons != 0) {
+    wl_signal_emit(&pointer->events.frame, pointer);
+  }
+
+  wlr_log(WLR_INFO, "vnc viewer on %s disconnected",
+          vnc->damage->output->name);
+
+  wl_event_source_remove(client->source);
+  close(client->fd);
+  if (client->zstream_ready) {
+    deflateEnd(&client->zstream);
+  }
+  pixman_region32_fini(&client->dirty);
+  free(client->output.data);
+  wl_list_remove(&client->link);
+  --vnc->num_clients;
+  free(client);
+}
+
+static bool flush(struct vnc_client *client) {
+  /* Returns false if the viewer is gone. */
+  while (client->output_sent < client->output.len) {
+    // a viewer that went away is an error here, not a SIGPIPE
+    ssize_t n = send(client->fd, client->output.data + client->output_sent,
+                     client->output.len - client->output_sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN) {
+      wl_event_source_fd_update(client->source,
+                                WL_EVENT_READABLE | WL_EVENT_WRITABLE);
+      return true;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    client->output_sent += n;
+  }
+
+  client->output.len = 0;
+  client->output_sent = 0;
+  wl_event_source_fd_update(client->source, WL_EVENT_READABLE);
+  return true;
+}
+
+static void put_rect_header(struct buffer *buffer, const pixman_box32_t *box,
+                            int32_t encoding) {
+  put_u16(buffer, box->x1);
+  put_u16(buffer, box->y1);
+  put_u16(buffer, box->x2 - box->x1);
+  put_u16(buffer, box->y2 - box->y1);
+  put_u32(buffer, (uint32_t)encoding);
+}
+
+static void encode_raw(struct vnc_client *client, const pixman_box32_t *box) {
+  struct dgde_vnc *vnc = client->vnc;
+  put_rect_header(&client->output, box, RfbEncoding_Raw);
+  for (int y = box->y1; y < box->y2; ++y) {
+    const uint32_t *row = &vnc->fb[(size_t)y * vnc->width];
+    for (int x = box->x1; x < box->x2; ++x) {
+      put_pixel(&client->output, client, row[x], false);
+    }
+  }
+}
+
+static bool tile_is_solid(const struct dgde_vnc *vnc, int x, int y, int width,
+                          int height) {
+  uint32_t pixel = vnc->fb[(size_t)y * vnc->width + x];
+  for (int ty = y; ty < y + height; ++ty) {
+    const uint32_t *row = &vnc->fb[(size_t)ty * vnc->width];
+    for (int tx = x; tx < x + width; ++tx) {
+      if (row[tx] != pixel) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void encode_zrle(struct vnc_client *client, const pixman_box32_t *box) {
+  struct dgde_vnc *vnc = client->vnc;
+  struct buffer *tiles = &vnc->tiles;
+  tiles->len = 0;
+
+  /* Tiles of a single colour, like most of a desktop, are a single pixel.
+   * The others are sent raw and left to zlib, which does well enough on
+   * rows of identical pixels. */
+  for (int y = box->y1; y < box->y2; y += ZRLE_TILE) {
+    int height = box->y2 - y < ZRLE_TILE ? box->y2 - y : ZRLE_TILE;
+    for (int x = box->x1; x < box->x2; x += ZRLE_TILE) {
+      int width = box->x2 - x < ZRLE_TILE ? box->x2 - x : ZRLE_TILE;
+      if (tile_is_solid(vnc, x, y, width, height)) {
+        put_u8(tiles, 1);
+        put_pixel(tiles, client, vnc->fb[(size_t)y * vnc->width + x], true);
+        continue;
+      }
+
+      put_u8(tiles, 0);
+      for (int ty = y; ty < y + height; ++ty) {
+        const uint32_t *row = &vnc->fb[(size_t)ty * vnc->width];
+        for (int tx = x; tx < x + width; ++tx) {
+          put_pixel(tiles, client, row[tx], true);
+        }
+      }
+    }
+  }
+
+  /* All rectangles of a connection share one zlib stream, each one is
+   * flushed so that the viewer can decode it on its own. */
+  struct buffer *output = &client->output;
+  put_rect_header(output, box, RfbEncoding_Zrle);
+  size_t length_at = output->len;
+  put_u32(output, 0);
+
+  z_stream *z = &client->zstream;
+  z->next_in = tiles->data;
+  z->avail_in = tiles->len;
+  do {
+    size_t chunk = deflateBound(z, z->avail_in) + 64;
+    z->next_out = buffer_reserve(output, chunk);
+    z->avail_out = chunk;
+    deflate(z, Z_SYNC_FLUSH);
+    output->len += chunk - z->avail_out;
+  } while (z->avail_out == 0);
+
+  uint32_t length = output->len - length_at - 4;
+  uint8_t *p = output->data + length_at;
+  p[0] = length >> 24;
+  p[1] = length >> 16;
+  p[2] = length >> 8;
+  p[3] = length;
+}
+
+static bool send_update(struct vnc_client *client) {
+  struct dgde_vnc *vnc = client->vnc;
+  int num_rects;
+  pixman_box32_t *rects = pixman_region32_rectangles(&client->dirty,
+                                                     &num_rects);
+
+  put_u8(&client->output, 0);
+  put_u8(&client->output, 0);
+  put_u16(&client->output, num_rects + (client->resized ? 1 : 0));
+
+  if (client->resized) {
+    pixman_box32_t box = {0, 0, vnc->width, vnc->height};
+    put_rect_header(&client->output, &box, RfbEncoding_DesktopSize);
+    client->resized = false;
+  }
+
+  for (int i = 0; i < num_rects; ++i) {
+    if (client->zrle) {
+      encode_zrle(client, &rects[i]);
+    } else {
+      encode_raw(client, &rects[i]);
+    }
+  }
+
+  pixman_region32_clear(&client->dirty);
+  client->update_requested = false;
+  return flush(client);
+}
+
+static bool maybe_send_update(struct vnc_client *client) {
+  /* Viewers ask for every update, and the next one waits until the last one
+   * has been written out. Changes pile up in the dirty region meanwhile, so
+   * a slow viewer gets fewer updates instead of a growing queue. */
+  if (client->state != ClientState_Normal || !client->update_requested ||
+      client->output.len > 0 || !client->vnc->fb_valid) {
+    return true;
+  }
+  if (!client->resized && !pixman_region32_not_empty(&client->dirty)) {
+    return true;
+  }
+
+  return send_update(client);
+}
+
+static void send_server_init(struct vnc_client *client) {
+  struct dgde_vnc *vnc = client->vnc;
+  struct buffer *output = &client->output;
+  put_u16(output, vnc->width);
+  put_u16(output, vnc->height);
+  put_pixel_format(output, &native_format);
+
+  char name[64];
+  int len = snprintf(name, sizeof(name), "dgde %s", vnc->damage->output->name);
+  put_u32(output, len);
+  put_bytes(output, name, len);
+}
+
+static void handle_pointer(struct vnc_client *client, uint8_t mask, int x,
+                           int y) {
+  struct dgde_vnc *vnc = client->vnc;
+  struct wlr_pointer *pointer = vnc->pointer->pointer;
+  struct wlr_output *output = vnc->damage->output;
+  uint32_t time = now_msec();
+
+  /* Absolute pointers are mapped onto the whole layout. */
+  struct wlr_box *output_box = wlr_output_layout_get_box(vnc->layout, output);
+  struct wlr_box *layout_box = wlr_output_layout_get_box(vnc->layout, NULL);
+  if (output_box != NULL && layout_box != NULL && layout_box->width > 0 &&
+      layout_box->height > 0) {
+    double lx = output_box->x + x / output->scale;
+    double ly = output_box->y + y / output->scale;
+    struct wlr_event_pointer_motion_absolute motion = {
+        .device = vnc->pointer,
+        .time_msec = time,
+        .x = (lx - layout_box->x) / layout_box->width,
+        .y = (ly - layout_box->y) / layout_box->height,
+    };
+    wl_signal_emit(&pointer->events.motion_absolute, &motion);
+  }
+
+  static const uint32_t buttons[] = {BTN_LEFT, BTN_MIDDLE, BTN_RIGHT};
+  uint8_t changed = mask ^ client->buttons;
+  for (int i = 0; i < 3; ++i) {
+    if (changed & (1 << i)) {
+      struct wlr_event_pointer_button event = {
+          .device = vnc->pointer,
+          .time_msec = time,
+          .button = buttons[i],
+          .state = mask & (1 << i) ? WLR_BUTTON_PRESSED : WLR_BUTTON_RELEASED,
+      };
+      wl_signal_emit(&pointer->events.button, &event);
+    }
+  }
+
+  // the wheel is buttons 4 to 7, pressed and released for every step
+  for (int i = 3; i < 7; ++i) {
+    if (!(changed & mask & (1 << i))) {
+      continue;
+    }
+    struct wlr_event_pointer_axis event = {
+        .device = vnc->pointer,
+        .time_msec = time,
+        .source = WLR_AXIS_SOURCE_WHEEL,
+        .orientation = i < 5 ? WLR_AXIS_ORIENTATION_VERTICAL
+                             : WLR_AXIS_ORIENTATION_HORIZONTAL,
+        .delta = i % 2 == 1 ? -15 : 15,
+        .delta_discrete = i % 2 == 1 ? -1 : 1,
+    };
+    wl_signal_emit(&pointer->events.axis, &event);
+  }
+
+  wl_signal_emit(&pointer->events.frame, pointer);
+  client->buttons = mask & 0x7;
+}
+
+static uint32_t keysym_to_keycode(struct xkb_keymap *keymap,
+                                  xkb_keysym_t keysym) {
+  /* Viewers send keysyms, modifiers included, so the unshifted and shifted
+   * levels of the first layout are all that is needed. */
+  xkb_keycode_t min = xkb_keymap_min_keycode(keymap);
+  xkb_keycode_t max = xkb_keymap_max_keycode(keymap);
+  for (xkb_keycode_t keycode = min; keycode <= max; ++keycode) {
+    for (xkb_level_index_t level = 0; level < 2; ++level) {
+      const xkb_keysym_t *syms;
+      int num_syms =
+          xkb_keymap_key_get_syms_by_level(keymap, keycode, 0, level, &syms);
+      if (num_syms > 0 && syms[0] == keysym) {
+        return keycode;
+      }
+    }
+  }
+  return 0;
+}
+
+static void handle_key(struct vnc_client *client, bool down,
+                       xkb_keysym_t keysym) {
+  struct wlr_keyboard *keyboard = client->vnc->keyboard->keyboard;
+  if (keyboard->keymap == NULL) {
+    return;
+  }
+
+  uint32_t keycode = keysym_to_keycode(keyboard->keymap, keysym);
+  if (keycode < 8 || keycode - 8 >= 256) {
+    wlr_log(WLR_DEBUG, "vnc: no key for keysym 0x%x", keysym);
+    return;
+  }
+
+  // evdev keycodes, like libinput's
+  keycode -= 8;
+  if (down) {
+    client->pressed[keycode / 32] |= 1u << keycode % 32;
+  } else {
+    client->pressed[keycode / 32] &= ~(1u << keycode % 32);
+  }
+
+  struct wlr_event_keyboard_key event = {
+      .time_msec = now_msec(),
+      .keycode = keycode,
+      .update_state = true,
+      .state = down ? WL_KEYBOARD_KEY_STATE_PRESSED
+                    : WL_KEYBOARD_KEY_STATE_RELEASED,
+  };
+  wlr_keyboard_notify_key(keyboard, &event);
+}
+
+static size_t handle_normal_message(struct vnc_client *client,
+                                    const uint8_t *data, size_t len) {
+  struct dgde_vnc *vnc = client->vnc;
+  switch (data[0]) {
+  case RfbMessage_SetPixelFormat: {
+    if (len < 20) {
+      return 0;
+    }
+    const uint8_t *p = data + 4;
+    struct pixel_format format = {
+        .bpp = p[0],
+        .depth = p[1],
+        .big_endian = p[2] != 0,
+        .true_colour = p[3] != 0,
+        .max = {get_u16(p + 4), get_u16(p + 6), get_u16(p + 8)},
+        .shift = {p[10], p[11], p[12]},
+    };
+    if (!valid_pixel_format(&format)) {
+      wlr_log(WLR_INFO, "vnc: unsupported pixel format, %d bpp%s", format.bpp,
+              format.true_colour ? "" : " with a colour map");
+      return MESSAGE_ERROR;
+    }
+    set_pixel_format(client, &format);
+    return 20;
+  }
+  case RfbMessage_SetEncodings: {
+    if (len < 4) {
+      return 0;
+    }
+    size_t size = 4 + 4 * (size_t)get_u16(data + 2);
+    if (size > INPUT_SIZE) {
+      return MESSAGE_ERROR;
+    }
+    if (len < size) {
+      return 0;
+    }
+
+    client->zrle = false;
+    client->desktop_size = false;
+    for (size_t i = 4; i < size; i += 4) {
+      int32_t encoding = (int32_t)get_u32(data + i);
+      if (encoding == RfbEncoding_Zrle) {
+        client->zrle = true;
+      } else if (encoding == RfbEncoding_DesktopSize) {
+        client->desktop_size = true;
+      }
+    }
+    if (client->zrle && !client->zstream_ready) {
+      // the fastest level, most of the saving is in not sending tiles at all
+      client->zstream_ready = deflateInit(&client->zstream, 1) == Z_OK;
+      client->zrle = client->zstream_ready;
+    }
+    return size;
+  }
+  case RfbMessage_UpdateRequest: {
+    if (len < 10) {
+      return 0;
+    }
+    client->update_requested = true;
+    if (!data[1]) {
+      // everything in the rectangle, not just what changed
+      pixman_region32_union_rect(&client->dirty, &client->dirty,
+                                 get_u16(data + 2), get_u16(data + 4),
+                                 get_u16(data + 6), get_u16(data + 8));
+      pixman_region32_intersect_rect(&client->dirty, &client->dirty, 0, 0,
+                                     vnc->width, vnc->height);
+    }
+    return 10;
+  }
+  case RfbMessage_KeyEvent:
+    if (len < 8) {
+      return 0;
+    }
+    handle_key(client, data[1] != 0, get_u32(data + 4));
+    return 8;
+  case RfbMessage_PointerEvent:
+    if (len < 6) {
+      return 0;
+    }
+    handle_pointer(client, data[1], get_u16(data + 2), get_u16(data + 4));
+    return 6;
+  case RfbMessage_ClientCutText:
+    if (len < 8) {
+      return 0;
+    }
+    client->skip = get_u32(data + 4);
+    return 8;
+  default:
+    wlr_log(WLR_INFO, "vnc: unknown message type %d", data[0]);
+    return MESSAGE_ERROR;
+  }
+}
+
+static size_t handle_message(struct vnc_client *client, const uint8_t *data,
+                             size_t len) {
+  /* Returns how much of data was used, 0 if the message isn't complete. */
+  struct dgde_vnc *vnc = client->vnc;
+  switch (client->state) {
+  case ClientState_Version:
+    if (len < 12) {
+      return 0;
+    }
+    if (memcmp(data, "RFB 003.", 8) != 0 || data[11] != '\n') {
+      return MESSAGE_ERROR;
+    }
+    client->minor_version = atoi((const char *)data + 8);
+    if (client->minor_version >= 7) {
+      // one security type: none
+      put_u8(&client->output, 1);
+      put_u8(&client->output, 1);
+      client->state = ClientState_Security;
+    } else {
+      put_u32(&client->output, 1);
+      client->state = ClientState_Init;
+    }
+    return 12;
+  case ClientState_Security:
+    if (len < 1) {
+      return 0;
+    }
+    if (data[0] != 1) {
+      return MESSAGE_ERROR;
+    }
+    if (client->minor_version >= 8) {
+      put_u32(&client->output, 0);
+    }
+    client->state = ClientState_Init;
+    return 1;
+  case ClientState_Init:
+    if (len < 1) {
+      return 0;
+    }
+    send_server_init(client);
+    client->state = ClientState_Normal;
+
+    pixman_region32_union_rect(&client->dirty, &client->dirty, 0, 0,
+                               vnc->width, vnc->height);
+    if (!vnc->fb_valid) {
+      wlr_output_damage_add_whole(vnc->damage);
+    }
+    wlr_log(WLR_INFO, "vnc viewer connected to %s",
+            vnc->damage->output->name);
+    return 1;
+  case ClientState_Normal:
+    return handle_normal_message(client, data, len);
+  }
+
+  return MESSAGE_ERROR;
+}
+
+static bool process_input(struct vnc_client *client) {
+  size_t pos = 0;
+  while (pos < client->input_len) {
+    size_t avail = client->input_len - pos;
+    size_t used;
+    if (client->skip > 0) {
+      used = client->skip < avail ? client->skip : avail;
+      client->skip -= used;
+    } else {
+      used = handle_message(client, client->input + pos, avail);
+    }
+
+    if (used == MESSAGE_ERROR) {
+      return false;
+    }
+    if (used == 0) {
+      break;
+    }
+    pos += used;
+  }
+
+  memmove(client->input, client->input + pos, client->input_len - pos);
+  client->input_len -= pos;
+
+  return flush(client) && maybe_send_update(client);
+}
+
+static int client_event(int fd, uint32_t mask, void *data) {
+  struct vnc_client *client = data;
+  if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) {
+    client_destroy(client);
+    return 0;
+  }
+
+  if (mask & WL_EVENT_WRITABLE) {
+    if (!flush(client) || !maybe_send_update(client)) {
+      client_destroy(client);
+      return 0;
+    }
+  }
+
+  if (mask & WL_EVENT_READABLE) {
+    ssize_t n = read(fd, client->input + client->input_len,
+                     INPUT_SIZE - client->input_len);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      client_destroy(client);
+      return 0;
+    }
+    if (n > 0) {
+      client->input_len += n;
+      if (!process_input(client)) {
+        client_destroy(client);
+      }
+    }
+  }
+
+  return 0;
+}
+
+static int accept_client(int fd, uint32_t mask, void *data) {
+  struct dgde_vnc *vnc = data;
+  int client_fd = accept(fd, NULL, NULL);
+  if (client_fd < 0) {
+    return 0;
+  }
+  if (vnc->num_clients >= MAX_CLIENTS) {
+    close(client_fd);
+    return 0;
+  }
+
+  fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) | O_NONBLOCK);
+  fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+
+  struct vnc_client *client = calloc(1, sizeof(struct vnc_client));
+  client->vnc = vnc;
+  client->fd = client_fd;
+  client->state = ClientState_Version;
+  set_pixel_format(client, &native_format);
+  pixman_region32_init(&client->dirty);
+  client->source = wl_event_loop_add_fd(
+      vnc->loop, client_fd, WL_EVENT_READABLE, client_event, client);
+  wl_list_insert(&vnc->clients, &client->link);
+  ++vnc->num_clients;
+
+  put_bytes(&client->output, "RFB 003.008\n", 12);
+  if (!flush(client)) {
+    client_destroy(client);
+  }
+  return 0;
+}
+
+static void resize(struct dgde_vnc *vnc, int width, int height) {
+  free(vnc->fb);
+  vnc->fb = calloc((size_t)width * height, sizeof(uint32_t));
+  vnc->width = width;
+  vnc->height = height;
+  vnc->fb_valid = false;
+
+  struct vnc_client *client, *tmp;
+  wl_list_for_each_safe(client, tmp, &vnc->clients, link) {
+    if (client->state != ClientState_Normal) {
+      continue;
+    }
+    if (!client->desktop_size) {
+      wlr_log(WLR_INFO, "vnc viewer can't follow the resize of %s",
+              vnc->damage->output->name);
+      client_destroy(client);
+      continue;
+    }
+    client->resized = true;
+    pixman_region32_fini(&client->dirty);
+    pixman_region32_init_rect(&client->dirty, 0, 0, width, height);
+  }
+
+  // the next frame reads back everything
+  wlr_output_damage_add_whole(vnc->damage);
+}
+
+static void diff_rect(struct dgde_vnc *vnc, int x, int y, int width,
+                      int height, pixman_region32_t *changed) {
+  /* Clients often redraw and damage more than what changed, a whole line
+   * of text for a caret or a whole window for a clock. Only tiles that
+   * differ from what the viewers already have are sent. Rows of a tile are
+   * compared with memcmp, which libc vectorises. */
+  for (int ty = y - y % DIFF_TILE; ty < y + height; ty += DIFF_TILE) {
+    int y1 = ty > y ? ty : y;
+    int y2 = ty + DIFF_TILE < y + height ? ty + DIFF_TILE : y + height;
+    for (int tx = x - x % DIFF_TILE; tx < x + width; tx += DIFF_TILE) {
+      int x1 = tx > x ? tx : x;
+      int x2 = tx + DIFF_TILE < x + width ? tx + DIFF_TILE : x + width;
+      size_t row_size = (x2 - x1) * sizeof(uint32_t);
+
+      bool differs = false;
+      for (int row = y1; row < y2 && !differs; ++row) {
+        differs = memcmp(&vnc->fb[(size_t)row * vnc->width + x1],
+                         &vnc->scratch[(size_t)(row - y) * width + x1 - x],
+                         row_size) != 0;
+      }
+      if (!differs) {
+        continue;
+      }
+
+      for (int row = y1; row < y2; ++row) {
+        memcpy(&vnc->fb[(size_t)row * vnc->width + x1],
+               &vnc->scratch[(size_t)(row - y) * width + x1 - x], row_size);
+      }
+      pixman_region32_union_rect(changed, changed, x1, y1, x2 - x1, y2 - y1);
+    }
+  }
+}
+
+void dgde_vnc_capture(struct dgde_vnc *vnc, struct wlr_renderer *renderer,
+                      pixman_region32_t *damage) {
+  if (vnc->num_clients == 0) {
+    vnc->fb_valid = false;
+    return;
+  }
+
+  int width, height;
+  wlr_output_transformed_resolution(vnc->damage->output, &width, &height);
+  if (width != vnc->width || height != vnc->height) {
+    resize(vnc, width, height);
+  }
+
+  pixman_region32_t changed;
+  pixman_region32_init(&changed);
+
+  int num_rects;
+  pixman_box32_t *rects = pixman_region32_rectangles(damage, &num_rects);
+  for (int i = 0; i < num_rects; ++i) {
+    int x1 = rects[i].x1 > 0 ? rects[i].x1 : 0;
+    int y1 = rects[i].y1 > 0 ? rects[i].y1 : 0;
+    int x2 = rects[i].x2 < width ? rects[i].x2 : width;
+    int y2 = rects[i].y2 < height ? rects[i].y2 : height;
+    if (x2 <= x1 || y2 <= y1) {
+      continue;
+    }
+
+    size_t size = (size_t)(x2 - x1) * (y2 - y1);
+    if (size > vnc->scratch_size) {
+      free(vnc->scratch);
+      vnc->scratch = malloc(size * sizeof(uint32_t));
+      vnc->scratch_size = size;
+    }
+
+    if (!wlr_renderer_read_pixels(renderer, DRM_FORMAT_XRGB8888, NULL,
+                                  (x2 - x1) * sizeof(uint32_t), x2 - x1,
+                                  y2 - y1, x1, y1, 0, 0, vnc->scratch)) {
+      continue;
+    }
+    diff_rect(vnc, x1, y1, x2 - x1, y2 - y1, &changed);
+  }
+
+  bool was_valid = vnc->fb_valid;
+  pixman_box32_t whole = {0, 0, width, height};
+  if (pixman_region32_contains_rectangle(damage, &whole) == PIXMAN_REGION_IN) {
+    vnc->fb_valid = true;
+  }
+
+  if (pixman_region32_not_empty(&changed) || vnc->fb_valid != was_valid) {
+    struct vnc_client *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &vnc->clients, link) {
+      if (client->state != ClientState_Normal) {
+        continue;
+      }
+      pixman_region32_union(&client->dirty, &client->dirty, &changed);
+      if (!maybe_send_update(client)) {
+        client_destroy(client);
+      }
+    }
+  }
+  pixman_region32_fini(&changed);
+}
+
+struct dgde_vnc *dgde_vnc_create(struct wl_event_loop *loop,
+                                 struct wlr_output_damage *damage,
+                                 struct wlr_output_layout *layout,
+                                 const char *path,
+                                 struct wlr_input_device *pointer,
+                                 struct wlr_input_device *keyboard) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    wlr_log(WLR_ERROR, "vnc socket path too long: %s", path);
+    return NULL;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    wlr_log_errno(WLR_ERROR, "vnc: failed to create socket");
+    return NULL;
+  }
+
+  /* Whoever can connect controls the session's input, so only the user may,
+   * even if the directory lets others in. */
+  unlink(path);
+  mode_t mask = umask(0077);
+  bool bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+  umask(mask);
+  if (!bound || listen(fd, MAX_CLIENTS) < 0) {
+    wlr_log_errno(WLR_ERROR, "vnc: failed to listen on %s", path);
+    close(fd);
+    return NULL;
+  }
+
+  struct dgde_vnc *vnc = calloc(1, sizeof(struct dgde_vnc));
+  vnc->loop = loop;
+  vnc->damage = damage;
+  vnc->layout = layout;
+  vnc->pointer = pointer;
+  vnc->keyboard = keyboard;
+  vnc->listen_fd = fd;
+  vnc->path = strdup(path);
+  vnc->listen_source =
+      wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE, accept_client, vnc);
+  wl_list_init(&vnc->clients);
+
+  int width, height;
+  wlr_output_transformed_resolution(damage->output, &width, &height);
+  resize(vnc, width, height);
+
+  wlr_log(WLR_INFO, "vnc server for %s on %s", damage->output->name, path);
+  return vnc;
+}
+
+void dgde_vnc_destroy(struct dgde_vnc *vnc) {
+  struct vnc_client *client, *tmp;
+  wl_list_for_each_safe(client, tmp, &vnc->clients, link) {
+    client_destroy(client);
+  }
+
+  wl_event_source_remove(vnc->listen_source);
+  close(vnc->listen_fd);
+  unlink(vnc->path);
+  free(vnc->path);
+  free(vnc->fb);
+  free(vnc->scratch);
+  free(vnc->tiles.data);
+  free(vnc);
+}
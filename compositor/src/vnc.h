@@ -0,0 +1,43 @@
+#ifndef VNC_H
+#define VNC_H
+
+#include <stdint.h>
+
+#include <pixman.h>
+#include <wayland-server-core.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_output_damage.h>
+#include <wlr/types/wlr_output_layout.h>
+
+/* A small RFB 3.8 (VNC) server showing a single output, so that headless
+ * sessions can be used with any stock VNC viewer. There is no
+ * authentication, it listens on a Unix socket only its user can connect to,
+ * which viewers reach directly or through a tunnel, e.g.
+ * `ssh -L 5900:$XDG_RUNTIME_DIR/dgde-vnc.wayland-1.HEADLESS-1.sock`.
+ *
+ * Only what was damaged in a frame is read back from the renderer, and of
+ * that only the 16x16 tiles that really changed are sent, ZRLE compressed if
+ * the viewer supports it. Nothing is read back while no viewer is
+ * connected. Input from viewers is fed into the pointer and keyboard devices
+ * given to it, so it takes the same path as any other input. */
+
+struct dgde_vnc;
+
+/* The pointer has to be absolute, the keyboard needs a keymap by the time the
+ * first key arrives. Returns NULL if the socket can't be listened on. */
+struct dgde_vnc *dgde_vnc_create(struct wl_event_loop *loop,
+                                 struct wlr_output_damage *damage,
+                                 struct wlr_output_layout *layout,
+                                 const char *path,
+                                 struct wlr_input_device *pointer,
+                                 struct wlr_input_device *keyboard);
+
+/* Called after a frame has been drawn, before the renderer is done with it.
+ * The damage is in buffer coordinates. */
+void dgde_vnc_capture(struct dgde_vnc *vnc, struct wlr_renderer *renderer,
+                      pixman_region32_t *damage);
+
+void dgde_vnc_destroy(struct dgde_vnc *vnc);
+
+#endif
@@ -3,13 +3,17 @@
 #include "workspace.h"
 #include "cursor.h"
 #include "decorations.h"
+#include "grid.h"
+#include "probes.h"
 #include "server.h"
+#include "trace.h"
 #include "view.h"
 
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <wlr/util/edges.h>
 #include <wlr/util/log.h>
 
 struct dgde_workspace {
@@ -19,6 +23,57 @@ struct dgde_workspace {
   struct node *root;
 
   struct wlr_seat *seat;
+
+  // where the workspace is shown, if it is
+  struct wlr_output *output;
+  bool visible;
+
+  dgde_workspace_damage_cb damage;
+  void *damage_userdata;
+
+  // the split being dragged, if any
+  struct node *resizing;
+
+  // floating views above the tree, from bottom to top
+  struct floating **floating;
+  uint32_t num_floating;
+  uint32_t floating_capacity;
+  // finds floating views by position without looking at all of them
+  struct dgde_grid *grid;
+  uint32_t query_stamp;
+  // scratch space for hit testing, as large as the floating array
+  struct floating **hits;
+  struct dgde_view **hit_views;
+
+  // the floating view being dragged and where it was grabbed
+  struct floating *moving;
+  double grab_x, grab_y;
+  // the last cursor position, for moves started by clients
+  struct dgde_cursor_position cursor_pos;
+  // clients starting a move or resize got the press, so they get the release
+  bool grab_by_client;
+};
+
+// about a quarter of the height of a typical output per cell
+#define GRID_CELL_SIZE 256
+
+struct floating {
+  struct dgde_view *view;
+  // the view including its decorations
+  struct wlr_box box;
+  // position in the stack, 0 is at the bottom
+  uint32_t index;
+  // the last query that reported the view, to skip duplicates
+  uint32_t stamp;
+  // completely covered by the floating views above it
+  bool occluded;
+};
+
+enum split {
+  // left and right side by side
+  Split_Columns,
+  // left above right
+  Split_Rows,
 };
 
 struct node {
@@ -27,6 +82,13 @@ struct node {
   struct node *right;
   struct node *parent;
   struct wlr_box geom;
+
+  // how the space is divided between left and right
+  enum split split;
+  float ratio;
+
+  // completely covered by floating views
+  bool occluded;
 };
 
 static struct wlr_box with_borders(const struct wlr_box *geom) {
@@ -44,29 +106,23 @@ static struct wlr_box with_borders(const struct wlr_box *geom) {
   return with_borders;
 }
 
-static void child_geom(const struct wlr_box *parent_geom,
+static void child_geom(const struct node *parent,
                        struct wlr_box *child_geoms[2]) {
-  uint32_t new_width = parent_geom->width;
-  uint32_t xoffset = 0;
-  uint32_t new_height = parent_geom->height;
-  uint32_t yoffset = 0;
-  if (parent_geom->height > parent_geom->width) {
-    new_height = parent_geom->height / 2;
-    yoffset = new_height;
-  } else {
-    new_width = parent_geom->width / 2;
-    xoffset = new_width;
-  }
-
+  const struct wlr_box *parent_geom = &parent->geom;
   *child_geoms[0] = *parent_geom;
-  child_geoms[0]->width = new_width;
-  child_geoms[0]->height = new_height;
-
   *child_geoms[1] = *parent_geom;
-  child_geoms[1]->x = parent_geom->x + xoffset;
-  child_geoms[1]->y = parent_geom->y + yoffset;
-  child_geoms[1]->width = new_width;
-  child_geoms[1]->height = new_height;
+
+  if (parent->split == Split_Rows) {
+    int height = parent_geom->height * parent->ratio;
+    child_geoms[0]->height = height;
+    child_geoms[1]->y = parent_geom->y + height;
+    child_geoms[1]->height = parent_geom->height - height;
+  } else {
+    int width = parent_geom->width * parent->ratio;
+    child_geoms[0]->width = width;
+    child_geoms[1]->x = parent_geom->x + width;
+    child_geoms[1]->width = parent_geom->width - width;
+  }
 }
 
 static struct node *split_node(struct node *parent) {
@@ -84,8 +140,13 @@ static struct node *split_node(struct node *parent) {
   parent->right = calloc(1, sizeof(struct node));
   parent->right->parent = parent;
 
+  // the direction is kept when the split is resized later
+  parent->split =
+      parent->geom.height > parent->geom.width ? Split_Rows : Split_Columns;
+  parent->ratio = 0.5f;
+
   struct wlr_box *results[2] = {&parent->left->geom, &parent->right->geom};
-  child_geom(&parent->geom, results);
+  child_geom(parent, results);
 
   parent->view = NULL;
 
@@ -97,6 +158,9 @@ static void resize_view(struct node *node, void *unused) {
 
   struct wlr_box geom = with_borders(&node->geom);
 
+  /* The client is asked for a window geometry of exactly the space inside the
+   * decorations, any client-side shadows are drawn outside of it since the
+   * view positions its surface by the geometry offset. */
   dgde_view_set_position(view,
                          (struct dgde_view_position){.x = geom.x, .y = geom.y});
   dgde_view_set_size(view, (struct dgde_view_size){
@@ -207,10 +271,25 @@ struct dgde_workspace *dgde_workspace_create(const char *display_name,
       .width = width,
       .height = height,
   };
+  ws->grid = dgde_grid_create(width, height, GRID_CELL_SIZE);
 
   return ws;
 }
 
+void dgde_workspace_set_damage_handler(struct dgde_workspace *workspace,
+                                       dgde_workspace_damage_cb handler,
+                                       void *userdata) {
+  workspace->damage = handler;
+  workspace->damage_userdata = userdata;
+}
+
+static void damage_workspace(struct dgde_workspace *workspace,
+                             pixman_region32_t *damage) {
+  if (workspace->damage != NULL) {
+    workspace->damage(workspace->damage_userdata, workspace, damage);
+  }
+}
+
 static void resize_node(struct node *node, void *data) {
   if (node->view != NULL) {
     resize_view(node, NULL);
@@ -218,63 +297,547 @@ static void resize_node(struct node *node, void *data) {
   }
 
   struct wlr_box *results[2] = {&node->left->geom, &node->right->geom};
-  child_geom(&node->geom, results);
+  child_geom(node, results);
 }
 
 void dgde_workspace_resize(struct dgde_workspace *workspace,
                            const uint32_t width, const uint32_t height) {
+  dgde_trace_begin("layout", width);
+  DGDE_PROBE(layout_begin, workspace, width, height);
   workspace->root->geom =
       (struct wlr_box){.x = 0, .y = 0, .width = width, .height = height};
 
   iter_all_nodes(workspace->root, resize_node, NULL);
+
+  // floating views keep their place, only the grid covers a new area
+  dgde_grid_reset(workspace->grid, width, height);
+  for (uint32_t i = 0, e = workspace->num_floating; i < e; ++i) {
+    struct floating *f = workspace->floating[i];
+    dgde_grid_insert(workspace->grid, f, &f->box);
+  }
+
+  damage_workspace(workspace, NULL);
+  DGDE_PROBE(layout_end, workspace);
+  dgde_trace_end("layout");
+}
+
+static void free_nodes(struct node *node) {
+  if (node == NULL) {
+    return;
+  }
+
+  free_nodes(node->left);
+  free_nodes(node->right);
+  free(node);
+}
+
+static void detach_view(struct node *node, void *data) {
+  dgde_view_remove_handlers(node->view, data);
 }
 
 void dgde_workspace_destroy(struct dgde_workspace *workspace) {
-  // TODO: free all views
+  // views belong to their clients, they just stop reporting to us
+  iter_nodes(workspace->root, detach_view, workspace);
+  free_nodes(workspace->root);
+
+  for (uint32_t i = 0, e = workspace->num_floating; i < e; ++i) {
+    struct floating *f = workspace->floating[i];
+    dgde_view_remove_handlers(f->view, workspace);
+    dgde_view_set_floating(f->view, false);
+    free(f);
+  }
+  free(workspace->floating);
+  free(workspace->hits);
+  free(workspace->hit_views);
+  dgde_grid_destroy(workspace->grid);
+
+  free((char *)workspace->name);
   free(workspace);
 }
 
+const char *dgde_workspace_name(const struct dgde_workspace *workspace) {
+  return workspace->name;
+}
+
+static void update_visibility(struct node *node, void *data) {
+  struct dgde_workspace *workspace = data;
+  dgde_view_set_visible(node->view, workspace->output, workspace->visible);
+}
+
+void dgde_workspace_set_visible(struct dgde_workspace *workspace,
+                                struct wlr_output *output, bool visible) {
+  workspace->output = output;
+  workspace->visible = visible && output != NULL;
+  iter_nodes(workspace->root, update_visibility, workspace);
+  for (uint32_t i = 0, e = workspace->num_floating; i < e; ++i) {
+    dgde_view_set_visible(workspace->floating[i]->view, output,
+                          workspace->visible);
+  }
+}
+
+static void evict_view(struct node *node, void *data) {
+  dgde_view_evict(node->view);
+}
+
+void dgde_workspace_evict(struct dgde_workspace *workspace) {
+  if (workspace->visible) {
+    return;
+  }
+
+  wlr_log(WLR_DEBUG, "evicting views on hidden workspace %s", workspace->name);
+  iter_nodes(workspace->root, evict_view, NULL);
+  for (uint32_t i = 0, e = workspace->num_floating; i < e; ++i) {
+    dgde_view_evict(workspace->floating[i]->view);
+  }
+}
+
+struct find_view_data {
+  const struct dgde_view *view;
+  struct node *node;
+};
+
+static void find_view(struct node *node, void *data) {
+  struct find_view_data *d = data;
+  if (node->view == d->view) {
+    d->node = node;
+  }
+}
+
 struct node_intersection {
   struct node *node;
-  struct dgde_cursor_position *pos;
+  const struct dgde_cursor_position *pos;
 };
 
-void node_intersects(struct node *node, void *data) {
+static void node_intersects(struct node *node, void *data) {
   struct node_intersection *d = data;
 
   if (wlr_box_contains_point(&node->geom, d->pos->x, d->pos->y)) {
+    d->node = node;
+  }
+}
+
+static struct node *leaf_at(struct dgde_workspace *workspace,
+                            const struct dgde_cursor_position *pos) {
+  struct node_intersection result = {.node = NULL, .pos = pos};
+  iter_nodes(workspace->root, node_intersects, &result);
+  return result.node;
+}
+
+static int split_position(const struct node *node) {
+  return node->split == Split_Columns ? node->right->geom.x
+                                      : node->right->geom.y;
+}
+
+static struct node *split_at(struct node *leaf,
+                             const struct dgde_cursor_position *pos) {
+  /* The edge between two nodes is made up of their borders, grabbing either
+   * border drags the closest split. */
+  int grab_size = DECORATION_SIZE[1] > DECORATION_SIZE[3] ? DECORATION_SIZE[1]
+                                                          : DECORATION_SIZE[3];
+  if (DECORATION_SIZE[0] > grab_size) {
+    grab_size = DECORATION_SIZE[0];
+  }
+
+  for (struct node *node = leaf->parent; node != NULL; node = node->parent) {
+    double p = node->split == Split_Columns ? pos->x : pos->y;
+    double distance = p - split_position(node);
+    if (distance > -grab_size && distance < grab_size) {
+      return node;
+    }
+  }
+
+  return NULL;
+}
+
+static struct node *split_for_edges(struct node *leaf, uint32_t edges) {
+  /* Clients asking for an interactive resize get the split on the side of
+   * the edge they asked for. */
+  for (struct node *child = leaf, *node = leaf->parent; node != NULL;
+       child = node, node = node->parent) {
+    bool left = child == node->left;
+    if (node->split == Split_Columns &&
+        (((edges & WLR_EDGE_RIGHT) && left) ||
+         ((edges & WLR_EDGE_LEFT) && !left))) {
+      return node;
+    }
+    if (node->split == Split_Rows && (((edges & WLR_EDGE_BOTTOM) && left) ||
+                                      ((edges & WLR_EDGE_TOP) && !left))) {
+      return node;
+    }
+  }
+
+  return NULL;
+}
+
+static void resize_subtree(struct node *node) {
+  if (node->view != NULL) {
+    resize_view(node, NULL);
+    return;
+  }
+
+  if (node->left == NULL) {
+    return;
+  }
+
+  struct wlr_box *results[2] = {&node->left->geom, &node->right->geom};
+  child_geom(node, results);
+  resize_subtree(node->left);
+  resize_subtree(node->right);
+}
+
+static void set_resizing(struct node *node, bool resizing) {
+  if (node->view != NULL) {
+    dgde_view_set_resizing(node->view, resizing);
+  } else if (node->left != NULL) {
+    set_resizing(node->left, resizing);
+    set_resizing(node->right, resizing);
+  }
+}
+
+static void begin_resize(struct dgde_workspace *workspace, struct node *split) {
+  wlr_log(WLR_DEBUG, "resizing split on workspace %s", workspace->name);
+  workspace->resizing = split;
+  set_resizing(split, true);
+}
+
+static void end_resize(struct dgde_workspace *workspace) {
+  set_resizing(workspace->resizing, false);
+  workspace->resizing = NULL;
+  damage_workspace(workspace, NULL);
+}
+
+static void drag_split(struct dgde_workspace *workspace,
+                       const struct dgde_cursor_position *pos) {
+  /* The views are configured at most once per commit of their clients (see
+   * dgde_view_set_size) and show their last buffer scaled to the new
+   * geometry in between, so this only costs a redraw per output frame no
+   * matter how fast the pointer reports motion. */
+  struct node *node = workspace->resizing;
+  float ratio =
+      node->split == Split_Columns
+          ? (float)(pos->x - node->geom.x) / node->geom.width
+          : (float)(pos->y - node->geom.y) / node->geom.height;
+  ratio = ratio < 0.1f ? 0.1f : ratio > 0.9f ? 0.9f : ratio;
+  if (ratio == node->ratio) {
+    return;
+  }
+
+  node->ratio = ratio;
+  dgde_trace_begin("layout", 0);
+  DGDE_PROBE(layout_begin, workspace, workspace->root->geom.width,
+             workspace->root->geom.height);
+  resize_subtree(node);
+  DGDE_PROBE(layout_end, workspace);
+  dgde_trace_end("layout");
+  damage_workspace(workspace, NULL);
+}
+
+static void damage_box(struct dgde_workspace *workspace,
+                       const struct wlr_box *box) {
+  pixman_region32_t damage;
+  pixman_region32_init_rect(&damage, box->x, box->y, box->width, box->height);
+  damage_workspace(workspace, &damage);
+  pixman_region32_fini(&damage);
+}
+
+static void place_floating(struct floating *f) {
+  struct wlr_box geom = with_borders(&f->box);
+  dgde_view_set_position(f->view,
+                         (struct dgde_view_position){.x = geom.x, .y = geom.y});
+}
+
+static struct floating *find_floating(const struct dgde_workspace *workspace,
+                                      const struct dgde_view *view) {
+  for (uint32_t i = 0, e = workspace->num_floating; i < e; ++i) {
+    if (workspace->floating[i]->view == view) {
+      return workspace->floating[i];
+    }
+  }
+
+  return NULL;
+}
+
+static struct wlr_box floating_box(const struct dgde_workspace *workspace,
+                                   const struct dgde_view *view) {
+  /* New floating views are centered at the size the client asked for, or
+   * at half the size of the workspace if it didn't. */
+  const struct wlr_box *area = &workspace->root->geom;
+  struct wlr_box geom = dgde_view_geometry(view);
+  int width = geom.width > 0 ? geom.width : area->width / 2;
+  int height = geom.height > 0 ? geom.height : area->height / 2;
+  width += DECORATION_SIZE[1] + DECORATION_SIZE[3];
+  height += DECORATION_SIZE[0] + DECORATION_SIZE[2];
+
+  return (struct wlr_box){
+      .x = area->x + (area->width - width) / 2,
+      .y = area->y + (area->height - height) / 2,
+      .width = width,
+      .height = height,
+  };
+}
+
+static void add_floating(struct dgde_workspace *workspace,
+                         struct dgde_view *view, const struct wlr_box *box) {
+  if (workspace->num_floating == workspace->floating_capacity) {
+    uint32_t capacity = workspace->floating_capacity == 0
+                            ? 8
+                            : workspace->floating_capacity * 2;
+    workspace->floating =
+        realloc(workspace->floating, capacity * sizeof(struct floating *));
+    workspace->hits =
+        realloc(workspace->hits, capacity * sizeof(struct floating *));
+    workspace->hit_views =
+        realloc(workspace->hit_views, capacity * sizeof(struct dgde_view *));
+    workspace->floating_capacity = capacity;
+  }
+
+  // new floating views go on top
+  struct floating *f = calloc(1, sizeof(struct floating));
+  f->view = view;
+  f->box = *box;
+  f->index = workspace->num_floating;
+  workspace->floating[workspace->num_floating++] = f;
+  dgde_grid_insert(workspace->grid, f, &f->box);
+
+  dgde_view_set_floating(view, true);
+  place_floating(f);
+  struct wlr_box geom = with_borders(&f->box);
+  dgde_view_set_size(view, (struct dgde_view_size){
+                               .width = geom.width,
+                               .height = geom.height,
+                           });
+  damage_box(workspace, &f->box);
+}
+
+static void remove_floating(struct dgde_workspace *workspace,
+                            struct floating *f) {
+  if (workspace->moving == f) {
+    workspace->moving = NULL;
+  }
+
+  dgde_grid_remove(workspace->grid, f, &f->box);
+  for (uint32_t i = f->index + 1, e = workspace->num_floating; i < e; ++i) {
+    workspace->floating[i - 1] = workspace->floating[i];
+    workspace->floating[i - 1]->index = i - 1;
+  }
+  --workspace->num_floating;
+
+  dgde_view_set_floating(f->view, false);
+  damage_box(workspace, &f->box);
+  free(f);
+}
+
+static void raise_floating(struct dgde_workspace *workspace,
+                           struct floating *f) {
+  uint32_t top = workspace->num_floating - 1;
+  if (f->index == top) {
+    return;
+  }
+
+  for (uint32_t i = f->index; i < top; ++i) {
+    workspace->floating[i] = workspace->floating[i + 1];
+    workspace->floating[i]->index = i;
+  }
+  workspace->floating[top] = f;
+  f->index = top;
+
+  damage_box(workspace, &f->box);
+}
+
+struct point_query {
+  const struct dgde_cursor_position *pos;
+  struct floating **hits;
+  uint32_t num_hits;
+};
+
+static void floating_contains(void *item, void *data) {
+  struct floating *f = item;
+  struct point_query *q = data;
+  if (dgde_view_is_mapped(f->view) &&
+      wlr_box_contains_point(&f->box, q->pos->x, q->pos->y)) {
+    q->hits[q->num_hits++] = f;
+  }
+}
+
+static int compare_stacking(const void *a, const void *b) {
+  const struct floating *fa = *(struct floating *const *)a;
+  const struct floating *fb = *(struct floating *const *)b;
+  // topmost first
+  return fa->index < fb->index ? 1 : fa->index > fb->index ? -1 : 0;
+}
+
+static uint32_t floating_at(struct dgde_workspace *workspace,
+                            const struct dgde_cursor_position *pos) {
+  /* A point is only ever in a single cell of the grid, so no view is
+   * reported twice. The few views sharing the cell are put in stacking
+   * order. */
+  struct point_query q = {.pos = pos, .hits = workspace->hits};
+  if (workspace->num_floating > 0) {
+    dgde_grid_query_point(workspace->grid, pos->x, pos->y, floating_contains,
+                          &q);
+  }
+  qsort(q.hits, q.num_hits, sizeof(struct floating *), compare_stacking);
+
+  return q.num_hits;
+}
+
+static struct dgde_view *view_at(struct dgde_workspace *workspace,
+                                 const struct dgde_cursor_position *pos,
+                                 struct wlr_surface **surface, double *sx,
+                                 double *sy) {
+  uint32_t num_hits = floating_at(workspace, pos);
+  if (num_hits == 0) {
+    struct node *node = leaf_at(workspace, pos);
+    if (node == NULL || node->view == NULL) {
+      return NULL;
+    }
+
+    return dgde_view_at(&node->view, 1, pos->x, pos->y, surface, sx, sy);
+  }
+
+  // the decorations of the topmost view hide everything below them
+  struct wlr_box inner = with_borders(&workspace->hits[0]->box);
+  if (!wlr_box_contains_point(&inner, pos->x, pos->y)) {
+    return NULL;
+  }
+
+  for (uint32_t i = 0; i < num_hits; ++i) {
+    workspace->hit_views[i] = workspace->hits[i]->view;
+  }
+  return dgde_view_at(workspace->hit_views, num_hits, pos->x, pos->y, surface,
+                      sx, sy);
+}
+
+static void begin_move(struct dgde_workspace *workspace, struct floating *f,
+                       const struct dgde_cursor_position *pos) {
+  wlr_log(WLR_DEBUG, "moving floating view on workspace %s", workspace->name);
+  workspace->moving = f;
+  workspace->grab_x = pos->x - f->box.x;
+  workspace->grab_y = pos->y - f->box.y;
+}
+
+static void drag_floating(struct dgde_workspace *workspace,
+                          const struct dgde_cursor_position *pos) {
+  struct floating *f = workspace->moving;
+  int x = pos->x - workspace->grab_x;
+  int y = pos->y - workspace->grab_y;
+  if (x == f->box.x && y == f->box.y) {
+    return;
+  }
+
+  damage_box(workspace, &f->box);
+  dgde_grid_remove(workspace->grid, f, &f->box);
+  f->box.x = x;
+  f->box.y = y;
+  dgde_grid_insert(workspace->grid, f, &f->box);
+  place_floating(f);
+  damage_box(workspace, &f->box);
+}
+
+struct cover_query {
+  struct dgde_workspace *workspace;
+  // only views stacked at or above this index cover anything
+  uint32_t above;
+  pixman_region32_t covered;
+};
+
+static void add_cover(void *item, void *data) {
+  struct floating *f = item;
+  struct cover_query *q = data;
+  if (f->stamp == q->workspace->query_stamp || f->index < q->above ||
+      !dgde_view_is_mapped(f->view)) {
+    return;
+  }
+  f->stamp = q->workspace->query_stamp;
+
+  // the decorations are opaque, the view only where the client says so
+  struct wlr_box inner = with_borders(&f->box);
+  pixman_region32_t opaque, hole;
+  pixman_region32_init_rect(&opaque, f->box.x, f->box.y, f->box.width,
+                            f->box.height);
+  pixman_region32_init_rect(&hole, inner.x, inner.y, inner.width,
+                            inner.height);
+  pixman_region32_subtract(&opaque, &opaque, &hole);
+  dgde_view_add_opaque_region(f->view, &opaque);
+  pixman_region32_union(&q->covered, &q->covered, &opaque);
+  pixman_region32_fini(&hole);
+  pixman_region32_fini(&opaque);
+}
+
+static bool is_occluded(struct dgde_workspace *workspace,
+                        const struct wlr_box *box, uint32_t above) {
+  if (above >= workspace->num_floating) {
+    return false;
+  }
+
+  /* Views spanning several cells are reported once per cell, the stamp
+   * makes sure that each of them is only added once. */
+  ++workspace->query_stamp;
+  struct cover_query q = {.workspace = workspace, .above = above};
+  pixman_region32_init(&q.covered);
+  dgde_grid_query_box(workspace->grid, box, add_cover, &q);
+
+  pixman_box32_t rect = {
+      .x1 = box->x,
+      .y1 = box->y,
+      .x2 = box->x + box->width,
+      .y2 = box->y + box->height,
+  };
+  bool occluded =
+      pixman_region32_contains_rectangle(&q.covered, &rect) == PIXMAN_REGION_IN;
+  pixman_region32_fini(&q.covered);
+
+  return occluded;
+}
+
+static void update_node_occlusion(struct node *node, void *data) {
+  node->occluded = is_occluded(data, &node->geom, 0);
+}
+
+static void update_occlusion(struct dgde_workspace *workspace) {
+  /* Anything completely covered by opaque floating views above it doesn't
+   * need to be drawn at all. */
+  iter_nodes(workspace->root, update_node_occlusion, workspace);
+  for (uint32_t i = 0, e = workspace->num_floating; i < e; ++i) {
+    struct floating *f = workspace->floating[i];
+    f->occluded = is_occluded(workspace, &f->box, i + 1);
   }
 }
 
 void dgde_workspace_on_cursor_motion(struct dgde_workspace *workspace,
                                      struct dgde_cursor *cursor,
+                                     struct dgde_cursor_position pos,
                                      struct wlr_event_pointer_motion *event) {
 
   uint32_t time = event->time_msec;
-
-  // find the view under the cursor
-  double sx, sy;
   struct wlr_seat *seat = workspace->seat;
-  struct dgde_cursor_position pos = dgde_cursor_position(cursor);
-  struct node_intersection intersection_result = (struct node_intersection){
-      .node = NULL,
-      .pos = &pos,
-  };
-  iter_nodes(workspace->root, node_intersects, &intersection_result);
 
-  struct dgde_view *view = NULL;
-  if (intersection_result.node != NULL) {
-    view = intersection_result.node->view;
+  workspace->cursor_pos = pos;
+
+  if (workspace->resizing != NULL) {
+    drag_split(workspace, &pos);
+    return;
+  }
+
+  if (workspace->moving != NULL) {
+    drag_floating(workspace, &pos);
+    return;
   }
 
-  if (!view) {
+  // find the view under the cursor
+  double sx, sy;
+  struct wlr_surface *surface = NULL;
+  view_at(workspace, &pos, &surface, &sx, &sy);
+
+  if (!surface) {
     /* If there's no view under the cursor, set the cursor image to a
      * default. This is what makes the cursor image appear when you move it
      * around the screen, not over any views. */
     dgde_cursor_set_image(cursor, "left_ptr");
+    /* Clear pointer focus so future button events and such are not sent to
+     * the last client to have the cursor over it. */
+    wlr_seat_pointer_clear_focus(seat);
   } else {
-    struct wlr_surface *surface =
-        dgde_view_surface_at(view, pos.x, pos.y, &sx, &sy);
     bool focus_changed = seat->pointer_state.focused_surface != surface;
     /*
      * "Enter" the surface if necessary. This lets the client know that the
@@ -290,31 +853,108 @@ void dgde_workspace_on_cursor_motion(struct dgde_workspace *workspace,
        * on motion if the focus did not change. */
       wlr_seat_pointer_notify_motion(seat, time, sx, sy);
     }
-    /* Clear pointer focus so future button events and such are not sent to
-     * the last client to have the cursor over it. */
-    wlr_seat_pointer_clear_focus(seat);
   }
 }
 
-void dgde_workspace_on_cursor_button(struct dgde_workspace *workspace,
+bool dgde_workspace_on_cursor_button(struct dgde_workspace *workspace,
                                      struct dgde_cursor *cursor,
+                                     struct dgde_cursor_position pos,
                                      struct wlr_event_pointer_button *event) {
-  struct dgde_cursor_position pos = dgde_cursor_position(cursor);
-  struct dgde_view *view = NULL;
+  if (event->state == WLR_BUTTON_RELEASED) {
+    if (workspace->moving != NULL) {
+      workspace->moving = NULL;
+      return !workspace->grab_by_client;
+    }
 
-  struct node_intersection intersection_result = (struct node_intersection){
-      .node = NULL,
-      .pos = &pos,
-  };
-  iter_nodes(workspace->root, node_intersects, &intersection_result);
+    if (workspace->resizing == NULL) {
+      return false;
+    }
+
+    end_resize(workspace);
+    return !workspace->grab_by_client;
+  }
+
+  // floating views are above the tree and get the button first
+  if (floating_at(workspace, &pos) > 0) {
+    struct floating *f = workspace->hits[0];
+    raise_floating(workspace, f);
+
+    // pressing on the decorations starts moving the view
+    struct wlr_box inner = with_borders(&f->box);
+    if (!wlr_box_contains_point(&inner, pos.x, pos.y)) {
+      dgde_cursor_set_mode(cursor, DgdeCursor_Move);
+      begin_move(workspace, f, &pos);
+      workspace->grab_by_client = false;
+      return true;
+    }
 
-  if (intersection_result.node != NULL) {
-    view = intersection_result.node->view;
+    dgde_view_focus(f->view);
+    return false;
   }
 
-  if (view != NULL && event->state == WLR_BUTTON_PRESSED) {
-    // focus the client if the button was pressed
-    dgde_view_focus(view);
+  struct node *node = leaf_at(workspace, &pos);
+  if (node == NULL || node->view == NULL) {
+    return false;
+  }
+
+  // pressing on the border between two views starts resizing them
+  struct wlr_box inner = dgde_view_geometry(node->view);
+  struct dgde_view_position view_pos = dgde_view_position(node->view);
+  inner.x = view_pos.x;
+  inner.y = view_pos.y;
+  struct node *split = NULL;
+  if (!wlr_box_contains_point(&inner, pos.x, pos.y)) {
+    split = split_at(node, &pos);
+  }
+
+  if (split != NULL) {
+    dgde_cursor_set_mode(cursor, DgdeCursor_Resize);
+    begin_resize(workspace, split);
+    workspace->grab_by_client = false;
+    return true;
+  }
+
+  // focus the client if the button was pressed
+  dgde_view_focus(node->view);
+  return false;
+}
+
+bool dgde_workspace_has_grab(const struct dgde_workspace *workspace) {
+  return workspace->resizing != NULL || workspace->moving != NULL;
+}
+
+static void view_interaction(struct dgde_workspace *workspace,
+                             struct dgde_view *view,
+                             enum dgde_cursor_mode mode, uint32_t edges) {
+  if (workspace->resizing != NULL || workspace->moving != NULL) {
+    return;
+  }
+
+  struct floating *f = find_floating(workspace, view);
+  if (f != NULL) {
+    // floating views can only be moved, their size is up to the client
+    if (mode == DgdeCursor_Move) {
+      raise_floating(workspace, f);
+      begin_move(workspace, f, &workspace->cursor_pos);
+      workspace->grab_by_client = true;
+    }
+    return;
+  }
+
+  if (mode != DgdeCursor_Resize) {
+    return;
+  }
+
+  struct find_view_data result = {.view = view, .node = NULL};
+  iter_nodes(workspace->root, find_view, &result);
+  if (result.node == NULL) {
+    return;
+  }
+
+  struct node *split = split_for_edges(result.node, edges);
+  if (split != NULL) {
+    begin_resize(workspace, split);
+    workspace->grab_by_client = true;
   }
 }
 
@@ -322,7 +962,9 @@ struct rdata {
   struct wlr_output *output;
   struct wlr_output_layout *layout;
   struct wlr_renderer *renderer;
+  struct dgde_glyph_atlas *atlas;
   struct timespec now;
+  struct dgde_render_list *list;
 };
 
 static void darken(const float in[4], float *result, float amount) {
@@ -339,51 +981,387 @@ static void lighten(const float in[4], float *result, float amount) {
   result[3] = in[3];
 }
 
-static void render_node(struct node *node, void *data) {
-  struct rdata *rdata = data;
+struct decoration_colors {
+  float base[4];
+  float text[4];
+  float dark[4];
+  float light[4];
+};
 
-  struct wlr_box b = {
-      .x = node->geom.x,
-      .y = node->geom.y,
-      .width = node->geom.width,
-      .height = node->geom.height,
+static struct decoration_colors decoration_colors(void) {
+  // TODO: Configuration for this
+  struct decoration_colors c = {
+      .base = {0.f, 0.5f, 0.f, 1.f},
+      .text = {1.f, 1.f, 1.f, 1.f},
   };
+  darken(c.base, c.dark, 0.4);
+  lighten(c.base, c.light, 0.2);
 
-  // TODO: Configuration for this
-  float base[4] = {0.f, 0.5f, 0.f, 1.f};
-  float text[4] = {1.f, 1.f, 1.f, 1.f};
-  float dark[4];
-  darken(base, dark, 0.4);
+  return c;
+}
 
-  float light[4];
-  lighten(base, light, 0.2);
+static void render_decorated(const struct wlr_box *geom,
+                             struct dgde_view *view, struct rdata *rdata) {
+  struct decoration_colors c = decoration_colors();
+  const float *colors[4] = {c.base, c.text, c.dark, c.light};
+  decorate_window(geom, dgde_view_title_text(view), rdata->atlas,
+                  rdata->renderer, rdata->output->transform_matrix, colors);
+  dgde_view_render(view, rdata->output, rdata->layout, &rdata->now);
+}
+
+static void collect_decorated(const struct wlr_box *geom,
+                              struct dgde_view *view, struct rdata *rdata) {
+  struct decoration_colors c = decoration_colors();
+  const float *colors[4] = {c.base, c.text, c.dark, c.light};
+  decorate_window_collect(geom, dgde_view_title_text(view), rdata->atlas,
+                          rdata->list, colors);
+  dgde_view_collect(view, rdata->output, rdata->layout, &rdata->now,
+                    rdata->list);
+}
 
-  const float *colors[4] = {base, text, dark, light};
-  decorate_window(&b, rdata->renderer, rdata->output->transform_matrix, colors);
-  dgde_view_render(node->view, rdata->output, rdata->layout, &rdata->now);
+static void render_node(struct node *node, void *data) {
+  if (!node->occluded) {
+    render_decorated(&node->geom, node->view, data);
+  }
+}
+
+static void collect_node(struct node *node, void *data) {
+  if (!node->occluded) {
+    collect_decorated(&node->geom, node->view, data);
+  }
 }
 
 void dgde_workspace_render(struct dgde_workspace *workspace,
                            struct wlr_renderer *renderer,
+                           struct dgde_glyph_atlas *atlas,
                            struct wlr_output *output,
                            struct wlr_output_layout *layout,
                            struct timespec now) {
 
-  struct rdata data = {
-      .now = now, .layout = layout, .output = output, .renderer = renderer};
+  struct rdata data = {.now = now,
+                       .layout = layout,
+                       .output = output,
+                       .renderer = renderer,
+                       .atlas = atlas};
+  update_occlusion(workspace);
   iter_nodes(workspace->root, render_node, &data);
+
+  for (uint32_t i = 0, e = workspace->num_floating; i < e; ++i) {
+    struct floating *f = workspace->floating[i];
+    if (dgde_view_is_mapped(f->view) && !f->occluded) {
+      render_decorated(&f->box, f->view, &data);
+    }
+  }
 }
 
-void dgde_workspace_add_view(struct dgde_workspace *workspace,
-                             struct wlr_xdg_surface *surface) {
-  /* Allocate a view for this surface */
-  struct dgde_view *view = dgde_view_create(surface, workspace->seat);
+void dgde_workspace_collect(struct dgde_workspace *workspace,
+                            struct dgde_glyph_atlas *atlas,
+                            struct wlr_output *output,
+                            struct wlr_output_layout *layout,
+                            struct timespec now,
+                            struct dgde_render_list *list) {
+  struct rdata data = {.now = now,
+                       .layout = layout,
+                       .output = output,
+                       .list = list,
+                       .atlas = atlas};
+  update_occlusion(workspace);
+  iter_nodes(workspace->root, collect_node, &data);
+
+  for (uint32_t i = 0, e = workspace->num_floating; i < e; ++i) {
+    struct floating *f = workspace->floating[i];
+    if (dgde_view_is_mapped(f->view) && !f->occluded) {
+      collect_decorated(&f->box, f->view, &data);
+    }
+  }
+}
+
+static void frame_done_node(struct node *node, void *data) {
+  dgde_view_send_frame_done(node->view, data);
+}
+
+void dgde_workspace_send_frame_done(struct dgde_workspace *workspace,
+                                    struct timespec now) {
+  iter_nodes(workspace->root, frame_done_node, &now);
+  for (uint32_t i = 0, e = workspace->num_floating; i < e; ++i) {
+    dgde_view_send_frame_done(workspace->floating[i]->view, &now);
+  }
+}
 
-  // Add it to the list of views.
+static void remove_node(struct node *node) {
+  struct node *parent = node->parent;
+  node->view = NULL;
+
+  // the root node is kept around even if it is empty
+  if (parent == NULL) {
+    return;
+  }
+
+  // the sibling takes over the space of the parent
+  struct node *sibling = parent->left == node ? parent->right : parent->left;
+  parent->view = sibling->view;
+  parent->left = sibling->left;
+  parent->right = sibling->right;
+  parent->split = sibling->split;
+  parent->ratio = sibling->ratio;
+  if (parent->left != NULL) {
+    parent->left->parent = parent;
+  }
+  if (parent->right != NULL) {
+    parent->right->parent = parent;
+  }
+
+  free(sibling);
+  free(node);
+}
+
+static void view_damage(struct dgde_workspace *workspace,
+                        struct dgde_view *view, pixman_region32_t *damage) {
+  damage_workspace(workspace, damage);
+}
+
+static void view_title(struct dgde_workspace *workspace,
+                       struct dgde_view *view) {
+  // only the titlebar shows the title
+  struct wlr_box box;
+  struct floating *f = find_floating(workspace, view);
+  if (f != NULL) {
+    box = f->box;
+  } else {
+    struct find_view_data result = {.view = view, .node = NULL};
+    iter_nodes(workspace->root, find_view, &result);
+    if (result.node == NULL) {
+      return;
+    }
+    box = result.node->geom;
+  }
+
+  box.height = DECORATION_SIZE[0];
+  damage_box(workspace, &box);
+}
+
+static void untile_view(struct dgde_workspace *workspace, struct node *node) {
+  // the split being dragged might go away with the node
+  if (workspace->resizing != NULL) {
+    end_resize(workspace);
+  }
+
+  wlr_log(WLR_DEBUG, "removing view from tree on workspace %s",
+          workspace->name);
+  remove_node(node);
+
+  // the remaining views get the space
+  dgde_trace_begin("layout", 0);
+  DGDE_PROBE(layout_begin, workspace, workspace->root->geom.width,
+             workspace->root->geom.height);
+  iter_all_nodes(workspace->root, resize_node, NULL);
+  DGDE_PROBE(layout_end, workspace);
+  dgde_trace_end("layout");
+  damage_workspace(workspace, NULL);
+}
+
+static void tile_view(struct dgde_workspace *workspace,
+                      struct dgde_view *view) {
   wlr_log(WLR_DEBUG, "inserting new view into tree on workspace %s",
           workspace->name);
   insert_node(workspace->root, view);
 
   // tree is dirty, need to resize all windows
+  dgde_trace_begin("layout", 0);
+  DGDE_PROBE(layout_begin, workspace, workspace->root->geom.width,
+             workspace->root->geom.height);
   iter_nodes(workspace->root, resize_view, NULL);
+  DGDE_PROBE(layout_end, workspace);
+  dgde_trace_end("layout");
+  damage_workspace(workspace, NULL);
+}
+
+static void float_view(struct dgde_workspace *workspace, struct node *node) {
+  struct dgde_view *view = node->view;
+  untile_view(workspace, node);
+
+  wlr_log(WLR_DEBUG, "floating view on workspace %s", workspace->name);
+  struct wlr_box box = floating_box(workspace, view);
+  add_floating(workspace, view, &box);
+}
+
+static void view_mapped(struct dgde_workspace *workspace,
+                        struct dgde_view *view) {
+  /* Whether a view wants to float is only known once the client has set up
+   * its parent and size limits, which it does before the first commit. */
+  if (dgde_view_is_mapped(view) && !dgde_view_is_floating(view) &&
+      dgde_view_wants_floating(view)) {
+    struct find_view_data result = {.view = view, .node = NULL};
+    iter_nodes(workspace->root, find_view, &result);
+    if (result.node != NULL) {
+      float_view(workspace, result.node);
+    }
+  }
+
+  damage_workspace(workspace, NULL);
+}
+
+static void view_destroyed(struct dgde_workspace *workspace,
+                           struct dgde_view *view) {
+  struct floating *f = find_floating(workspace, view);
+  if (f != NULL) {
+    remove_floating(workspace, f);
+    return;
+  }
+
+  struct find_view_data result = {.view = view, .node = NULL};
+  iter_nodes(workspace->root, find_view, &result);
+  if (result.node != NULL) {
+    untile_view(workspace, result.node);
+  }
+}
+
+static void register_view(struct dgde_workspace *workspace,
+                          struct dgde_view *view) {
+  struct dgde_view_handler handler = {
+      .userdata = workspace,
+      .map = (dgde_view_cb)view_mapped,
+      .unmap = (dgde_view_cb)view_mapped,
+      .destroy = (dgde_view_cb)view_destroyed,
+      .damage = (dgde_view_damage_cb)view_damage,
+      .title = (dgde_view_cb)view_title,
+  };
+  dgde_view_add_handler(view, &handler);
+  dgde_view_add_interaction_handler(
+      view, (dgde_view_interaction_handler)view_interaction, workspace);
+  dgde_view_set_visible(view, workspace->output, workspace->visible);
+}
+
+void dgde_workspace_add_view(struct dgde_workspace *workspace,
+                             struct dgde_view *view) {
+  register_view(workspace, view);
+
+  // X11 windows come in mapped, they already know whether they want to float
+  if (dgde_view_is_mapped(view) && dgde_view_wants_floating(view)) {
+    wlr_log(WLR_DEBUG, "floating view on workspace %s", workspace->name);
+    struct wlr_box box = floating_box(workspace, view);
+    add_floating(workspace, view, &box);
+    return;
+  }
+  tile_view(workspace, view);
+}
+
+bool dgde_workspace_remove_view(struct dgde_workspace *workspace,
+                                struct dgde_view *view) {
+  struct find_view_data result = {.view = view, .node = NULL};
+  iter_nodes(workspace->root, find_view, &result);
+  if (result.node == NULL && find_floating(workspace, view) == NULL) {
+    return false;
+  }
+
+  view_destroyed(workspace, view);
+  dgde_view_remove_handlers(view, workspace);
+  dgde_view_set_visible(view, workspace->output, false);
+  return true;
+}
+
+bool dgde_workspace_toggle_floating(struct dgde_workspace *workspace,
+                                    struct dgde_view *view) {
+  if (workspace->resizing != NULL || workspace->moving != NULL) {
+    return false;
+  }
+
+  struct floating *f = find_floating(workspace, view);
+  if (f != NULL) {
+    remove_floating(workspace, f);
+    tile_view(workspace, view);
+    return true;
+  }
+
+  struct find_view_data result = {.view = view, .node = NULL};
+  iter_nodes(workspace->root, find_view, &result);
+  if (result.node == NULL) {
+    return false;
+  }
+
+  float_view(workspace, result.node);
+  return true;
+}
+
+struct for_each_view_data {
+  dgde_workspace_view_fn fn;
+  void *userdata;
+};
+
+static void for_each_view(struct node *node, void *data) {
+  struct for_each_view_data *d = data;
+  d->fn(node->view, d->userdata);
+}
+
+void dgde_workspace_for_each_view(struct dgde_workspace *workspace,
+                                  dgde_workspace_view_fn fn, void *userdata) {
+  struct for_each_view_data data = {.fn = fn, .userdata = userdata};
+  iter_nodes(workspace->root, for_each_view, &data);
+
+  // floating views come last, from bottom to top
+  for (uint32_t i = 0, e = workspace->num_floating; i < e; ++i) {
+    fn(workspace->floating[i]->view, userdata);
+  }
+}
+
+struct view_array {
+  struct dgde_view **views;
+  uint32_t num_views;
+};
+
+static void count_view(struct node *node, void *data) {
+  struct view_array *views = data;
+  ++views->num_views;
+}
+
+static void collect_view(struct node *node, void *data) {
+  struct view_array *views = data;
+  views->views[views->num_views++] = node->view;
+}
+
+void dgde_workspace_move_views(struct dgde_workspace *from,
+                               struct dgde_workspace *to) {
+  struct view_array views = {0};
+  iter_nodes(from->root, count_view, &views);
+
+  if (from->resizing != NULL) {
+    end_resize(from);
+  }
+  from->moving = NULL;
+
+  // the tree can't be modified while iterating it
+  if (views.num_views > 0) {
+    views.views = calloc(views.num_views, sizeof(struct dgde_view *));
+    views.num_views = 0;
+    iter_nodes(from->root, collect_view, &views);
+  }
+
+  free_nodes(from->root->left);
+  free_nodes(from->root->right);
+  from->root->left = NULL;
+  from->root->right = NULL;
+  from->root->view = NULL;
+  damage_workspace(from, NULL);
+
+  wlr_log(WLR_DEBUG, "moving %d tiled and %d floating views from workspace %s "
+                     "to %s",
+          views.num_views, from->num_floating, from->name, to->name);
+  for (uint32_t i = 0; i < views.num_views; ++i) {
+    dgde_view_remove_handlers(views.views[i], from);
+    register_view(to, views.views[i]);
+    tile_view(to, views.views[i]);
+  }
+
+  // floating views keep their place and stacking order
+  for (uint32_t i = 0, e = from->num_floating; i < e; ++i) {
+    struct floating *f = from->floating[i];
+    dgde_grid_remove(from->grid, f, &f->box);
+    dgde_view_remove_handlers(f->view, from);
+    register_view(to, f->view);
+    add_floating(to, f->view, &f->box);
+    free(f);
+  }
+  from->num_floating = 0;
+
+  free(views.views);
 }
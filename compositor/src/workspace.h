@@ -4,6 +4,7 @@
 #include "cursor.h"
 #include "src/server.h"
 
+#include <pixman.h>
 #include <stdint.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_xdg_shell.h>
@@ -19,23 +20,90 @@ struct dgde_workspace *dgde_workspace_create(const char *display_name,
 void dgde_workspace_resize(struct dgde_workspace *workspace,
                            const uint32_t width, const uint32_t height);
 
+/* Damage is in workspace coordinates, NULL means the whole workspace. */
+typedef void (*dgde_workspace_damage_cb)(void *, struct dgde_workspace *,
+                                         pixman_region32_t *);
+void dgde_workspace_set_damage_handler(struct dgde_workspace *workspace,
+                                       dgde_workspace_damage_cb handler,
+                                       void *userdata);
+
 void dgde_workspace_destroy(struct dgde_workspace *workspace);
 
+const char *dgde_workspace_name(const struct dgde_workspace *workspace);
+
+/* Views on hidden workspaces leave the output and get no frame callbacks, so
+ * clients stop drawing and we stop uploading their buffers. */
+void dgde_workspace_set_visible(struct dgde_workspace *workspace,
+                                struct wlr_output *output, bool visible);
+
+/* Shrinks the views of a hidden workspace to small snapshots, see
+ * dgde_view_evict. */
+void dgde_workspace_evict(struct dgde_workspace *workspace);
+
+/* Cursor positions are in workspace coordinates. */
 void dgde_workspace_on_cursor_motion(struct dgde_workspace *workspace,
                                      struct dgde_cursor *cursor,
+                                     struct dgde_cursor_position pos,
                                      struct wlr_event_pointer_motion *event);
 
-void dgde_workspace_on_cursor_button(struct dgde_workspace *workspace,
+/* Returns true if the workspace used the button itself, e.g. to start
+ * resizing the split between two views by dragging their borders. Releases
+ * ending a move or resize started by a client are passed on to it. */
+bool dgde_workspace_on_cursor_button(struct dgde_workspace *workspace,
                                      struct dgde_cursor *cursor,
+                                     struct dgde_cursor_position pos,
                                      struct wlr_event_pointer_button *event);
 
+/* Motion and button events should go to a workspace that is resizing a split
+ * or moving a floating view until the button is released, even if the cursor
+ * leaves its output. */
+bool dgde_workspace_has_grab(const struct dgde_workspace *workspace);
+
+struct dgde_glyph_atlas;
 void dgde_workspace_render(struct dgde_workspace *workspace,
                            struct wlr_renderer *renderer,
+                           struct dgde_glyph_atlas *atlas,
                            struct wlr_output *output,
                            struct wlr_output_layout *layout,
                            struct timespec now);
 
+/* Collects everything dgde_workspace_render would draw into a render list for
+ * the tiled compositor. */
+struct dgde_render_list;
+void dgde_workspace_collect(struct dgde_workspace *workspace,
+                            struct dgde_glyph_atlas *atlas,
+                            struct wlr_output *output,
+                            struct wlr_output_layout *layout,
+                            struct timespec now,
+                            struct dgde_render_list *list);
+
+void dgde_workspace_send_frame_done(struct dgde_workspace *workspace,
+                                    struct timespec now);
+
+struct dgde_view;
+/* Takes a view, xdg toplevels when they are created and X11 windows when
+ * they are mapped. */
 void dgde_workspace_add_view(struct dgde_workspace *workspace,
-                             struct wlr_xdg_surface *surface);
+                             struct dgde_view *view);
+
+/* Gives the space of the view to the others, e.g. when an X11 window is
+ * unmapped. The view itself stays around. Returns false if the view is not
+ * on the workspace. */
+bool dgde_workspace_remove_view(struct dgde_workspace *workspace,
+                                struct dgde_view *view);
+
+/* Floating views are stacked above the tree in the order they were last
+ * clicked. Returns false if the view is not on the workspace. */
+bool dgde_workspace_toggle_floating(struct dgde_workspace *workspace,
+                                    struct dgde_view *view);
+
+typedef void (*dgde_workspace_view_fn)(struct dgde_view *, void *);
+void dgde_workspace_for_each_view(struct dgde_workspace *workspace,
+                                  dgde_workspace_view_fn fn, void *userdata);
+
+/* Moves all views from one workspace into the tree of another, leaving the
+ * first one empty. */
+void dgde_workspace_move_views(struct dgde_workspace *from,
+                               struct dgde_workspace *to);
 
 #endif
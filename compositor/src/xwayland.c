@@ -0,0 +1,294 @@
+#define _POSIX_C_SOURCE 200809L
+#include "xwayland.h"
+#include "composite.h"
+#include "view.h"
+
+#include <stdlib.h>
+
+#include <wlr/render/pixman.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/util/log.h>
+#include <wlr/xwayland.h>
+
+struct dgde_xwayland {
+  struct wlr_xwayland *wlr_xwayland;
+  struct wlr_seat *seat;
+  struct dgde_xwayland_handler handler;
+
+  struct wl_listener new_surface;
+
+  // mapped override-redirect windows, from bottom to top
+  struct wl_list unmanaged;
+};
+
+struct unmanaged {
+  struct dgde_xwayland *xwayland;
+  struct wlr_xwayland_surface *surface;
+  struct wl_list link;
+
+  // where it was drawn last, damaged when it moves or goes away
+  struct wlr_box box;
+
+  struct wl_listener map;
+  struct wl_listener unmap;
+  struct wl_listener destroy;
+  struct wl_listener commit;
+  struct wl_listener request_configure;
+};
+
+/* Managed windows only take up space on a workspace while they are mapped,
+ * toolkits create windows that never are. */
+struct managed {
+  struct dgde_xwayland *xwayland;
+  struct dgde_view *view;
+
+  struct wl_listener map;
+  struct wl_listener unmap;
+  struct wl_listener destroy;
+};
+
+static struct wlr_box unmanaged_box(const struct unmanaged *u) {
+  return (struct wlr_box){
+      .x = u->surface->x,
+      .y = u->surface->y,
+      .width = u->surface->surface->current.width,
+      .height = u->surface->surface->current.height,
+  };
+}
+
+static void emit_damage(struct dgde_xwayland *xwayland,
+                        const struct wlr_box *box) {
+  if (xwayland->handler.damage != NULL) {
+    xwayland->handler.damage(xwayland->handler.userdata, box);
+  }
+}
+
+static void unmanaged_commit(struct wl_listener *listener, void *data) {
+  /* Menus and tooltips are small, they are redrawn as a whole. */
+  struct unmanaged *u = wl_container_of(listener, u, commit);
+  struct wlr_box box = unmanaged_box(u);
+  if (box.x != u->box.x || box.y != u->box.y || box.width != u->box.width ||
+      box.height != u->box.height) {
+    emit_damage(u->xwayland, &u->box);
+    u->box = box;
+  }
+  emit_damage(u->xwayland, &u->box);
+}
+
+static void unmanaged_map(struct wl_listener *listener, void *data) {
+  struct unmanaged *u = wl_container_of(listener, u, map);
+  wl_list_insert(u->xwayland->unmanaged.prev, &u->link);
+  wl_signal_add(&u->surface->surface->events.commit, &u->commit);
+
+  u->box = unmanaged_box(u);
+  emit_damage(u->xwayland, &u->box);
+}
+
+static void unmanaged_unmap(struct wl_listener *listener, void *data) {
+  struct unmanaged *u = wl_container_of(listener, u, unmap);
+  emit_damage(u->xwayland, &u->box);
+
+  wl_list_remove(&u->link);
+  wl_list_init(&u->link);
+  wl_list_remove(&u->commit.link);
+  wl_list_init(&u->commit.link);
+}
+
+static void unmanaged_request_configure(struct wl_listener *listener,
+                                        void *data) {
+  /* Override-redirect windows place themselves, whatever they ask for is
+   * what they get. */
+  struct unmanaged *u = wl_container_of(listener, u, request_configure);
+  struct wlr_xwayland_surface_configure_event *event = data;
+  wlr_xwayland_surface_configure(u->surface, event->x, event->y, event->width,
+                                 event->height);
+}
+
+static void unmanaged_destroy(struct wl_listener *listener, void *data) {
+  struct unmanaged *u = wl_container_of(listener, u, destroy);
+  wl_list_remove(&u->link);
+  wl_list_remove(&u->commit.link);
+  wl_list_remove(&u->map.link);
+  wl_list_remove(&u->unmap.link);
+  wl_list_remove(&u->destroy.link);
+  wl_list_remove(&u->request_configure.link);
+  free(u);
+}
+
+static void unmanaged_create(struct dgde_xwayland *xwayland,
+                             struct wlr_xwayland_surface *surface) {
+  struct unmanaged *u = calloc(1, sizeof(struct unmanaged));
+  u->xwayland = xwayland;
+  u->surface = surface;
+  wl_list_init(&u->link);
+
+  u->map.notify = unmanaged_map;
+  wl_signal_add(&surface->events.map, &u->map);
+  u->unmap.notify = unmanaged_unmap;
+  wl_signal_add(&surface->events.unmap, &u->unmap);
+  u->destroy.notify = unmanaged_destroy;
+  wl_signal_add(&surface->events.destroy, &u->destroy);
+  u->request_configure.notify = unmanaged_request_configure;
+  wl_signal_add(&surface->events.request_configure, &u->request_configure);
+  u->commit.notify = unmanaged_commit;
+  wl_list_init(&u->commit.link);
+}
+
+static void managed_map(struct wl_listener *listener, void *data) {
+  struct managed *m = wl_container_of(listener, m, map);
+  m->xwayland->handler.map(m->xwayland->handler.userdata, m->view);
+}
+
+static void managed_unmap(struct wl_listener *listener, void *data) {
+  struct managed *m = wl_container_of(listener, m, unmap);
+  m->xwayland->handler.unmap(m->xwayland->handler.userdata, m->view);
+}
+
+static void managed_destroy(struct wl_listener *listener, void *data) {
+  struct managed *m = wl_container_of(listener, m, destroy);
+  wl_list_remove(&m->map.link);
+  wl_list_remove(&m->unmap.link);
+  wl_list_remove(&m->destroy.link);
+  free(m);
+}
+
+static void managed_create(struct dgde_xwayland *xwayland,
+                           struct wlr_xwayland_surface *surface) {
+  struct managed *m = calloc(1, sizeof(struct managed));
+  m->xwayland = xwayland;
+  m->view = dgde_view_create_xwayland(surface, xwayland->seat);
+  xwayland->handler.new_view(xwayland->handler.userdata, m->view);
+
+  // after the listeners of the view, which is mapped by the time these run
+  m->map.notify = managed_map;
+  wl_signal_add(&surface->events.map, &m->map);
+  m->unmap.notify = managed_unmap;
+  wl_signal_add(&surface->events.unmap, &m->unmap);
+  m->destroy.notify = managed_destroy;
+  wl_signal_add(&surface->events.destroy, &m->destroy);
+}
+
+static void new_surface(struct wl_listener *listener, void *data) {
+  /* Raised for every X11 window, including the ones that are never mapped
+   * like the hidden leader windows of toolkits. */
+  struct dgde_xwayland *xwayland =
+      wl_container_of(listener, xwayland, new_surface);
+  struct wlr_xwayland_surface *surface = data;
+
+  if (surface->override_redirect) {
+    unmanaged_create(xwayland, surface);
+    return;
+  }
+
+  managed_create(xwayland, surface);
+}
+
+struct dgde_xwayland *
+dgde_xwayland_create(struct wl_display *display,
+                     struct wlr_compositor *compositor, struct wlr_seat *seat,
+                     const struct dgde_xwayland_handler *handler) {
+  /* Lazy means that only the sockets are set up now, the X server is started
+   * when a client connects to one of them. */
+  struct wlr_xwayland *wlr_xwayland =
+      wlr_xwayland_create(display, compositor, true);
+  if (wlr_xwayland == NULL) {
+    wlr_log(WLR_ERROR, "failed to set up Xwayland, X11 clients won't work");
+    return NULL;
+  }
+
+  struct dgde_xwayland *xwayland = calloc(1, sizeof(struct dgde_xwayland));
+  xwayland->wlr_xwayland = wlr_xwayland;
+  xwayland->seat = seat;
+  xwayland->handler = *handler;
+  wl_list_init(&xwayland->unmanaged);
+
+  xwayland->new_surface.notify = new_surface;
+  wl_signal_add(&wlr_xwayland->events.new_surface, &xwayland->new_surface);
+  wlr_xwayland_set_seat(wlr_xwayland, seat);
+
+  wlr_log(WLR_INFO, "X11 clients can connect to DISPLAY=%s",
+          wlr_xwayland->display_name);
+  setenv("DISPLAY", wlr_xwayland->display_name, true);
+
+  return xwayland;
+}
+
+struct wlr_surface *dgde_xwayland_surface_at(struct dgde_xwayland *xwayland,
+                                             double lx, double ly, double *sx,
+                                             double *sy) {
+  struct unmanaged *u;
+  wl_list_for_each_reverse(u, &xwayland->unmanaged, link) {
+    struct wlr_surface *surface = wlr_surface_surface_at(
+        u->surface->surface, lx - u->box.x, ly - u->box.y, sx, sy);
+    if (surface != NULL) {
+      return surface;
+    }
+  }
+
+  return NULL;
+}
+
+static struct wlr_box output_box(const struct unmanaged *u,
+                                 struct wlr_output *output,
+                                 struct wlr_output_layout *layout) {
+  double ox = u->box.x, oy = u->box.y;
+  wlr_output_layout_output_coords(layout, output, &ox, &oy);
+
+  return (struct wlr_box){
+      .x = ox * output->scale,
+      .y = oy * output->scale,
+      .width = u->box.width * output->scale,
+      .height = u->box.height * output->scale,
+  };
+}
+
+void dgde_xwayland_render(struct dgde_xwayland *xwayland,
+                          struct wlr_renderer *renderer,
+                          struct wlr_output *output,
+                          struct wlr_output_layout *layout) {
+  struct unmanaged *u;
+  wl_list_for_each(u, &xwayland->unmanaged, link) {
+    struct wlr_texture *texture = wlr_surface_get_texture(u->surface->surface);
+    if (texture == NULL) {
+      continue;
+    }
+
+    struct wlr_box box = output_box(u, output, layout);
+    float matrix[9];
+    wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
+                           output->transform_matrix);
+    wlr_render_texture_with_matrix(renderer, texture, matrix, 1);
+  }
+}
+
+void dgde_xwayland_collect(struct dgde_xwayland *xwayland,
+                           struct wlr_output *output,
+                           struct wlr_output_layout *layout,
+                           struct dgde_render_list *list) {
+  struct unmanaged *u;
+  wl_list_for_each(u, &xwayland->unmanaged, link) {
+    struct wlr_texture *texture = wlr_surface_get_texture(u->surface->surface);
+    if (texture == NULL || !wlr_texture_is_pixman(texture)) {
+      continue;
+    }
+
+    struct wlr_box box = output_box(u, output, layout);
+    dgde_render_list_add_image(list, &box,
+                               wlr_pixman_texture_get_image(texture), NULL);
+  }
+}
+
+void dgde_xwayland_send_frame_done(struct dgde_xwayland *xwayland,
+                                   const struct timespec *now) {
+  struct unmanaged *u;
+  wl_list_for_each(u, &xwayland->unmanaged, link) {
+    wlr_surface_send_frame_done(u->surface->surface, now);
+  }
+}
+
+void dgde_xwayland_destroy(struct dgde_xwayland *xwayland) {
+  wl_list_remove(&xwayland->new_surface.link);
+  // destroys the remaining windows, and with them their views
+  wlr_xwayland_destroy(xwayland->wlr_xwayland);
+  free(xwayland);
+}
@@ -0,0 +1,63 @@
+#ifndef XWAYLAND_H
+#define XWAYLAND_H
+
+#include <time.h>
+
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_box.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_seat.h>
+
+/* X11 clients, through an Xwayland server that isn't started until the first
+ * X11 client connects to its socket, so sessions without X11 clients don't
+ * pay for it. Managed windows become views and go on workspaces like xdg
+ * toplevels. Override-redirect windows (menus, tooltips, drag icons) are
+ * drawn above everything at the position the client picked, without
+ * decorations or keyboard focus. */
+
+struct dgde_xwayland;
+struct dgde_view;
+struct dgde_render_list;
+
+typedef void (*dgde_xwayland_view_cb)(void *, struct dgde_view *);
+/* Damage of an override-redirect window, in layout coordinates. */
+typedef void (*dgde_xwayland_damage_cb)(void *, const struct wlr_box *);
+
+struct dgde_xwayland_handler {
+  void *userdata;
+  // a managed window was created, many are never mapped
+  dgde_xwayland_view_cb new_view;
+  // a managed window that should be put on a workspace, or taken off it
+  dgde_xwayland_view_cb map;
+  dgde_xwayland_view_cb unmap;
+  dgde_xwayland_damage_cb damage;
+};
+
+/* Sets DISPLAY for the clients we start. Returns NULL if the X11 sockets
+ * can't be created. */
+struct dgde_xwayland *
+dgde_xwayland_create(struct wl_display *display,
+                     struct wlr_compositor *compositor, struct wlr_seat *seat,
+                     const struct dgde_xwayland_handler *handler);
+
+/* Finds the topmost override-redirect window at the layout coordinates. */
+struct wlr_surface *dgde_xwayland_surface_at(struct dgde_xwayland *xwayland,
+                                             double lx, double ly, double *sx,
+                                             double *sy);
+
+void dgde_xwayland_render(struct dgde_xwayland *xwayland,
+                          struct wlr_renderer *renderer,
+                          struct wlr_output *output,
+                          struct wlr_output_layout *layout);
+void dgde_xwayland_collect(struct dgde_xwayland *xwayland,
+                           struct wlr_output *output,
+                           struct wlr_output_layout *layout,
+                           struct dgde_render_list *list);
+void dgde_xwayland_send_frame_done(struct dgde_xwayland *xwayland,
+                                   const struct timespec *now);
+
+/* Has to be called before the display is destroyed. */
+void dgde_xwayland_destroy(struct dgde_xwayland *xwayland);
+
+#endif
@@ -9,6 +9,7 @@
 , wayland
 , wayland-protocols
 , wlroots
+, zlib
 }:
 stdenv.mkDerivation {
   name = "dgde";
@@ -28,5 +29,6 @@ stdenv.mkDerivation {
     wayland
     wayland-protocols
     libxkbcommon
+    zlib
   ];
 }
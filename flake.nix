@@ -16,6 +16,11 @@
 
       packages = {
         inherit compositor clients;
+        # everything behind a build option, so that CI compiles it too
+        compositor-full = compositor.override {
+          xwayland = true;
+          usdt = true;
+        };
       };
     });
 }